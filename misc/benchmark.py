@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+
+'''
+Compare the speed of verifiers generated by two builds of Rumur.
+
+Each model is turned into a verifier by both builds, compiled and run, and the
+rate at which each verifier fires rules is reported. For example, to measure a
+change against the test suite's models:
+
+  misc/benchmark.py --before ./rumur-old --after ./rumur-new tests/*.m
+
+Models whose verifiers are expected to fail, or that Rumur is expected to
+reject, are skipped, as are models that run too briefly to time reliably.
+'''
+
+import argparse
+import math
+import os
+import re
+import subprocess as sp
+import sys
+import tempfile
+import time
+from typing import List, Optional
+
+# recogniser for the '-- key: value' lines at the start of test models
+TWEAK_LINE = re.compile(r'\s*--\s*(?P<key>[a-zA-Z_]\w*)\s*:(?P<value>.*)$')
+
+# recogniser for the summary line of the verifier's XML output
+SUMMARY = re.compile(r'<summary\b[^>]*\brules_fired="(?P<rules>\d+)"')
+
+def tweaks(model: str) -> Optional[dict]:
+  '''
+  parse the options a test model gives its test harness, returning None if they
+  depend on the harness' own configuration
+  '''
+  result = {'rumur_flags': [], 'rumur_exit_code': 0, 'checker_exit_code': 0}
+  with open(model, 'rt', encoding='utf-8') as f:
+    for line in f:
+      m = TWEAK_LINE.match(line)
+      if m is None:
+        break
+      if m.group('key') in result:
+        try:
+          result[m.group('key')] = eval(m.group('value').strip())
+        except NameError:
+          return None
+  return result
+
+def measure(rumur: str, model: str, flags: List[str], cc: str,
+    cflags: List[str], repeat: int, timeout: float,
+    tmp: str) -> Optional[float]:
+  'return the rules fired per second by the verifier for a model'
+
+  verifier = os.path.join(tmp, 'verifier')
+  source = f'{verifier}.c'
+
+  p = sp.run([rumur, '--output', source, '--output-format', 'machine-readable',
+    model] + flags, stdout=sp.DEVNULL, stderr=sp.DEVNULL)
+  if p.returncode != 0:
+    return None
+
+  p = sp.run([cc] + cflags + ['-o', verifier, source, '-lpthread'],
+    stdout=sp.DEVNULL, stderr=sp.DEVNULL)
+  if p.returncode != 0:
+    return None
+
+  # take the fastest of several runs to reduce noise
+  best = None
+  for _ in range(repeat):
+    start = time.monotonic()
+    try:
+      p = sp.run([verifier], stdout=sp.PIPE, stderr=sp.DEVNULL,
+        universal_newlines=True, timeout=timeout)
+    except sp.TimeoutExpired:
+      return None
+    elapsed = time.monotonic() - start
+    if p.returncode != 0:
+      return None
+    m = SUMMARY.search(p.stdout)
+    if m is None:
+      return None
+    if best is None or elapsed < best[1]:
+      best = (int(m.group('rules')), elapsed)
+
+  rules, elapsed = best
+  if elapsed < MIN_SECONDS:
+    return None
+  return rules / elapsed
+
+def main(args: List[str]) -> int:
+  global MIN_SECONDS
+
+  parser = argparse.ArgumentParser(description='compare verifier speed between '
+    'two builds of Rumur')
+  parser.add_argument('--before', required=True, help='baseline Rumur binary')
+  parser.add_argument('--after', required=True, help='Rumur binary to compare')
+  parser.add_argument('--cc', default=os.environ.get('CC', 'cc'),
+    help='C compiler to use')
+  parser.add_argument('--cflags', default='-std=c11 -O3 -mcx16',
+    help='flags to pass to the C compiler')
+  parser.add_argument('--repeat', type=int, default=3,
+    help='number of times to run each verifier')
+  parser.add_argument('--timeout', type=float, default=300,
+    help='ignore models whose verifier takes longer than this many seconds')
+  parser.add_argument('--min-seconds', type=float, default=0.1,
+    help='ignore models whose verifier finishes quicker than this')
+  parser.add_argument('model', nargs='+', help='models to benchmark')
+  options = parser.parse_args(args[1:])
+
+  MIN_SECONDS = options.min_seconds
+  cflags = options.cflags.split()
+
+  speedups = []
+  print(f'{"model":40} {"before (rules/s)":>18} {"after (rules/s)":>18} '
+    f'{"speedup":>8}')
+
+  with tempfile.TemporaryDirectory() as tmp:
+    for model in options.model:
+
+      t = tweaks(model)
+      if t is None:
+        continue
+      if t['rumur_exit_code'] != 0 or t['checker_exit_code'] != 0:
+        continue
+
+      # run verifiers single-threaded to reduce variation between runs
+      flags = t['rumur_flags'] + ['--threads', '1']
+
+      before = measure(options.before, model, flags, options.cc, cflags,
+        options.repeat, options.timeout, tmp)
+      if before is None:
+        continue
+      after = measure(options.after, model, flags, options.cc, cflags,
+        options.repeat, options.timeout, tmp)
+      if after is None:
+        continue
+
+      speedups.append(after / before)
+      print(f'{os.path.basename(model):40} {before:18.0f} {after:18.0f} '
+        f'{after / before:7.2f}x', flush=True)
+
+  if len(speedups) == 0:
+    sys.stderr.write('no models could be measured\n')
+    return -1
+
+  mean = math.exp(sum(math.log(s) for s in speedups) / len(speedups))
+  print(f'\ngeometric mean speedup over {len(speedups)} models: {mean:.2f}x')
+
+  return 0
+
+MIN_SECONDS = 0.1
+
+if __name__ == '__main__':
+  sys.exit(main(sys.argv))
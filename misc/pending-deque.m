@@ -0,0 +1,221 @@
+/* Model of the work-stealing pending queue in the generated verifier.
+ *
+ * This replaced the lock-free linked list queue modelled in
+ * pending-queue-4k.m. Each thread has a circular array of states, into which
+ * only it enqueues. Any thread can take states from the top of an array by
+ * reading them and then advancing the top index with a compare-and-swap. The
+ * owner takes one state at a time, while a thief takes up to half the states
+ * present. The model below checks that no state is taken twice and that every
+ * state enqueued is eventually taken by someone.
+ *
+ * Where we abstract the implementation:
+ *   * We model a single queue, owned by thread 0, with every other thread
+ *     acting only as a thief. Thieves in the implementation move the states
+ *     they steal into their own queue, which is equivalent to the owner taking
+ *     them from the point of view of the victim's queue.
+ *   * In the implementation, the array grows when full. Growth copies the
+ *     states between top and bottom into a new array, leaving the old one in
+ *     place for thieves that are still reading it, so it does not affect which
+ *     states a thief reads. In the model, the owner waits for space instead.
+ *   * The states themselves are represented by the order in which they were
+ *     enqueued, 1 .. STATES, with 0 indicating a slot not yet written.
+ *
+ * All threads eventually finish, so this should be checked with
+ * `--deadlock-detection off`.
+ */
+const
+
+  -- number of threads
+  THREADS: 3
+
+  -- total number of states the owner enqueues
+  STATES: 5
+
+  -- number of slots in the circular array
+  CAPACITY: 2
+
+  -- maximum number of states a thief takes at once
+  STEAL_MAX: 2
+
+type
+
+  thread_id_t: 0 .. THREADS - 1
+
+  -- an index into the queue, before wrapping around the array
+  index_t: 0 .. STATES
+
+  -- a state, or 0 for none
+  state_t: 0 .. STATES
+
+  label_t: enum {
+
+    -- not running any operation
+    IDLE,
+
+    -- enqueueing (the owner only)
+    ENQUEUE_LOAD_TOP,
+    ENQUEUE_WRITE,
+    ENQUEUE_PUBLISH,
+
+    -- taking states from the top
+    TAKE_LOAD_BOTTOM,
+    TAKE_READ,
+    TAKE_CAS,
+
+    -- finished
+    DONE
+  }
+
+  thread_local: record
+    pc:    label_t
+    top:   index_t
+    bottom: index_t
+    count: 0 .. STEAL_MAX
+    i:     0 .. STEAL_MAX
+    taken: array [0 .. STEAL_MAX - 1] of state_t
+  end
+
+var
+
+  slots: array [0 .. CAPACITY - 1] of state_t
+  top: index_t
+  bottom: index_t
+
+  -- number of times each state has been taken
+  taken_count: array [1 .. STATES] of 0 .. THREADS
+
+  threads: array [thread_id_t] of thread_local
+
+startstate begin
+  for i: 0 .. CAPACITY - 1 do
+    slots[i] := 0;
+  end;
+  top := 0;
+  bottom := 0;
+  for i: 1 .. STATES do
+    taken_count[i] := 0;
+  end;
+  for t: thread_id_t do
+    threads[t].pc := IDLE;
+    threads[t].top := 0;
+    threads[t].bottom := 0;
+    threads[t].count := 0;
+    threads[t].i := 0;
+    for i: 0 .. STEAL_MAX - 1 do
+      threads[t].taken[i] := 0;
+    end;
+  end;
+end;
+
+ruleset t: thread_id_t do
+
+  alias self: threads[t] do
+
+    /* enqueue, the owner reading its own bottom with no race */
+
+    rule "start enqueue" t = 0 & self.pc = IDLE & bottom < STATES ==> begin
+      self.bottom := bottom;
+      self.pc := ENQUEUE_LOAD_TOP;
+    end;
+
+    rule "enqueue: load top" self.pc = ENQUEUE_LOAD_TOP ==> begin
+      self.top := top;
+      self.pc := ENQUEUE_WRITE;
+    end;
+
+    rule "enqueue: write slot" self.pc = ENQUEUE_WRITE ==> begin
+      if self.bottom - self.top >= CAPACITY then
+        -- full; try again later
+        self.pc := IDLE;
+      else
+        slots[self.bottom % CAPACITY] := self.bottom + 1;
+        self.pc := ENQUEUE_PUBLISH;
+      end;
+    end;
+
+    rule "enqueue: publish" self.pc = ENQUEUE_PUBLISH ==> begin
+      bottom := self.bottom + 1;
+      self.pc := IDLE;
+    end;
+
+    /* taking states, common to the owner and thieves */
+
+    rule "start take" self.pc = IDLE ==> begin
+      self.top := top;
+      self.pc := TAKE_LOAD_BOTTOM;
+    end;
+
+    rule "take: load bottom" self.pc = TAKE_LOAD_BOTTOM ==>
+    var
+      n: index_t;
+    begin
+      self.bottom := bottom;
+      if self.bottom <= self.top then
+        -- empty
+        if t != 0 | bottom = STATES then
+          self.pc := DONE;
+        else
+          self.pc := IDLE;
+        end;
+      else
+        if t = 0 then
+          self.count := 1;
+        else
+          -- steal half, rounding up
+          n := (self.bottom - self.top + 1) / 2;
+          if n > STEAL_MAX then
+            n := STEAL_MAX;
+          end;
+          self.count := n;
+        end;
+        self.i := 0;
+        self.pc := TAKE_READ;
+      end;
+    end;
+
+    rule "take: read slot" self.pc = TAKE_READ ==> begin
+      self.taken[self.i] := slots[(self.top + self.i) % CAPACITY];
+      self.i := self.i + 1;
+      if self.i = self.count then
+        self.pc := TAKE_CAS;
+      end;
+    end;
+
+    rule "take: advance top" self.pc = TAKE_CAS ==> begin
+      if top = self.top then
+        top := self.top + self.count;
+        for i: 0 .. STEAL_MAX - 1 do
+          if i < self.count then
+            assert self.taken[i] != 0 "took a slot that was never written";
+            assert self.taken[i] = self.top + i + 1 "took a stale state";
+            taken_count[self.taken[i]] := taken_count[self.taken[i]] + 1;
+          end;
+        end;
+      end;
+      for i: 0 .. STEAL_MAX - 1 do
+        self.taken[i] := 0;
+      end;
+      self.count := 0;
+      self.i := 0;
+      self.pc := IDLE;
+    end;
+
+    /* a thief that found the queue empty may come back later */
+
+    rule "thief retry" t != 0 & self.pc = DONE & bottom < STATES ==> begin
+      self.pc := IDLE;
+    end;
+
+  end;
+
+end;
+
+invariant "no state taken more than once"
+  forall i: 1 .. STATES do taken_count[i] <= 1 end;
+
+invariant "top never passes bottom"
+  top <= bottom;
+
+invariant "every state is taken once the owner is finished"
+  threads[0].pc = DONE ->
+    forall i: 1 .. STATES do taken_count[i] = 1 end;
@@ -1,4 +1,10 @@
-/* Model of the pending queue algorithm in the generated verifier. This was
+/* Update: the generated verifier now uses the work-stealing queue modelled in
+ * pending-deque.m. This model of the prior linked list queue has been retained
+ * as an interesting large model to run through Rumur.
+ *
+ * ----
+ *
+ * Model of the pending queue algorithm in the generated verifier. This was
  * originally adapted from pending-queue.m.
  *
  * The generated verifier uses a moderately complex lock-free algorithm for
@@ -42,9 +42,17 @@
 /* The size of the compressed state data in bytes. */
 enum { STATE_SIZE_BYTES = BITS_TO_BYTES(STATE_SIZE_BITS) };
 
+/* Whether each state points to the state it was reached from. With
+ * COUNTEREXAMPLE_REPLAY, a counterexample trace is instead reconstructed by
+ * replaying exploration, and only liveness checking needs this pointer.
+ */
+#define STATE_PREVIOUS \
+  ((COUNTEREXAMPLE_TRACE != CEX_OFF && !COUNTEREXAMPLE_REPLAY) \
+    || LIVENESS_COUNT > 0)
+
 /* the size of auxliary members of the state struct */
 enum { BOUND_BITS = BITS_FOR(BOUND) };
-#if COUNTEREXAMPLE_TRACE != CEX_OFF || LIVENESS_COUNT > 0
+#if STATE_PREVIOUS
   #if POINTER_BITS != 0
     enum { PREVIOUS_BITS = POINTER_BITS };
   #elif defined(__linux__) && defined(__x86_64__) && !defined(__ILP32__)
@@ -59,14 +67,69 @@ enum { BOUND_BITS = BITS_FOR(BOUND) };
 #else
   enum { PREVIOUS_BITS = 0 };
 #endif
-#if COUNTEREXAMPLE_TRACE != CEX_OFF
+#if COUNTEREXAMPLE_TRACE != CEX_OFF && !COUNTEREXAMPLE_REPLAY
   enum { RULE_TAKEN_BITS = BITS_FOR(RULE_TAKEN_LIMIT) };
 #else
   enum { RULE_TAKEN_BITS = 0 };
 #endif
+#if COUNTEREXAMPLE_REPLAY
+  /* low bits of the hash of the state this one was reached from */
+  enum { PARENT_HASH_BITS = 16 };
+#else
+  enum { PARENT_HASH_BITS = 0 };
+#endif
 enum { STATE_OTHER_BYTES
   = BITS_TO_BYTES(BOUND_BITS + PREVIOUS_BITS + RULE_TAKEN_BITS
-  + (USE_SCALARSET_SCHEDULES ? SCHEDULE_BITS : 0)) };
+  + PARENT_HASH_BITS + (USE_SCALARSET_SCHEDULES ? SCHEDULE_BITS : 0)) };
+
+/* The generator asks for small states to be stored inline in 8- or 16-byte
+ * slots of the seen set when nothing needs to refer to a state once it has been
+ * expanded. Without a 128-bit type and a lock-free compare-and-swap to hold and
+ * update a 16-byte slot (on x86-64, this needs -mcx16), the set points to
+ * states as usual.
+ */
+#if INLINE_STATES == 16 && (!defined(__SIZEOF_INT128__) \
+  || !defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16))
+  #undef INLINE_STATES
+  #define INLINE_STATES 0
+#endif
+
+/* Whether the seen set keeps states alive after they have been inserted. With
+ * hash compaction or a bitstate search, the set only records a summary of each
+ * state, with inline states it records a copy, and with tree compression an
+ * encoding of one. Either way a state can be discarded once it has been
+ * expanded.
+ */
+#define SEEN_SET_RETAINS_STATES \
+  (HASH_COMPACTION_BITS == 0 && BITSTATE_MB == 0 && !EXTERNAL_MEMORY \
+    && INLINE_STATES == 0 && TREE_COMPRESSION_MB == 0)
+
+/* Whether each seen set slot points to a state, as opposed to holding the
+ * fingerprint, contents or compressed tree of one.
+ */
+#define SLOTS_POINT_TO_STATES \
+  (HASH_COMPACTION_BITS == 0 && INLINE_STATES == 0 && TREE_COMPRESSION_MB == 0)
+
+_Static_assert(SEEN_SET_RETAINS_STATES || LIVENESS_COUNT == 0,
+  "liveness checking requires the seen set to retain states");
+_Static_assert((HASH_COMPACTION_BITS > 0) + (BITSTATE_MB > 0) + EXTERNAL_MEMORY
+  + (TREE_COMPRESSION_MB > 0) <= 1, "hash compaction, bitstate search, "
+  "external memory, and tree compression are mutually exclusive");
+_Static_assert(!EXTERNAL_MEMORY || THREADS == 1,
+  "external memory exploration is single threaded");
+_Static_assert(!EXTERNAL_MEMORY || STATE_SIZE_BYTES > 0,
+  "external memory exploration requires a model with state variables");
+_Static_assert(SEEN_SET_RETAINS_STATES || (!CHECKPOINT && !RESUME),
+  "checkpoints require the seen set to retain states");
+_Static_assert(SEEN_SET_RETAINS_STATES || !COUNTEREXAMPLE_REPLAY,
+  "counterexample replay requires the seen set to retain states");
+_Static_assert(LIVENESS_COUNT == 0 || !COUNTEREXAMPLE_REPLAY,
+  "counterexample replay cannot be used with liveness properties");
+_Static_assert(INLINE_STATES == 0 || (HASH_COMPACTION_BITS == 0
+  && BITSTATE_MB == 0 && !EXTERNAL_MEMORY && TREE_COMPRESSION_MB == 0),
+  "inline states are only stored in the default seen set");
+_Static_assert(INLINE_STATES == 0 || COUNTEREXAMPLE_TRACE == CEX_OFF,
+  "counterexample traces require the seen set to retain states");
 
 /* Implement _Thread_local for GCC <4.9, which is missing this. */
 #if defined(__GNUC__) && defined(__GNUC_MINOR__)
@@ -103,6 +166,9 @@ enum { STATE_OTHER_BYTES
  */
 static _Thread_local size_t thread_id;
 
+/* Index of this process among those exploring the state space. */
+static size_t process_id;
+
 /* The threads themselves. Note that we have no element for the initial thread,
  * so *your* thread is 'threads[thread_id - 1]'.
  */
@@ -143,11 +209,15 @@ _Static_assert(MAX_ERRORS > 0, "illegal MAX_ERRORS value");
  *      hit MAX_ERRORS. In this case we want to longjmp back to resume checking.
  *   2. We failed an assume statement. In this case we want to mark the current
  *      state as invalid and resume checking with the next state.
- * In either scenario the actual longjmp performed is the same, but by knowing
- * statically whether either can occur we can avoid calling setjmp if both are
+ *   3. We hit an error while replaying exploration to reconstruct a
+ *      counterexample trace. In this case we want to skip the transition that
+ *      caused it.
+ * In each scenario the actual longjmp performed is the same, but by knowing
+ * statically whether any can occur we can avoid calling setjmp if all are
  * impossible.
  */
-enum { JMP_BUF_NEEDED = MAX_ERRORS > 1 || ASSUME_STATEMENTS_COUNT > 0 };
+enum { JMP_BUF_NEEDED = MAX_ERRORS > 1 || ASSUME_STATEMENTS_COUNT > 0
+  || COUNTEREXAMPLE_REPLAY };
 
 /*******************************************************************************
  * Sandbox support.                                                            *
@@ -267,7 +337,7 @@ static void sandbox(void) {
 #endif
 #ifdef __NR_madvise
       BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_madvise, 0, 1),
-      BPF_STMT(BPF_RET|BPF_K, THREADS > 1 ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+      BPF_STMT(BPF_RET|BPF_K, THREADS > 1 || HUGE_PAGES != HUGE_PAGES_OFF ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
 #endif
 #ifdef __NR_mprotect
       BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_mprotect, 0, 1),
@@ -280,13 +350,75 @@ static void sandbox(void) {
 #endif
 #ifdef __NR_read
       BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_read, 0, 1),
-      BPF_STMT(BPF_RET|BPF_K, THREADS > 1 ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+      BPF_STMT(BPF_RET|BPF_K, THREADS > 1 || EXTERNAL_MEMORY || RESUME || PROCESSES > 1 ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
 #endif
 #ifdef __NR_set_robust_list
       BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_set_robust_list, 0, 1),
       BPF_STMT(BPF_RET|BPF_K, THREADS > 1 ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
 #endif
 
+      /* If we're placing threads and memory by NUMA node, enable syscalls used
+       * for this.
+       */
+#ifdef __NR_sched_setaffinity
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_sched_setaffinity, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, NUMA ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+#endif
+#ifdef __NR_mbind
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_mbind, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, NUMA ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+#endif
+
+      /* If we're using external memory or checkpointing, enable syscalls used
+       * for file I/O. The files themselves were opened before entering the
+       * sandbox.
+       */
+#ifdef __NR_lseek
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_lseek, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, EXTERNAL_MEMORY || CHECKPOINT || SIZE_HINT ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+#endif
+#ifdef __NR__llseek
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR__llseek, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, EXTERNAL_MEMORY || CHECKPOINT || SIZE_HINT ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+#endif
+#ifdef __NR_ftruncate
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_ftruncate, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, EXTERNAL_MEMORY || CHECKPOINT || SIZE_HINT ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+#endif
+#ifdef __NR_ftruncate64
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_ftruncate64, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, EXTERNAL_MEMORY || CHECKPOINT || SIZE_HINT ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+#endif
+#ifdef __NR_newfstatat
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_newfstatat, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, EXTERNAL_MEMORY || CHECKPOINT || RESUME || SIZE_HINT ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+#endif
+#ifdef __NR_fstatat64
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_fstatat64, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, EXTERNAL_MEMORY || CHECKPOINT || RESUME || SIZE_HINT ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+#endif
+#ifdef __NR_fsync
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_fsync, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, CHECKPOINT ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+#endif
+
+      /* If we're exploring with multiple processes, enable syscalls used to
+       * exchange states over the sockets connecting them and for process 0 to
+       * wait on the others.
+       */
+#ifdef __NR_poll
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_poll, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, PROCESSES > 1 ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+#endif
+#ifdef __NR_ppoll
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_ppoll, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, PROCESSES > 1 ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+#endif
+#ifdef __NR_wait4
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_wait4, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, PROCESSES > 1 ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+#endif
+
       /* on platforms without vDSO support, time() makes an actual syscall, so
        * we need to allow them
        */
@@ -539,6 +671,185 @@ static void *xcalloc(size_t count, size_t size) {
   return p;
 }
 
+/* Grow an array of `count` elements of `size` bytes, if it is full. */
+static __attribute__((unused)) void *array_reserve(void *p, size_t count,
+    size_t *NONNULL capacity, size_t size) {
+  if (count < *capacity) {
+    return p;
+  }
+  *capacity = *capacity == 0 ? 4096 / size : *capacity * 2;
+  p = realloc(p, *capacity * size);
+  if (__builtin_expect(p == NULL, 0)) {
+    oom();
+  }
+  return p;
+}
+
+/*******************************************************************************
+ * Huge page allocation.                                                       *
+ *                                                                             *
+ * With `--huge-pages`, the seen set and state arenas are mapped directly and  *
+ * backed by huge pages where possible, to reduce TLB misses when accessing    *
+ * large tables. Explicit huge pages come from the kernel's reserved pool (see *
+ * /proc/sys/vm/nr_hugepages), while transparent huge pages are requested with *
+ * madvise. If neither is available, normal pages are used.                    *
+ ******************************************************************************/
+
+/* Granularity of the allocations below and the kind of pages they obtain. */
+static size_t huge_page_size;
+static enum {
+  PAGES_NORMAL,
+  PAGES_TRANSPARENT,
+  PAGES_EXPLICIT,
+} huge_page_kind;
+
+#if HUGE_PAGES != HUGE_PAGES_OFF && defined(__linux__)
+static void huge_pages_init(void) {
+
+  long page_size = sysconf(_SC_PAGESIZE);
+  huge_page_size = page_size > 0 ? (size_t)page_size : 4096;
+  huge_page_kind = PAGES_NORMAL;
+
+  if (HUGE_PAGES == HUGE_PAGES_EXPLICIT) {
+
+    /* find the size of pages in the reserved pool */
+    size_t size = 0;
+    FILE *f = fopen("/proc/meminfo", "r");
+    if (f != NULL) {
+      char line[128];
+      while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "Hugepagesize: %zu kB", &size) == 1) {
+          size *= 1024;
+          break;
+        }
+      }
+      (void)fclose(f);
+    }
+
+    /* check the pool actually has a page for us */
+    if (size > 0) {
+      void *p = mmap(NULL, size, PROT_READ|PROT_WRITE,
+        MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+      if (p != MAP_FAILED) {
+        (void)munmap(p, size);
+        huge_page_size = size;
+        huge_page_kind = PAGES_EXPLICIT;
+        return;
+      }
+    }
+  }
+
+  /* otherwise, see if transparent huge pages are enabled */
+  FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+  if (f == NULL) {
+    return;
+  }
+  char line[128];
+  bool enabled = fgets(line, sizeof(line), f) != NULL
+    && strstr(line, "[never]") == NULL;
+  (void)fclose(f);
+  if (!enabled) {
+    return;
+  }
+
+  size_t size = 2 * 1024 * 1024;
+  f = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+  if (f != NULL) {
+    size_t s;
+    if (fscanf(f, "%zu", &s) == 1 && s > 0) {
+      size = s;
+    }
+    (void)fclose(f);
+  }
+  huge_page_size = size;
+  huge_page_kind = PAGES_TRANSPARENT;
+}
+
+/* Allocate zeroed memory, returning NULL on failure. This must be released
+ * with huge_free().
+ */
+static void *huge_calloc(size_t size) {
+
+  /* Round up to whole huge pages. Normal pages that are never touched cost
+   * nothing, so we do this regardless of which kind of pages we get.
+   */
+  size_t len = (size + huge_page_size - 1) & ~(huge_page_size - 1);
+  if (len < size) {
+    return NULL;
+  }
+
+  /* Allocations smaller than a huge page are not worth taking from the pool. */
+  if (huge_page_kind == PAGES_EXPLICIT && size >= huge_page_size) {
+    void *p = mmap(NULL, len, PROT_READ|PROT_WRITE,
+      MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      return p;
+    }
+    /* The pool is exhausted. Fall back to normal pages. */
+  }
+
+  if (huge_page_kind == PAGES_TRANSPARENT) {
+    /* Only aligned memory can be backed by transparent huge pages, so
+     * over-allocate and trim the excess either side of an aligned region.
+     */
+    if (len + huge_page_size < len) {
+      return NULL;
+    }
+    void *p = mmap(NULL, len + huge_page_size, PROT_READ|PROT_WRITE,
+      MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      return NULL;
+    }
+    uintptr_t start = ((uintptr_t)p + huge_page_size - 1)
+      & ~(uintptr_t)(huge_page_size - 1);
+    size_t head = start - (uintptr_t)p;
+    if (head > 0) {
+      (void)munmap(p, head);
+    }
+    if (huge_page_size - head > 0) {
+      (void)munmap((void*)(start + len), huge_page_size - head);
+    }
+    (void)madvise((void*)start, len, MADV_HUGEPAGE);
+    return (void*)start;
+  }
+
+  void *p = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS,
+    -1, 0);
+  return p == MAP_FAILED ? NULL : p;
+}
+
+static void huge_free(void *p, size_t size) {
+  if (p == NULL) {
+    return;
+  }
+  size_t len = (size + huge_page_size - 1) & ~(huge_page_size - 1);
+  (void)munmap(p, len);
+}
+#else
+static void huge_pages_init(void) {
+  long page_size = sysconf(_SC_PAGESIZE);
+  huge_page_size = page_size > 0 ? (size_t)page_size : 4096;
+  huge_page_kind = PAGES_NORMAL;
+}
+
+static void *huge_calloc(size_t size) {
+  return calloc(1, size);
+}
+
+static void huge_free(void *p, size_t size) {
+  (void)size;
+  free(p);
+}
+#endif
+
+static void *xhuge_calloc(size_t size) {
+  void *p = huge_calloc(size);
+  if (__builtin_expect(p == NULL, 0)) {
+    oom();
+  }
+  return p;
+}
+
 static void put(const char *NONNULL s) {
   for (; *s != '\0'; ++s) {
     putchar_unlocked(*s);
@@ -557,6 +868,12 @@ static void put_uint(uintmax_t u) {
   put(buffer);
 }
 
+static __attribute__((unused)) void put_double(double d) {
+  char buffer[128] = { 0 };
+  snprintf(buffer, sizeof(buffer), "%g", d);
+  put(buffer);
+}
+
 static __attribute__((unused)) void put_val(value_t v) {
   if (value_is_signed()) {
     put_int((intmax_t)v);
@@ -644,6 +961,16 @@ struct state {
      LIVENESS_COUNT / sizeof(uintptr_t) % CHAR_BIT == 0 ? 0 : 1)];
 #endif
 
+#if CACHE_HASH
+  /* hash of 'data', or 0 if it has not been computed yet */
+  size_t hash;
+#endif
+
+#if INCREMENTAL_HASH
+  /* Zobrist hash of 'data', kept up to date on every write to it */
+  uint64_t zobrist;
+#endif
+
   uint8_t data[STATE_SIZE_BYTES];
 
 #if PACK_STATE
@@ -652,6 +979,7 @@ struct state {
    *  * uint64_t bound;
    *  * const struct state *previous;
    *  * uint64_t rule_taken;
+   *  * uint16_t parent_hash;
    *  * uint8_t schedules[BITS_TO_BYTES(SCHEDULE_BITS)];
    *
    * They are bit-packed, so may take up less space. E.g. if the maximum value
@@ -662,6 +990,9 @@ struct state {
   uint64_t bound;
   const struct state *previous;
   uint64_t rule_taken;
+#if COUNTEREXAMPLE_REPLAY
+  uint16_t parent_hash;
+#endif
   uint8_t schedules[USE_SCALARSET_SCHEDULES ? BITS_TO_BYTES(SCHEDULE_BITS) : 0];
 #endif
 };
@@ -747,6 +1078,14 @@ static unsigned __int128 copy_out128(const uint8_t *p, size_t extent) {
 }
 #endif
 
+/* Is this handle byte-aligned and of a width that can be read or written with a
+ * single load or store? With --state-layout fast, most fields are.
+ */
+static bool handle_is_aligned(struct handle h) {
+  return h.offset == 0
+    && (h.width == 8 || h.width == 16 || h.width == 32 || h.width == 64);
+}
+
 /* If you are in the Rumur repository modifying the following function, remember
  * to also update ../../misc/read-raw.smt2.
  */
@@ -759,6 +1098,19 @@ static __attribute__((pure)) uint64_t read_raw(struct handle h) {
     return 0;
   }
 
+  /* Aligned fields can be loaded directly, without the shifting and masking
+   * below. Each of these calls has a constant extent so compiles to a single
+   * load.
+   */
+  if (FAST_LAYOUT && handle_is_aligned(h)) {
+    switch (h.width) {
+      case 8:  return copy_out64(h.base, 1);
+      case 16: return copy_out64(h.base, 2);
+      case 32: return copy_out64(h.base, 4);
+      default: return copy_out64(h.base, 8);
+    }
+  }
+
   /* Generate a handle that is offset- and width-aligned on byte boundaries.
    * Essentially, we widen the handle to align it. The motivation for this is
    * that we can only do byte-granularity reads, so we need to "over-read" if we
@@ -909,6 +1261,16 @@ static void write_raw(struct handle h, uint64_t v) {
     v &= (UINT64_C(1) << h.width) - 1;
   }
 
+  /* as in read_raw(), store directly to aligned fields */
+  if (FAST_LAYOUT && handle_is_aligned(h)) {
+    switch (h.width) {
+      case 8:  copy_in64(h.base, v, 1); return;
+      case 16: copy_in64(h.base, v, 2); return;
+      case 32: copy_in64(h.base, v, 4); return;
+      default: copy_in64(h.base, v, 8); return;
+    }
+  }
+
   /* Generate a offset- and width-aligned handle on byte boundaries. */
   struct handle aligned = handle_align(h);
   ASSERT(aligned.offset == 0);
@@ -1080,7 +1442,7 @@ static void state_bound_set(struct state *NONNULL s, uint64_t bound) {
 }
 #endif
 
-#if COUNTEREXAMPLE_TRACE != CEX_OFF || LIVENESS_COUNT > 0
+#if STATE_PREVIOUS
 #if PACK_STATE
 static struct handle state_previous_handle(const struct state *NONNULL s) {
 
@@ -1119,7 +1481,7 @@ static void state_previous_set(struct state *NONNULL s,
 }
 #endif
 
-#if COUNTEREXAMPLE_TRACE != CEX_OFF
+#if COUNTEREXAMPLE_TRACE != CEX_OFF && !COUNTEREXAMPLE_REPLAY
 #if PACK_STATE
 static struct handle state_rule_taken_handle(const struct state *NONNULL s) {
 
@@ -1157,6 +1519,61 @@ static void state_rule_taken_set(struct state *NONNULL s, uint64_t rule_taken) {
 }
 #endif
 
+#if COUNTEREXAMPLE_REPLAY
+/* States do not record the rule that produced them, because the path to any
+ * state in the seen set can be recovered by replay (see trace_replay()). The
+ * exception is the final step of a counterexample, whose target may be a
+ * successor that failed to make it into the seen set. So each thread tracks
+ * the state it is expanding and the rule it last fired.
+ */
+static _Thread_local const struct state *trace_expanding;
+static _Thread_local uint64_t trace_rule;
+
+/* Whether this thread is currently replaying exploration. */
+static _Thread_local bool trace_replaying;
+
+static void state_rule_taken_set(struct state *NONNULL s __attribute__((unused)),
+    uint64_t rule_taken) {
+  trace_rule = rule_taken;
+}
+
+#if PACK_STATE
+static struct handle state_parent_hash_handle(const struct state *NONNULL s) {
+
+  size_t offset = BOUND_BITS + PREVIOUS_BITS + RULE_TAKEN_BITS;
+
+  struct handle h = (struct handle){
+    .base = (uint8_t*)s->other + offset / 8,
+    .offset = offset % 8,
+    .width = PARENT_HASH_BITS,
+  };
+
+  return h;
+}
+#endif
+
+static __attribute__((pure)) uint16_t state_parent_hash_get(
+    const struct state *NONNULL s) {
+  assert(s != NULL);
+#if PACK_STATE
+  struct handle h = state_parent_hash_handle(s);
+  return (uint16_t)read_raw(h);
+#else
+  return s->parent_hash;
+#endif
+}
+
+static void state_parent_hash_set(struct state *NONNULL s, size_t hash) {
+  assert(s != NULL);
+#if PACK_STATE
+  struct handle h = state_parent_hash_handle(s);
+  write_raw(h, (uint16_t)hash);
+#else
+  s->parent_hash = (uint16_t)hash;
+#endif
+}
+#endif
+
 static struct handle state_schedule_handle(const struct state *NONNULL s,
     size_t offset, size_t width) {
 
@@ -1178,7 +1595,7 @@ static struct handle state_schedule_handle(const struct state *NONNULL s,
 
 #if PACK_STATE
   b = (uint8_t*)s->other;
-  o = BOUND_BITS + PREVIOUS_BITS + RULE_TAKEN_BITS + offset;
+  o = BOUND_BITS + PREVIOUS_BITS + RULE_TAKEN_BITS + PARENT_HASH_BITS + offset;
 #else
   b = (uint8_t*)s->schedules;
   o = offset;
@@ -1217,6 +1634,214 @@ static __attribute__((unused)) void state_schedule_set(
   write_raw(h, (uint64_t)v);
 }
 
+/*******************************************************************************
+ * NUMA placement.                                                             *
+ *                                                                             *
+ * With `--numa on`, each thread is pinned to a CPU, with threads spread in    *
+ * contiguous blocks across the machine's NUMA nodes. The seen set, which all  *
+ * threads access, is interleaved across nodes, while each thread's state      *
+ * arena and queue are kept on its own node. On a machine with a single node,  *
+ * or on platforms other than Linux, none of this has any effect.              *
+ ******************************************************************************/
+
+/* Number of nodes threads have been placed across, or 0 if NUMA placement is
+ * not in effect.
+ */
+static size_t numa_nodes;
+
+#if NUMA && defined(__linux__)
+/* Limit on the node numbers we recognise, such that a mask of them fits in a
+ * word.
+ */
+enum { NUMA_MAX_NODES = sizeof(unsigned long) * CHAR_BIT };
+
+/* The node each thread runs on and the CPU it is pinned to. */
+static unsigned numa_thread_node[THREADS];
+static int numa_thread_cpu[THREADS];
+
+/* Mask of all nodes with CPUs available to us. */
+static unsigned long numa_all_nodes;
+
+static size_t numa_page_size;
+
+/* Pin the calling thread to its CPU. */
+static void numa_pin(void) {
+  if (numa_nodes == 0) {
+    return;
+  }
+
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(numa_thread_cpu[thread_id], &cpus);
+
+  /* Placement is only an optimisation, so ignore failure. */
+  (void)sched_setaffinity(0, sizeof(cpus), &cpus);
+}
+
+static void numa_init(void) {
+
+  /* Running multiple processes would pin each of their threads to the same
+   * CPUs, so leave placement to the OS.
+   */
+  if (PROCESSES > 1) {
+    return;
+  }
+
+  /* respect any restriction we were started with, e.g. by taskset */
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    return;
+  }
+
+  /* find the CPUs we can use on each node */
+  cpu_set_t node_cpus[NUMA_MAX_NODES];
+  unsigned node_ids[NUMA_MAX_NODES];
+  size_t count = 0;
+  for (unsigned node = 0; node < NUMA_MAX_NODES; node++) {
+
+    char path[64];
+    (void)snprintf(path, sizeof(path),
+      "/sys/devices/system/node/node%u/cpulist", node);
+
+    /* node numbers are not necessarily contiguous */
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+      continue;
+    }
+
+    /* parse a list of CPU ranges, e.g. "0-3,8-11" */
+    CPU_ZERO(&node_cpus[count]);
+    for (;;) {
+      unsigned lo, hi;
+      if (fscanf(f, "%u", &lo) != 1) {
+        break;
+      }
+      hi = lo;
+      int c = fgetc(f);
+      if (c == '-') {
+        if (fscanf(f, "%u", &hi) != 1) {
+          break;
+        }
+        c = fgetc(f);
+      }
+      for (unsigned cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed)) {
+          CPU_SET(cpu, &node_cpus[count]);
+        }
+      }
+      if (c != ',') {
+        break;
+      }
+    }
+    (void)fclose(f);
+
+    /* ignore nodes that have memory but no CPUs we can use */
+    if (CPU_COUNT(&node_cpus[count]) > 0) {
+      node_ids[count] = node;
+      count++;
+    }
+  }
+
+  /* with a single node, there is nothing to gain */
+  if (count < 2) {
+    return;
+  }
+
+  long page_size = sysconf(_SC_PAGESIZE);
+  if (page_size <= 0) {
+    return;
+  }
+  numa_page_size = (size_t)page_size;
+
+  for (size_t i = 0; i < count; i++) {
+    numa_all_nodes |= 1ul << node_ids[i];
+  }
+
+  /* Assign threads to nodes in contiguous blocks, so neighbouring threads
+   * share a node, and round robin to CPUs within each node.
+   */
+  for (size_t i = 0; i < THREADS; i++) {
+    size_t node = i * count / THREADS;
+    size_t first = (node * THREADS + count - 1) / count;
+    size_t k = (i - first) % (size_t)CPU_COUNT(&node_cpus[node]);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &node_cpus[node])) {
+        if (k == 0) {
+          numa_thread_cpu[i] = cpu;
+          break;
+        }
+        k--;
+      }
+    }
+    numa_thread_node[i] = node_ids[node];
+  }
+
+  numa_nodes = count < THREADS ? count : THREADS;
+
+  /* we are the initial thread, so pin ourselves now */
+  numa_pin();
+}
+
+/* Apply a memory policy to the pages lying wholly within the given memory.
+ * Pages that have already been touched are left where they are.
+ */
+static void numa_bind(void *p, size_t size, int mode, unsigned long nodes) {
+  if (numa_nodes == 0) {
+    return;
+  }
+
+  uintptr_t start = ((uintptr_t)p + numa_page_size - 1)
+    & ~(uintptr_t)(numa_page_size - 1);
+  uintptr_t end = ((uintptr_t)p + size) & ~(uintptr_t)(numa_page_size - 1);
+  if (end <= start) {
+    return;
+  }
+
+  /* Placement is only an optimisation, so ignore failure. */
+  (void)syscall(SYS_mbind, (void*)start, end - start, mode, &nodes,
+    NUMA_MAX_NODES + 1, 0);
+}
+
+/* Place memory on the given thread's node. */
+static void numa_local(void *p, size_t size, size_t thread) {
+  if (numa_nodes == 0) {
+    return;
+  }
+  numa_bind(p, size, MPOL_PREFERRED, 1ul << numa_thread_node[thread]);
+}
+
+/* Spread memory accessed by all threads across nodes. */
+static void numa_interleave(void *p, size_t size) {
+  numa_bind(p, size, MPOL_INTERLEAVE, numa_all_nodes);
+}
+
+/* Does the given thread run on the same node as us? */
+static bool numa_is_local(size_t thread) {
+  return numa_nodes == 0
+    || numa_thread_node[thread] == numa_thread_node[thread_id];
+}
+#else
+static void numa_init(void) { }
+
+static void numa_pin(void) { }
+
+static void numa_local(void *p, size_t size, size_t thread) {
+  (void)p;
+  (void)size;
+  (void)thread;
+}
+
+static void numa_interleave(void *p, size_t size) {
+  (void)p;
+  (void)size;
+}
+
+static bool numa_is_local(size_t thread) {
+  (void)thread;
+  return true;
+}
+#endif
+
 /*******************************************************************************
  * State allocator.                                                            *
  *                                                                             *
@@ -1235,15 +1860,35 @@ static _Thread_local size_t arena_count =
 static _Thread_local struct state *arena_base;
 static _Thread_local struct state *arena_limit;
 
+#if !SEEN_SET_RETAINS_STATES
+/* Discarded states that have been expanded are not necessarily at the top of
+ * any thread's arena, so we keep a thread-local stack of them for reuse.
+ */
+static _Thread_local struct state **recycled;
+static _Thread_local size_t recycled_count;
+static _Thread_local size_t recycled_capacity;
+#endif
+
 static struct state *state_new(void) {
 
+#if !SEEN_SET_RETAINS_STATES
+  if (recycled_count > 0) {
+    recycled_count--;
+    struct state *s = recycled[recycled_count];
+#if CACHE_HASH
+    s->hash = 0;
+#endif
+    return s;
+  }
+#endif
+
   if (arena_base == arena_limit) {
     /* Allocation pool is empty. We need to set up a new pool. */
     for (;;) {
       if (arena_count == 1) {
         arena_base = xmalloc(sizeof(*arena_base));
       } else {
-        arena_base = calloc(arena_count, sizeof(*arena_base));
+        arena_base = huge_calloc(arena_count * sizeof(*arena_base));
         if (__builtin_expect(arena_base == NULL, 0)) {
           /* Memory pressure high. Decrease our attempted allocation and try
            * again.
@@ -1254,6 +1899,7 @@ static struct state *state_new(void) {
       }
 
       arena_limit = arena_base + arena_count;
+      numa_local(arena_base, arena_count * sizeof(*arena_base), thread_id);
       break;
     }
   }
@@ -1263,6 +1909,10 @@ static struct state *state_new(void) {
 
   struct state *s = arena_base;
   arena_base++;
+#if CACHE_HASH
+  /* this may be a previously freed state */
+  s->hash = 0;
+#endif
   return s;
 }
 
@@ -1272,15 +1922,58 @@ static void state_free(struct state *s) {
     return;
   }
 
+#if !SEEN_SET_RETAINS_STATES
+  if (s + 1 != arena_base) {
+    if (recycled_count == recycled_capacity) {
+      recycled_capacity = recycled_capacity == 0 ? 1024 : recycled_capacity * 2;
+      recycled = realloc(recycled, recycled_capacity * sizeof(recycled[0]));
+      if (__builtin_expect(recycled == NULL, 0)) {
+        oom();
+      }
+    }
+    recycled[recycled_count] = s;
+    recycled_count++;
+    return;
+  }
+#endif
+
   assert(s + 1 == arena_base);
   arena_base--;
 }
 
-/*******************************************************************************
- * statistics for memory usage                                                 *
- *                                                                             *
+/* Give back this thread's allocation pool, if none of its states are still in
+ * use. This is for short-lived threads whose states are all temporaries.
+ */
+static __attribute__((unused)) void state_arena_release(void) {
+
+  if (arena_base == NULL) {
+    return;
+  }
+
+  struct state *start = arena_limit - arena_count;
+  if (arena_base != start) {
+    return;
+  }
+
+  if (arena_count == 1) {
+    free(start);
+  } else {
+    huge_free(start, arena_count * sizeof(*start));
+  }
+  arena_base = arena_limit = NULL;
+
+#if !SEEN_SET_RETAINS_STATES
+  free(recycled);
+  recycled = NULL;
+  recycled_count = recycled_capacity = 0;
+#endif
+}
+
+/*******************************************************************************
+ * statistics for memory usage                                                 *
+ *                                                                             *
  * This functionality is only used when `--trace memory_usage` is given on the *
- * command line.                                                               *
+ * command line, or when `--size-hint` is given with `--bound`.                *
  ******************************************************************************/
 
 /* number of allocated state structs per depth of expansion */
@@ -1289,8 +1982,10 @@ static size_t allocated[BOUND == 0 ? 1 : (BOUND + 1)];
 /* note a new allocation of a state struct at the given depth */
 static void register_allocation(size_t depth) {
 
-  /* if we are not tracing memory usage, make this a no-op */
-  if (!(TC_MEMORY_USAGE & TRACES_ENABLED)) {
+  /* if we are not tracing memory usage or recording the states at each depth,
+   * make this a no-op
+   */
+  if (!(TC_MEMORY_USAGE & TRACES_ENABLED) && !(SIZE_HINT && BOUND > 0)) {
     return;
   }
 
@@ -1352,12 +2047,60 @@ static void print_counterexample(
  */
 static _Noreturn int exit_with(int status);
 
+static struct state *state_dup(const struct state *NONNULL s);
+
+#if COUNTEREXAMPLE_TRACE != CEX_OFF
+/* The rule whose guard is currently being evaluated, or 0 if none is. Guards
+ * are evaluated against the state being expanded rather than a copy of it, so
+ * this lets error() reconstruct the step that led to a failing guard.
+ */
+static _Thread_local uint64_t guard_rule_taken;
+#endif
+
+static void guard_enter(uint64_t rule_taken __attribute__((unused))) {
+#if COUNTEREXAMPLE_TRACE != CEX_OFF
+  guard_rule_taken = rule_taken;
+#endif
+}
+
+static void guard_leave(void) {
+#if COUNTEREXAMPLE_TRACE != CEX_OFF
+  guard_rule_taken = 0;
+#endif
+}
+
 static __attribute__((format(printf, 2, 3))) _Noreturn void error(
   const struct state *NONNULL s, const char *NONNULL fmt, ...) {
 
+#if COUNTEREXAMPLE_REPLAY
+  if (trace_replaying) {
+    /* This transition will be (or was) reported when exploration reaches it.
+     * For the purposes of replay, just treat it as disabled.
+     */
+    siglongjmp(checkpoint, 1);
+  }
+#endif
+
   unsigned long prior_errors = __atomic_fetch_add(&error_count, 1,
     __ATOMIC_SEQ_CST);
 
+  /* If a guard failed, we were passed the state whose rule it guards. Extend
+   * the trace by the step that rule would have taken so it matches an error
+   * from within the rule's body.
+   */
+  struct state *guarded = NULL;
+#if COUNTEREXAMPLE_TRACE != CEX_OFF
+  if (guard_rule_taken != 0) {
+    if (s != NULL && prior_errors < MAX_ERRORS) {
+      guarded = state_dup(s);
+      state_rule_taken_set(guarded, guard_rule_taken);
+      s = guarded;
+    }
+    /* we will not return to the guard's caller to clear this */
+    guard_leave();
+  }
+#endif
+
   if (__builtin_expect(prior_errors < MAX_ERRORS, 1)) {
 
     flockfile(stdout);
@@ -1440,6 +2183,10 @@ static __attribute__((format(printf, 2, 3))) _Noreturn void error(
     funlockfile(stdout);;
   }
 
+  if (guarded != NULL) {
+    state_free(guarded);
+  }
+
 #ifdef __clang__
   #pragma clang diagnostic push
   #pragma clang diagnostic ignored "-Wtautological-compare"
@@ -1481,14 +2228,29 @@ static bool state_eq(const struct state *NONNULL a,
   return state_cmp(a, b) == 0;
 }
 
-static void handle_copy(struct handle a, struct handle b);
+static void handle_copy(const struct state *NONNULL s, struct handle a,
+    struct handle b);
 
-static struct state *state_dup(const struct state *NONNULL s) {
-  struct state *n = state_new();
+static size_t state_hash(const struct state *NONNULL s);
+
+/* Set up 'n' as a successor of 's', ready for a rule to be applied to it. 'n'
+ * need not have come from state_new().
+ */
+static void state_dup_into(struct state *NONNULL n,
+    const struct state *NONNULL s) {
+#if CACHE_HASH
+  n->hash = 0;
+#endif
   memcpy(n->data, s->data, sizeof(n->data));
-#if COUNTEREXAMPLE_TRACE != CEX_OFF || LIVENESS_COUNT > 0
+#if INCREMENTAL_HASH
+  n->zobrist = s->zobrist;
+#endif
+#if STATE_PREVIOUS
   state_previous_set(n, s);
 #endif
+#if COUNTEREXAMPLE_REPLAY
+  state_parent_hash_set(n, state_hash(s));
+#endif
 #if BOUND > 0
   assert(state_bound_get(s) < BOUND && "exceeding bounded exploration depth");
   state_bound_set(n, state_bound_get(s) + 1);
@@ -1501,17 +2263,116 @@ static struct state *state_dup(const struct state *NONNULL s) {
     /* copy schedule data related to past scalarset permutations */
     struct handle sch_src = state_schedule_handle(s, 0, SCHEDULE_BITS);
     struct handle sch_dst = state_schedule_handle(n, 0, SCHEDULE_BITS);
-    handle_copy(sch_dst, sch_src);
+    handle_copy(n, sch_dst, sch_src);
   }
+}
 
+static __attribute__((unused)) struct state *state_dup(
+    const struct state *NONNULL s) {
+  struct state *n = state_new();
+  state_dup_into(n, s);
   return n;
 }
 
-static size_t state_hash(const struct state *NONNULL s) {
+/*******************************************************************************
+ * Incremental state hashing                                                   *
+ *                                                                             *
+ * With `--incremental-hash`, a state's hash is the XOR of a pseudo-random key *
+ * for each set bit of its data. Every write through a handle into the state   *
+ * adjusts the hash by the keys of the bits it flips, so hashing a successor   *
+ * costs in proportion to what its rule changed rather than to the size of the *
+ * state.                                                                      *
+ ******************************************************************************/
+
+#if INCREMENTAL_HASH
+/* The key of a given bit of state data. This is the SplitMix64 finaliser,
+ * computed on demand rather than stored in a table.
+ */
+static uint64_t zobrist_key(size_t bit) {
+  uint64_t z = ((uint64_t)bit + 1) * UINT64_C(0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+  z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+  return z ^ (z >> 31);
+}
+
+/* Offset in bits of a handle within a state's data, or SIZE_MAX if the handle
+ * refers to something else, like a local variable.
+ */
+static size_t zobrist_offset(const struct state *NONNULL s, struct handle h) {
+  uintptr_t base = (uintptr_t)h.base;
+  uintptr_t data = (uintptr_t)s->data;
+  if (base < data || base >= data + sizeof(s->data)) {
+    return SIZE_MAX;
+  }
+  return (size_t)(base - data) * CHAR_BIT + h.offset;
+}
+
+/* Account for flipping the given bits of a simple value in a state. */
+static void zobrist_update(const struct state *NONNULL s, struct handle h,
+    uint64_t flipped) {
+  size_t offset = zobrist_offset(s, h);
+  if (offset == SIZE_MAX) {
+    return;
+  }
+  uint64_t z = 0;
+  while (flipped != 0) {
+    z ^= zobrist_key(offset + (size_t)__builtin_ctzll(flipped));
+    flipped &= flipped - 1;
+  }
+  ((struct state*)s)->zobrist ^= z;
+}
+
+/* The contribution of the bits under a handle of any width to a state's hash. */
+static uint64_t zobrist_range(const struct state *NONNULL s, struct handle h) {
+  size_t offset = zobrist_offset(s, h);
+  if (offset == SIZE_MAX) {
+    return 0;
+  }
+  uint64_t z = 0;
+  for (size_t i = offset; i < offset + h.width; i++) {
+    if ((s->data[i / CHAR_BIT] >> (i % CHAR_BIT)) & 1) {
+      z ^= zobrist_key(i);
+    }
+  }
+  return z;
+}
+#endif
+
+static __attribute__((unused)) size_t state_hash(
+    const struct state *NONNULL s) {
+#if INCREMENTAL_HASH
+#ifndef NDEBUG
+  {
+    struct handle all = { .base = (uint8_t*)s->data, .offset = 0,
+      .width = sizeof(s->data) * CHAR_BIT };
+    assert(s->zobrist == zobrist_range(s, all)
+      && "incremental hash of a state is out of date");
+  }
+#endif
+  return (size_t)s->zobrist;
+#endif
+#if CACHE_HASH
+  if (s->hash != 0) {
+    return s->hash;
+  }
+#endif
   return (size_t)MurmurHash64A(s->data, sizeof(s->data));
 }
 
-#if COUNTEREXAMPLE_TRACE != CEX_OFF
+/* Hash a state and remember the result in it, if we are caching hashes. This
+ * must only be called on a state that is not yet visible to other threads and
+ * whose data will not change again.
+ */
+static __attribute__((unused)) size_t state_hash_cache(
+    struct state *NONNULL s) {
+  size_t hash = state_hash(s);
+#if CACHE_HASH
+  s->hash = hash;
+#endif
+  return hash;
+}
+
+#if COUNTEREXAMPLE_TRACE != CEX_OFF && !COUNTEREXAMPLE_REPLAY
 static __attribute__((unused)) size_t state_depth(
     const struct state *NONNULL s) {
 #if BOUND > 0
@@ -1537,6 +2398,7 @@ static __attribute__((unused)) struct state *state_drop_const(const struct state
 /* These functions are generated. */
 static void state_canonicalise_heuristic(struct state *NONNULL s);
 static void state_canonicalise_exhaustive(struct state *NONNULL s);
+static void state_canonicalise_signature(struct state *NONNULL s);
 
 static void state_canonicalise(struct state *NONNULL s) {
 
@@ -1555,7 +2417,97 @@ static void state_canonicalise(struct state *NONNULL s) {
       state_canonicalise_exhaustive(s);
       break;
 
+    case SYMMETRY_REDUCTION_SIGNATURE:
+      state_canonicalise_signature(s);
+      break;
+
+  }
+}
+
+#if CANONICAL_CACHE
+/* These functions are generated. */
+static void state_schedule_reset(struct state *NONNULL s);
+static void state_schedule_compose(struct state *NONNULL s,
+  const struct state *NONNULL relative);
+
+/* A recently canonicalised state. The schedule of `canonical` records the
+ * permutation that was applied to `key` to reach it, rather than one relative
+ * to the start state, so the entry can be reused by states reached through
+ * different permutations.
+ */
+struct canonical_entry {
+  bool valid;
+  uint8_t key[STATE_SIZE_BYTES];
+  struct state canonical;
+};
+
+/* Each thread has a direct-mapped cache of about 256KB. */
+enum {
+  CANONICAL_CACHE_ENTRIES = 262144 / sizeof(struct canonical_entry) < 16 ? 16
+    : 262144 / sizeof(struct canonical_entry)
+};
+static _Thread_local struct canonical_entry
+  canonical_cache[CANONICAL_CACHE_ENTRIES];
+
+/* Canonicalisation statistics. As for rules_fired, there are thread-local
+ * counts and global per-thread ones for the summary.
+ */
+struct canonical_stats {
+  uintmax_t lookups; /* states looked up in the canonical form cache */
+  uintmax_t hits;    /* lookups that found a cached canonical form */
+  uintmax_t skipped; /* states that were known to be canonical already */
+};
+static _Thread_local struct canonical_stats canonical_stats_local;
+static struct canonical_stats canonical_stats[THREADS];
+#endif
+
+/* Canonicalise a successor of a canonical state. `symmetric` indicates whether
+ * the rule that produced it may have written data affected by permuting a
+ * scalarset. If not, the successor is already canonical.
+ */
+static void state_canonicalise_successor(struct state *NONNULL s,
+    bool symmetric) {
+
+  assert(s != NULL && "attempt to canonicalise NULL state");
+
+#if CANONICAL_CACHE
+  if (!symmetric) {
+    canonical_stats_local.skipped++;
+    return;
+  }
+
+  canonical_stats_local.lookups++;
+
+  size_t index = (size_t)(MurmurHash64A(s->data, sizeof(s->data))
+    % CANONICAL_CACHE_ENTRIES);
+  struct canonical_entry *e = &canonical_cache[index];
+
+  if (e->valid && memcmp(e->key, s->data, sizeof(s->data)) == 0) {
+    canonical_stats_local.hits++;
+  } else {
+    /* canonicalise a copy from the identity permutation, so we learn the
+     * permutation the canonical form is reached by
+     */
+    memcpy(e->key, s->data, sizeof(e->key));
+    memcpy(&e->canonical, s, sizeof(e->canonical));
+    if (USE_SCALARSET_SCHEDULES) {
+      state_schedule_reset(&e->canonical);
+    }
+    state_canonicalise(&e->canonical);
+    e->valid = true;
+  }
+
+  memcpy(s->data, e->canonical.data, sizeof(s->data));
+#if INCREMENTAL_HASH
+  s->zobrist = e->canonical.zobrist;
+#endif
+  if (USE_SCALARSET_SCHEDULES) {
+    state_schedule_compose(s, &e->canonical);
   }
+#else
+  (void)symmetric;
+  state_canonicalise(s);
+#endif
 }
 
 /* This function is generated. */
@@ -1571,7 +2523,13 @@ static __attribute__((unused)) void state_print(const struct state *previous,
  * function assumes that the caller holds a lock on stdout.
  */
 static __attribute__((unused)) void print_transition(
-    const struct state *NONNULL s);
+    const struct state *previous, const struct state *NONNULL s,
+    uint64_t rule_taken);
+
+#if COUNTEREXAMPLE_REPLAY
+static size_t trace_replay(const struct state *NONNULL s,
+  const struct state ***NONNULL states, uint64_t **NONNULL rules);
+#endif
 
 static void print_counterexample(
     const struct state *NONNULL s __attribute__((unused))) {
@@ -1579,12 +2537,20 @@ static void print_counterexample(
   assert(s != NULL && "missing state in request for counterexample trace");
 
 #if COUNTEREXAMPLE_TRACE != CEX_OFF
-  /* Construct an array of the states we need to print by walking backwards to
-   * the initial starting state.
+  /* Construct an array of the states we need to print and the rules that
+   * reached each of them.
    */
+  const struct state **cex;
+  uint64_t *rules;
+
+#if COUNTEREXAMPLE_REPLAY
+  size_t trace_length = trace_replay(s, &cex, &rules);
+#else
+  /* Walk backwards to the initial starting state. */
   size_t trace_length = state_depth(s);
 
-  const struct state **cex = xcalloc(trace_length, sizeof(cex[0]));
+  cex = xcalloc(trace_length, sizeof(cex[0]));
+  rules = xcalloc(trace_length, sizeof(rules[0]));
 
   {
     size_t i = trace_length - 1;
@@ -1592,16 +2558,20 @@ static void print_counterexample(
       assert(i < trace_length && "error in counterexample trace traversal "
         "logic");
       cex[i] = p;
+      rules[i] = state_rule_taken_get(p);
       i--;
     }
   }
+#endif
 
   for (size_t i = 0; i < trace_length; i++) {
 
     const struct state *current = cex[i];
     const struct state *previous = i == 0 ? NULL : cex[i - 1];
 
-    print_transition(current);
+    if (rules[i] != 0) {
+      print_transition(previous, current, rules[i]);
+    }
 
     if (MACHINE_READABLE_OUTPUT) {
       put("<state>\n");
@@ -1614,6 +2584,7 @@ static void print_counterexample(
     }
   }
 
+  free(rules);
   free(cex);
 #endif
 }
@@ -1720,6 +2691,9 @@ static void handle_write_raw(const struct state *NONNULL s, struct handle h,
   #pragma GCC diagnostic pop
 #endif
 
+#if INCREMENTAL_HASH
+  zobrist_update(s, h, read_raw(h) ^ (uint64_t)value);
+#endif
   write_raw(h, (uint64_t)value);
 }
 
@@ -1748,7 +2722,13 @@ static __attribute__((unused)) void handle_write(const char *NONNULL context,
   handle_write_raw(s, h, r);
 }
 
-static __attribute__((unused)) void handle_zero(struct handle h) {
+static __attribute__((unused)) void handle_zero(
+    const struct state *NONNULL s __attribute__((unused)), struct handle h) {
+
+#if INCREMENTAL_HASH
+  /* Every set bit under the handle is about to be cleared. */
+  ((struct state*)s)->zobrist ^= zobrist_range(s, h);
+#endif
 
   uint8_t *p = h.base + h.offset / 8;
 
@@ -1778,10 +2758,15 @@ static __attribute__((unused)) void handle_zero(struct handle h) {
   }
 }
 
-static void handle_copy(struct handle a, struct handle b) {
+static void handle_copy(const struct state *NONNULL s __attribute__((unused)),
+    struct handle a, struct handle b) {
 
   ASSERT(a.width == b.width && "copying between handles of different sizes");
 
+#if INCREMENTAL_HASH
+  uint64_t before = zobrist_range(s, a);
+#endif
+
   /* FIXME: This does a bit-by-bit copy which almost certainly could be
    * accelerated by detecting byte-boundaries and complementary alignment and
    * then calling memcpy when possible.
@@ -1800,6 +2785,9 @@ static void handle_copy(struct handle a, struct handle b) {
 
     *dst = (*dst & and_mask) | or_mask;
   }
+#if INCREMENTAL_HASH
+  ((struct state*)s)->zobrist ^= before ^ zobrist_range(s, a);
+#endif
 }
 
 static __attribute__((unused)) bool handle_eq(struct handle a,
@@ -1876,6 +2864,140 @@ static __attribute__((unused)) struct handle handle_index(
   };
 }
 
+/*******************************************************************************
+ * Accessors for values at fixed positions.                                    *
+ *                                                                             *
+ * When the generator can determine a value's offset and width within its root *
+ * variable, it calls these instead of handle_read() and handle_write(). They  *
+ * are forced inline, so that with the root's handle and the constant offset   *
+ * and width visible the compiler can reduce each access to a single load or   *
+ * store of the bytes covering the value, with a shift and a mask.             *
+ ******************************************************************************/
+
+static inline __attribute__((always_inline, pure)) uint64_t read_fixed(
+    struct handle h) {
+
+  if (h.offset + h.width <= 64) {
+
+    if (h.width == 0) {
+      return 0;
+    }
+
+    uint64_t v = copy_out64(h.base, BITS_TO_BYTES(h.offset + h.width));
+    v >>= h.offset;
+    if (h.width < 64) {
+      v &= (UINT64_C(1) << h.width) - 1;
+    }
+    return v;
+  }
+
+  return read_raw(h);
+}
+
+static inline __attribute__((always_inline)) void write_fixed(struct handle h,
+    uint64_t v) {
+
+  if (h.offset + h.width <= 64) {
+
+    if (h.width == 0) {
+      return;
+    }
+
+    size_t extent = BITS_TO_BYTES(h.offset + h.width);
+    uint64_t mask = h.width < 64 ? (UINT64_C(1) << h.width) - 1 : UINT64_MAX;
+    uint64_t x = copy_out64(h.base, extent);
+    x = (x & ~(mask << h.offset)) | ((v & mask) << h.offset);
+    copy_in64(h.base, x, extent);
+    return;
+  }
+
+  write_raw(h, v);
+}
+
+/* The equivalent of handle_narrow() for the fixed accessors. This must be
+ * forced inline like its callers. A guard or rule that calls sigsetjmp() has an
+ * abnormal edge from every call site it contains. If a call to handle_narrow()
+ * is only inlined late, its edge is left behind on an empty block, and GCC 12's
+ * control dependent dead code elimination at -O2 then deletes branches ahead of
+ * it, including the comparison against the value subsequently read.
+ */
+static inline __attribute__((always_inline)) struct handle narrow_fixed(
+    struct handle root, size_t offset, size_t width) {
+
+  ASSERT(offset + width <= root.width && "narrowing a handle with values that "
+    "actually expand it");
+
+  return (struct handle){
+    .base = root.base + (root.offset + offset) / CHAR_BIT,
+    .offset = (root.offset + offset) % CHAR_BIT,
+    .width = width,
+  };
+}
+
+static inline __attribute__((always_inline, unused)) value_t handle_read_fixed(
+    const char *NONNULL context, const char *rule_name,
+    const char *NONNULL name, const struct state *NONNULL s, value_t lb,
+    value_t ub, struct handle root, size_t offset, size_t width) {
+
+  assert(context != NULL);
+  assert(name != NULL);
+
+  struct handle h = narrow_fixed(root, offset, width);
+
+  if (__builtin_expect(h.width > sizeof(raw_value_t) * 8, 0)) {
+    error(s, "read of a handle that is wider than the value type");
+  }
+
+  ASSERT(h.width <= MAX_SIMPLE_WIDTH && "read of a handle that is larger than "
+    "the maximum width of a simple type in this model");
+
+  raw_value_t raw = (raw_value_t)read_fixed(h);
+
+  TRACE(TC_HANDLE_READS, "read value %" PRIRAWVAL " from handle { %p, %zu, %zu }",
+    raw_value_to_string(raw), h.base, h.offset, h.width);
+
+  if (__builtin_expect(raw == 0, 0)) {
+    error(s, "%sread of undefined value in %s%s%s", context, name,
+      rule_name == NULL ? "" : " within ", rule_name == NULL ? "" : rule_name);
+  }
+
+  return decode_value(lb, ub, raw);
+}
+
+static inline __attribute__((always_inline, unused)) void handle_write_fixed(
+    const char *NONNULL context, const char *rule_name,
+    const char *NONNULL name, const struct state *NONNULL s, value_t lb,
+    value_t ub, struct handle root, size_t offset, size_t width,
+    value_t value) {
+
+  assert(context != NULL);
+  assert(name != NULL);
+
+  struct handle h = narrow_fixed(root, offset, width);
+
+  raw_value_t r;
+  if (__builtin_expect(value < lb || value > ub || SUB(value, lb, &r)
+      || ADD(r, 1, &r), 0)) {
+    error(s, "%swrite of out-of-range value into %s%s%s", context, name,
+      rule_name == NULL ? "" : " within ", rule_name == NULL ? "" : rule_name);
+  }
+
+  if (__builtin_expect(h.width > sizeof(raw_value_t) * 8, 0)) {
+    error(s, "write of a handle that is wider than the value type");
+  }
+
+  ASSERT(h.width <= MAX_SIMPLE_WIDTH && "write to a handle that is larger than "
+    "the maximum width of a simple type in this model");
+
+  TRACE(TC_HANDLE_WRITES, "writing value %" PRIRAWVAL " to handle { %p, %zu, %zu }",
+    raw_value_to_string(r), h.base, h.offset, h.width);
+
+#if INCREMENTAL_HASH
+  zobrist_update(s, h, read_fixed(h) ^ (uint64_t)r);
+#endif
+  write_fixed(h, (uint64_t)r);
+}
+
 static __attribute__((unused)) value_t handle_isundefined(
     const struct state *NONNULL s, struct handle h) {
   raw_value_t v = handle_read_raw(s, h);
@@ -2063,6 +3185,16 @@ static __attribute__((unused)) value_t bnot(value_t v) {
   return (value_t)~(raw_value_t)v;
 }
 
+/* combine a component into the signature of a scalarset element, for
+ * signature-based symmetry reduction
+ */
+static __attribute__((unused)) uint64_t signature_mix(uint64_t a, uint64_t b) {
+  uint64_t x = a * UINT64_C(0x9e3779b97f4a7c15) + b;
+  x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+  x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+  return x ^ (x >> 31);
+}
+
 /* use Heap's algorithm for generating permutations to implement a
  * permutation-to-number mapping
  */
@@ -2168,1463 +3300,3796 @@ static __attribute__((unused)) void index_to_permutation(size_t index,
 }
 
 /*******************************************************************************
- * State queue node                                                            *
+ * State queue                                                                 *
  *                                                                             *
- * Queue nodes are 4K-sized, 4K-aligned linked-list nodes. They contain        *
- * pending states and then a pointer to the next node in the queue.            *
+ * The following implements a per-thread queue for pending states. Each queue  *
+ * is a variant of the work-stealing deque of Chase and Lev, "Dynamic Circular *
+ * Work-Stealing Deque" in SPAA 2005, a growable circular array of states that *
+ * only its owning thread enqueues into. Unlike Chase-Lev, the owner also      *
+ * dequeues from the top, so states are expanded in roughly breadth-first      *
+ * order. Any thread may take from the top by advancing it with a single-word  *
+ * compare-and-swap. A thread whose queue is empty steals a batch of states    *
+ * from the top of a randomly chosen victim's queue. A property we maintain is *
+ * that all states within all queues pass the current model's invariants.      *
  ******************************************************************************/
 
-struct queue_node {
-  struct state *s[(4096 - sizeof(struct queue_node*)) / sizeof(struct state*)];
-  struct queue_node *next;
+struct queue_array {
+  size_t capacity; /* always a power of 2 */
+
+  /* The array this replaced when it grew. Another thread may still be reading
+   * from it, so it is kept until exit.
+   */
+  struct queue_array *retired;
+
+  struct state *s[];
 };
 
-_Static_assert(sizeof(struct queue_node) == 4096,
-  "incorrect queue_node size calculation");
+static struct {
+  size_t top;    /* index of the oldest state */
+  size_t bottom; /* index one past the newest state */
+  struct queue_array *array;
 
-static struct queue_node *queue_node_new(void) {
-  struct queue_node *p = NULL;
+  /* pad to a cache line to avoid false sharing between queues */
+  char padding[64 - 2 * sizeof(size_t) - sizeof(struct queue_array*)];
+} q[THREADS];
 
-  int r = posix_memalign((void**)&p, sizeof(*p), sizeof(*p));
+/* Maximum number of states to steal at once. This is half of a 4K page of
+ * state pointers, to bound the time a victim's states are in transit.
+ */
+enum { QUEUE_STEAL_MAX = 4096 / sizeof(struct state*) / 2 };
 
-  assert((r == 0 || r == ENOMEM) && "invalid alignment to posix_memalign");
+/* Work-stealing statistics, each written only by the corresponding thread. */
+static struct {
+  uintmax_t steals;        /* successful steals */
+  uintmax_t states_stolen; /* states taken in those steals */
+  uintmax_t failed_steals; /* attempts that found nothing or lost a race */
+  size_t peak;             /* most states the queue has held */
+} queue_stats[THREADS];
+
+#if EXTERNAL_MEMORY
+/* Queueing with external memory. These are defined below. */
+static size_t external_queue_size(void);
+static const struct state *external_dequeue(void);
+#endif
 
-  if (__builtin_expect(r != 0, 0)) {
-    oom();
-  }
+#if PROCESSES > 1
+/* Exchanging states with other processes. Defined below. */
+static bool dist_wait(void);
+#endif
 
-  memset(p, 0, sizeof(*p));
+#if LEVEL_SYNC
+/* Moving on to the next depth of a level-synchronous search. Defined below. */
+static bool level_advance(void);
+#endif
 
-  return p;
+static struct queue_array *queue_array_new(size_t capacity,
+    size_t queue_id) {
+  assert(capacity > 0 && (capacity & (capacity - 1)) == 0 &&
+    "queue capacity is not a power of 2");
+  struct queue_array *a = xmalloc(sizeof(*a) + capacity * sizeof(a->s[0]));
+  numa_local(a->s, capacity * sizeof(a->s[0]), queue_id);
+  a->capacity = capacity;
+  a->retired = NULL;
+  return a;
 }
 
-static void queue_node_free(struct queue_node *p) {
-  free(p);
+/* Number of states currently in the given queue. */
+static size_t queue_size(size_t queue_id) {
+  size_t bottom = __atomic_load_n(&q[queue_id].bottom, __ATOMIC_SEQ_CST);
+  size_t top = __atomic_load_n(&q[queue_id].top, __ATOMIC_SEQ_CST);
+  return bottom > top ? bottom - top : 0;
 }
 
-/******************************************************************************/
+/* Add a state to the bottom of a queue. Only the thread owning the queue may
+ * call this, or any thread while no secondary threads are running.
+ */
+static size_t queue_enqueue(struct state *NONNULL s, size_t queue_id) {
+  assert(queue_id < sizeof(q) / sizeof(q[0]) && "out of bounds queue access");
 
-/*******************************************************************************
- * Queue node handles                                                          *
- *                                                                             *
- * These are pointers to a member-aligned address within a queue_node. The     *
- * idea is that you can have a queue_handle_t pointing at either one of the    *
- * elements of the `s` member or at the chained `next` pointer. Since          *
- * queue_node pointers are always 4K-aligned, you can examine the low 12 bits  *
- * of the queue node handle to determine which member you are pointing at.     *
- ******************************************************************************/
+#if EXTERNAL_MEMORY
+  /* The state was already recorded by set_insert() and will be written to the
+   * on-disk queue once it is known to be new.
+   */
+  (void)s;
+  return external_queue_size();
+#endif
 
-typedef uintptr_t queue_handle_t;
+  size_t bottom = __atomic_load_n(&q[queue_id].bottom, __ATOMIC_SEQ_CST);
+  size_t top = __atomic_load_n(&q[queue_id].top, __ATOMIC_SEQ_CST);
+  struct queue_array *a = __atomic_load_n(&q[queue_id].array,
+    __ATOMIC_SEQ_CST);
 
-static queue_handle_t queue_handle_from_node_ptr(const struct queue_node *n) {
-  return (queue_handle_t)n;
-}
+  if (a == NULL || bottom - top >= a->capacity) {
+    /* The queue is full. Move its contents into a larger array. Thieves that
+     * loaded the old array can continue reading from it, as the states they
+     * are after are not moved within it.
+     */
+    struct queue_array *b = queue_array_new(a == NULL ? 4096 / sizeof(s)
+      : a->capacity * 2, queue_id);
+    for (size_t i = top; i != bottom; i++) {
+      b->s[i & (b->capacity - 1)] = __atomic_load_n(&a->s[i & (a->capacity - 1)],
+        __ATOMIC_SEQ_CST);
+    }
+    b->retired = a;
+    __atomic_store_n(&q[queue_id].array, b, __ATOMIC_SEQ_CST);
+    a = b;
+    TRACE(TC_QUEUE, "expanded queue %zu to %zu states", queue_id, a->capacity);
+  }
 
-static struct queue_node *queue_handle_base(queue_handle_t h) {
-  return (struct queue_node*)(h - h % sizeof(struct queue_node));
-}
+  __atomic_store_n(&a->s[bottom & (a->capacity - 1)], s, __ATOMIC_SEQ_CST);
 
-static bool queue_handle_is_state_pptr(queue_handle_t h) {
-  return h % sizeof(struct queue_node)
-    < __builtin_offsetof(struct queue_node, next);
-}
+  /* Publish the state. Having written the array first, any thread that sees
+   * the new bottom also sees the state.
+   */
+  __atomic_store_n(&q[queue_id].bottom, bottom + 1, __ATOMIC_SEQ_CST);
 
-static struct state **queue_handle_to_state_pptr(queue_handle_t h) {
-  assert(queue_handle_is_state_pptr(h) &&
-    "invalid use of queue_handle_to_state_pptr");
+  size_t count = bottom + 1 - top;
 
-  return (struct state**)h;
-}
+  if (SIZE_HINT && count > queue_stats[queue_id].peak) {
+    queue_stats[queue_id].peak = count;
+  }
 
-static struct queue_node **queue_handle_to_node_pptr(queue_handle_t h) {
-  assert(!queue_handle_is_state_pptr(h) &&
-    "invalid use of queue_handle_to_node_pptr");
-
-  return (struct queue_node**)h;
-}
+  TRACE(TC_QUEUE, "enqueued state %p into queue %zu, queue length is now %zu",
+    s, queue_id, count);
 
-static queue_handle_t queue_handle_next(queue_handle_t h) {
-  return h + sizeof(struct state*);
+  return count;
 }
 
-/******************************************************************************/
-
-/*******************************************************************************
- * Hazard pointers                                                             *
- *                                                                             *
- * The idea of "hazard pointers" comes from Maged Michael, "Hazard Pointers:   *
- * Safe Memory Reclamation for Lock-Free Objects" in TPDS 15(8) 2004. The      *
- * basic concept is to maintain a collection of safe-to-dereference pointers.  *
- * Before freeing a pointer, you look in this collection to see if it is in    *
- * use and you must always add a pointer to this collection before             *
- * dereferencing it. The finer details of how we keep this consistent and why  *
- * the size of this collection can be statically known ahead of time are a     *
- * little complicated, but the paper explains this in further detail.          *
- ******************************************************************************/
+/* Take up to 'limit' of the oldest states from a queue, writing them to
+ * 'taken'. Returns the number of states taken, or 0 if the queue was empty or
+ * we lost a race with another thread.
+ */
+static size_t queue_take(size_t queue_id, struct state **NONNULL taken,
+    size_t limit) {
 
-/* Queue node pointers currently safe to dereference. */
-static const struct queue_node *hazarded[THREADS];
+  size_t top = __atomic_load_n(&q[queue_id].top, __ATOMIC_SEQ_CST);
+  size_t bottom = __atomic_load_n(&q[queue_id].bottom, __ATOMIC_SEQ_CST);
+  if (bottom <= top) {
+    return 0;
+  }
 
-/* Protect a pointer that we wish to dereference. */
-static void hazard(queue_handle_t h) {
+  /* Load the array after bottom, to see one at least as new as the states up
+   * to it.
+   */
+  const struct queue_array *a = __atomic_load_n(&q[queue_id].array,
+    __ATOMIC_SEQ_CST);
 
-  /* Find the queue node this handle lies within. */
-  const struct queue_node *p = queue_handle_base(h);
+  size_t count = bottom - top;
+  if (count > limit) {
+    count = limit;
+  }
 
-  /* You can't protect the null pointer because it is invalid to dereference it.
+  /* If the owner has since wrapped around and overwritten any of these, top
+   * will have moved and we will fail below.
    */
-  assert(p != NULL && "attempt to hazard an invalid pointer");
+  for (size_t i = 0; i < count; i++) {
+    taken[i] = __atomic_load_n(&a->s[(top + i) & (a->capacity - 1)],
+      __ATOMIC_SEQ_CST);
+  }
 
-  /* Each thread is only allowed a single hazarded pointer at a time. */
-  assert(__atomic_load_n(&hazarded[thread_id], __ATOMIC_SEQ_CST) == NULL
-    && "hazarding multiple pointers at once");
+  if (!__atomic_compare_exchange_n(&q[queue_id].top, &top, top + count, false,
+      __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+    return 0;
+  }
 
-  __atomic_store_n(&hazarded[thread_id], p, __ATOMIC_SEQ_CST);
+  return count;
 }
 
-/* Drop protection on a pointer whose target we are done accessing. */
-static void unhazard(queue_handle_t h) {
-
-  /* Find the queue node this handle lies within. */
-  const struct queue_node *p __attribute__((unused)) = queue_handle_base(h);
-
-  assert(p != NULL && "attempt to unhazard an invalid pointer");
+/* A per-thread xorshift generator for choosing victims to steal from. */
+static size_t queue_random(void) {
+  static _Thread_local uint64_t x;
+  if (x == 0) {
+    x = (uint64_t)thread_id + 1;
+  }
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return (size_t)x;
+}
 
-  assert(__atomic_load_n(&hazarded[thread_id], __ATOMIC_SEQ_CST) != NULL
-    && "unhazarding a pointer when none are hazarded");
+static const struct state *queue_dequeue(size_t *NONNULL queue_id) {
+  assert(queue_id != NULL && *queue_id < sizeof(q) / sizeof(q[0]) &&
+    "out of bounds queue access");
 
-  assert(__atomic_load_n(&hazarded[thread_id], __ATOMIC_SEQ_CST) == p
-    && "unhazarding a pointer that differs from the one hazarded");
+#if PROCESSES > 1
+  if (!dist_wait()) {
+    return NULL;
+  }
+#endif
 
-  __atomic_store_n(&hazarded[thread_id], NULL, __ATOMIC_SEQ_CST);
-}
+#if EXTERNAL_MEMORY
+  return external_dequeue();
+#endif
 
-/* Free a pointer or, if not possible, defer this to later. */
-static void reclaim(queue_handle_t h) {
+  struct state *s;
 
-  /* Find the queue node this handle lies within. */
-  struct queue_node *p = queue_handle_base(h);
+#if LEVEL_SYNC
+retry:;
+#endif
 
-  assert(p != NULL && "reclaiming a null pointer");
+  /* First try our own queue. We only compete here with thieves, so retry until
+   * it is empty.
+   */
+  while (queue_size(*queue_id) > 0) {
+    if (queue_take(*queue_id, &s, 1) == 1) {
+      TRACE(TC_QUEUE, "dequeued state %p from queue %zu, queue length is now "
+        "%zu", s, *queue_id, queue_size(*queue_id));
+      return s;
+    }
+  }
 
-  /* The reclaimer is not allowed to be freeing something while also holding a
-   * hazarded pointer.
+  /* Our queue is empty. Try to steal half of another's, visiting each other
+   * queue once in an order starting from a random victim. Queues of threads on
+   * our own NUMA node are visited first, as their states are cheaper for us to
+   * access.
    */
-  assert(__atomic_load_n(&hazarded[thread_id], __ATOMIC_SEQ_CST) == NULL
-    && "reclaiming a pointer while holding a hazarded pointer");
+  size_t start = queue_random();
+  for (size_t pass = 0; pass < 2; pass++) {
+    for (size_t i = 0; i < THREADS; i++) {
+      size_t victim = (start + i) % THREADS;
+      if (victim == *queue_id) {
+        continue;
+      }
+      if (numa_is_local(victim) != (pass == 0)) {
+        continue;
+      }
 
-  /* Pointers that we failed to free initially because they were in use
-   * (hazarded) at the time they were passed to reclaim().
-   *
-   * Why are we sure we will only ever have a maximum of `THREADS - 1` pointers
-   * outstanding? Anything passed to reclaim() is expected to be
-   * now-unreachable, so the only outstanding references to such are threads
-   * racing with us. Because each thread can only have one hazarded pointer at a
-   * time, the maximum number of in use pointers right now is `THREADS - 1`
-   * (because the current thread does not have one).
-   *
-   * There is an edge case where another thread (1) held a hazarded pointer we
-   * previously tried to reclaim and thus ended up on our deferred list, then
-   * (2) in-between that time and now dropped this reference and acquired a
-   * hazarded pointer to `p`. This still will not exceed our count of
-   * `THREADS - 1` as the order in which we scan the deferred list and then add
-   * `p` to it below ensures that we will discover the originally hazarded
-   * pointer (now no longer conflicted) and clear its slot, leaving this
-   * available for `p`.
-   */
-  static _Thread_local struct queue_node *deferred[THREADS - 1];
-  static const size_t DEFERRED_SIZE = sizeof(deferred) / sizeof(deferred[0]);
-
-  /* First try to free any previously deferred pointers. */
-  for (size_t i = 0; i < DEFERRED_SIZE; i++) {
-    if (deferred[i] != NULL) {
-      bool conflict = false;
-      for (size_t j = 0; j < sizeof(hazarded) / sizeof(hazarded[0]); j++) {
-        if (j == thread_id) {
-          /* No need to check for conflicts with ourself. */
-          assert(__atomic_load_n(&hazarded[j], __ATOMIC_SEQ_CST) == NULL);
-          continue;
-        }
-        if (deferred[i] == __atomic_load_n(&hazarded[j], __ATOMIC_SEQ_CST)) {
-          /* This pointer is in use by thread j. */
-          conflict = true;
-          break;
-        }
+      struct state *stolen[QUEUE_STEAL_MAX];
+      size_t limit = (queue_size(victim) + 1) / 2;
+      if (limit > QUEUE_STEAL_MAX) {
+        limit = QUEUE_STEAL_MAX;
       }
-      if (!conflict) {
-        queue_node_free(deferred[i]);
-        deferred[i] = NULL;
+      size_t count = limit == 0 ? 0 : queue_take(victim, stolen, limit);
+      if (count == 0) {
+        queue_stats[thread_id].failed_steals++;
+        continue;
       }
-    }
-  }
 
-  /* Now deal with the pointer we were passed. The most likely case is that no
-   * one else is using this pointer, so try this first.
-   */
-  bool conflict = false;
-  for (size_t i = 0; i < sizeof(hazarded) / sizeof(hazarded[i]); i++) {
-    if (i == thread_id) {
-      /* No need to check for conflicts with ourself. */
-      assert(__atomic_load_n(&hazarded[i], __ATOMIC_SEQ_CST) == NULL);
-      continue;
-    }
-    if (p == __atomic_load_n(&hazarded[i], __ATOMIC_SEQ_CST)) {
-      /* Bad luck :( */
-      conflict = true;
-      break;
-    }
-  }
+      queue_stats[thread_id].steals++;
+      queue_stats[thread_id].states_stolen += count;
 
-  if (!conflict) {
-    /* We're done! */
-    queue_node_free(p);
-    return;
-  }
+      /* Keep the oldest and queue the rest for ourselves. */
+      for (size_t j = 1; j < count; j++) {
+        (void)queue_enqueue(stolen[j], *queue_id);
+      }
 
-  /* If we reached here, we need to defer this reclamation to later. */
-  for (size_t i = 0; i < DEFERRED_SIZE; i++) {
-    if (deferred[i] == NULL) {
-      deferred[i] = p;
-      return;
+      TRACE(TC_QUEUE, "stole %zu state(s) from queue %zu into queue %zu",
+        count, victim, *queue_id);
+
+      return stolen[0];
     }
   }
 
-  ASSERT(!"deferred more than `THREADS` reclamations");
+#if LEVEL_SYNC
+  /* There is nothing left at the current depth. Wait for the other threads to
+   * finish it too, and then start on the next.
+   */
+  if (level_advance()) {
+    goto retry;
+  }
+#endif
+
+  return NULL;
 }
 
 /******************************************************************************/
 
 /*******************************************************************************
- * Atomic operations on double word values                                     *
+ * Thread rendezvous support                                                   *
  ******************************************************************************/
 
-#if __SIZEOF_POINTER__ <= 4
-  typedef uint64_t dword_t;
-#elif __SIZEOF_POINTER__ <= 8
-  typedef unsigned __int128 dword_t;
-#else
-  #error "unexpected pointer size; what scalar type to use for dword_t?"
-#endif
-
-static dword_t atomic_read(dword_t *p) {
+static pthread_mutex_t rendezvous_lock; /* mutual exclusion mechanism for below. */
+static pthread_cond_t rendezvous_cond;  /* sleep mechanism for below. */
+static size_t running_count = 1;            /* how many threads are opted in to rendezvous? */
+static size_t rendezvous_pending = 1;   /* how many threads are opted in and not sleeping? */
+static size_t rendezvous_generation;    /* how many rendezvous have completed? */
 
-  if (THREADS == 1) {
-    return *p;
+static void rendezvous_init(void) {
+  int r = pthread_mutex_init(&rendezvous_lock, NULL);
+  if (__builtin_expect(r != 0, 0)) {
+    fprintf(stderr, "pthread_mutex_init failed: %s\n", strerror(r));
+    exit(EXIT_FAILURE);
   }
 
-#if defined(__x86_64__) || defined(__i386__)
-  /* x86-64: MOV is not guaranteed to be atomic on 128-bit naturally aligned
-   *   memory. The way to work around this is apparently the following
-   *   degenerate CMPXCHG16B.
-   * i386: __atomic_load_n emits code calling a libatomic function that takes a
-   *   lock, making this no longer lock free. Force a CMPXCHG8B by using the
-   *   __sync built-in instead.
-   */
-  return __sync_val_compare_and_swap(p, 0, 0);
-#endif
-
-  return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+  r = pthread_cond_init(&rendezvous_cond, NULL);
+  if (__builtin_expect(r != 0, 0)) {
+    fprintf(stderr, "pthread_cond_init failed: %s\n", strerror(r));
+    exit(EXIT_FAILURE);
+  }
 }
 
-static void atomic_write(dword_t *p, dword_t v) {
+/* Call this at the start of a rendezvous point.
+ *
+ * This is a low level function, not expected to be directly used outside of the
+ * context of the rendezvous implementation.
+ *
+ * @return True if the caller was the last to arrive and henceforth dubbed the
+ *   'leader'.
+ */
+static bool rendezvous_arrive(void) {
+  int r __attribute__((unused)) = pthread_mutex_lock(&rendezvous_lock);
+  assert(r == 0);
 
-  if (THREADS == 1) {
-    *p = v;
-    return;
-  }
+  /* Take a token from the rendezvous down-counter. */
+  assert(rendezvous_pending > 0);
+  rendezvous_pending--;
 
-#if defined(__x86_64__) || defined(__i386__)
-  /* As explained above, we need some extra gymnastics to avoid a call to
-   * libatomic on x86-64 and i386.
+  /* If we were the last to arrive then it was our arrival that dropped the
+   * counter to zero.
    */
-  dword_t expected;
-  dword_t old = 0;
-  do {
-    expected = old;
-    old = __sync_val_compare_and_swap(p, expected, v);
-  } while (expected != old);
-  return;
-#endif
-
-  __atomic_store_n(p, v, __ATOMIC_SEQ_CST);
+  return rendezvous_pending == 0;
 }
 
-static bool atomic_cas(dword_t *p, dword_t expected, dword_t new) {
+/* Call this at the end of a rendezvous point.
+ *
+ * This is a low level function, not expected to be directly used outside of the
+ * context of the rendezvous implementation.
+ *
+ * @param leader Whether the caller is the 'leader'. If you call this when you
+ *   are the 'leader' it will unblock all 'followers' at the rendezvous point.
+ * @param action Optional code for the leader to run.
+ */
+static void rendezvous_depart(bool leader, void (*action)(void)) {
+  int r __attribute((unused));
 
-  if (THREADS == 1) {
-    if (*p == expected) {
-      *p = new;
-      return true;
+  if (leader) {
+    if (action != NULL) {
+      action();
     }
-    return false;
+
+    /* Reset the counter for the next rendezvous. */
+    assert(rendezvous_pending == 0 && "a rendezvous point is being exited "
+      "while some participating threads have yet to arrive");
+    rendezvous_pending = running_count;
+    rendezvous_generation++;
+
+    /* Wake up the 'followers'. */
+    r = pthread_cond_broadcast(&rendezvous_cond);
+    assert(r == 0);
+
+  } else {
+
+    /* Wait on the 'leader' to wake us up, ignoring any spurious wake ups. */
+    size_t generation = rendezvous_generation;
+    do {
+      r = pthread_cond_wait(&rendezvous_cond, &rendezvous_lock);
+      assert(r == 0);
+    } while (generation == rendezvous_generation);
   }
 
-#if defined(__x86_64__) || defined(__i386__)
-  /* Make GCC >= 7.1 emit cmpxchg on x86-64 and i386. See
-   * https://gcc.gnu.org/bugzilla/show_bug.cgi?id=80878.
-   */
-  return __sync_bool_compare_and_swap(p, expected, new);
-#endif
+  r = pthread_mutex_unlock(&rendezvous_lock);
+  assert(r == 0);
+}
 
-  return __atomic_compare_exchange_n(p, &expected, new, false, __ATOMIC_SEQ_CST,
-    __ATOMIC_SEQ_CST);
+/* Exposed friendly function for performing a rendezvous. */
+static __attribute__((unused)) void rendezvous(void (*action)(void)) {
+  bool leader = rendezvous_arrive();
+  if (leader) {
+    TRACE(TC_SET, "arrived at rendezvous point as leader");
+  }
+  rendezvous_depart(leader, action);
 }
 
-static dword_t atomic_cas_val(dword_t *p, dword_t expected, dword_t new) {
+/* Remove the caller from the pool of threads who participate in this
+ * rendezvous.
+ */
+static void rendezvous_opt_out(void (*action)(void)) {
 
-  if (THREADS == 1) {
-    dword_t old = *p;
-    if (old == expected) {
-      *p = new;
-    }
-    return old;
-  }
+retry:;
 
-#if defined(__x86_64__) || defined(__i386__)
-  /* Make GCC >= 7.1 emit cmpxchg on x86-64 and i386. See
-   * https://gcc.gnu.org/bugzilla/show_bug.cgi?id=80878.
+  /* "Arrive" at the rendezvous to decrement the count of outstanding threads.
    */
-  return __sync_val_compare_and_swap(p, expected, new);
-#endif
+  bool leader = rendezvous_arrive();
+
+  if (leader && running_count > 1) {
+    /* We unfortunately opted out of this rendezvous while the remaining threads
+     * were arriving at one and we were the last to arrive. Let's pretend we are
+     * participating in the rendezvous and unblock them.
+     */
+    rendezvous_depart(true, action);
 
+    /* Re-attempt opting-out. */
+    goto retry;
+  }
 
-  (void)__atomic_compare_exchange_n(p, &expected, new, false, __ATOMIC_SEQ_CST,
-    __ATOMIC_SEQ_CST);
-  return expected;
-}
+  /* Remove ourselves from the known threads. */
+  assert(running_count > 0);
+  running_count--;
 
-/******************************************************************************/
+  int r __attribute__((unused)) = pthread_mutex_unlock(&rendezvous_lock);
+  assert(r == 0);
+}
 
+#if LEVEL_SYNC
 /*******************************************************************************
- * Double pointers                                                             *
+ * Level-synchronous exploration                                               *
  *                                                                             *
- * A scalar type that can store the value of two pointers.                     *
+ * With --minimal-traces, states are expanded strictly one depth at a time.    *
+ * New states found while expanding depth d are held in a per-thread buffer    *
+ * rather than queued. Only when all threads have run out of states at depth d *
+ * are these moved into the queues. The first time a state is inserted into    *
+ * the seen set is then always via a shortest path from a start state, so      *
+ * whichever thread wins the race to insert it, the previous pointer it is     *
+ * recorded with gives a minimal counterexample trace.                         *
  ******************************************************************************/
 
-#if __SIZEOF_POINTER__ <= 4
-  typedef uint64_t double_ptr_t;
-#elif __SIZEOF_POINTER__ <= 8
-  typedef unsigned __int128 double_ptr_t;
-#else
-  #error "unexpected pointer size; what scalar type to use for double_ptr_t?"
-#endif
+/* States at the next depth, each written only by the owning thread. */
+static struct {
+  struct state **s;
+  size_t count;
+  size_t capacity;
+} level_next[THREADS];
 
-static uintptr_t double_ptr_extract1(double_ptr_t p) {
+static size_t level;     /* depth currently being expanded */
+static bool level_done;  /* did the last depth find no new states? */
 
-  _Static_assert(sizeof(p) > sizeof(uintptr_t), "double_ptr_t is not big "
-    "enough to fit a pointer");
+/* Hold a new state until the current depth is finished.
+ *
+ * @return Number of states this thread is holding
+ */
+static size_t level_defer(struct state *NONNULL s) {
+
+  if (level_next[thread_id].count == level_next[thread_id].capacity) {
+    level_next[thread_id].capacity = level_next[thread_id].capacity == 0
+      ? 4096 / sizeof(s) : level_next[thread_id].capacity * 2;
+    level_next[thread_id].s = realloc(level_next[thread_id].s,
+      level_next[thread_id].capacity * sizeof(level_next[thread_id].s[0]));
+    if (__builtin_expect(level_next[thread_id].s == NULL, 0)) {
+      oom();
+    }
+  }
 
-  uintptr_t q;
-  memcpy(&q, &p, sizeof(q));
+  level_next[thread_id].s[level_next[thread_id].count] = s;
+  level_next[thread_id].count++;
 
-  return q;
+  return level_next[thread_id].count;
 }
 
-static uintptr_t double_ptr_extract2(double_ptr_t p) {
-
-  _Static_assert(sizeof(p) >= 2 * sizeof(uintptr_t), "double_ptr_t is not big "
-    "enough to fit two pointers");
+/* Run by the last thread to finish a depth, while the others wait. As no other
+ * thread is running, we can queue the next depth into every thread's queue,
+ * dealing its states out among them as we do the start states.
+ */
+static void level_end(void) {
+
+  size_t next = 0;
+  size_t queue_id = 0;
+  for (size_t i = 0; i < THREADS; i++) {
+    for (size_t j = 0; j < level_next[i].count; j++) {
+      (void)queue_enqueue(level_next[i].s[j], queue_id);
+      queue_id = (queue_id + 1) % (sizeof(q) / sizeof(q[0]));
+    }
+    next += level_next[i].count;
+    level_next[i].count = 0;
+  }
 
-  uintptr_t q;
-  memcpy(&q, (unsigned char*)&p + sizeof(void*), sizeof(q));
+  TRACE(TC_QUEUE, "finished depth %zu, with %zu states at the next depth",
+    level, next);
 
-  return q;
+  if (next == 0) {
+    level_done = true;
+  } else {
+    level++;
+  }
 }
 
-static double_ptr_t double_ptr_make(uintptr_t q1, uintptr_t q2) {
-
-  double_ptr_t p = 0;
+static bool level_advance(void) {
 
-  _Static_assert(sizeof(p) >= 2 * sizeof(uintptr_t), "double_ptr_t is not big "
-    "enough to fit two pointers");
+  /* Wait for the other threads to finish the current depth. */
+  rendezvous(level_end);
 
-  memcpy(&p, &q1, sizeof(q1));
-  memcpy((unsigned char*)&p + sizeof(q1), &q2, sizeof(q2));
+  /* If another thread exited after finding an error, it may have released us
+   * without starting the next depth.
+   */
+  if (__atomic_load_n(&error_count, __ATOMIC_SEQ_CST) >= MAX_ERRORS) {
+    return false;
+  }
 
-  return p;
+  return !level_done;
 }
+#endif
 
 /******************************************************************************/
 
+#if TREE_COMPRESSION_MB > 0
 /*******************************************************************************
- * State queue                                                                 *
+ * Tree compression                                                            *
  *                                                                             *
- * The following implements a per-thread queue for pending states. The only    *
- * supported operations are enqueueing and dequeueing states. A property we    *
- * maintain is that all states within all queues pass the current model's      *
- * invariants.                                                                 *
+ * With tree compression, the seen set does not store states themselves.       *
+ * Instead a state's data is cut into the leaves described by TREE_LEAF_OFFSET *
+ * and TREE_LEAF_WIDTH, which are paired up into a binary tree. Each distinct  *
+ * node of this tree is stored once, in a table shared by all states, and the  *
+ * seen set only holds the root. As most rules only change a few variables,   *
+ * states mostly share their nodes with other states.                          *
  ******************************************************************************/
 
-static struct {
-  double_ptr_t ends;
-  size_t count;
-} q[THREADS];
-
-static size_t queue_enqueue(struct state *NONNULL s, size_t queue_id) {
-  assert(queue_id < sizeof(q) / sizeof(q[0]) && "out of bounds queue access");
-
-  /* Look up the tail of the queue. */
-
-  double_ptr_t ends = atomic_read(&q[queue_id].ends);
+/* A node is a pair of children, each either a leaf value or the index of
+ * another node in the table. Children are at most this many bits, leaving the
+ * top bit of a node free to be set so that a node is never 0, an empty entry.
+ */
+enum { TREE_CHILD_BITS = 31 };
 
-retry:;
-  queue_handle_t tail = double_ptr_extract2(ends);
+/* The node table is given in megabytes, rounded down to a power of two, but
+ * limited to as many entries as a child can index.
+ */
+enum {
+  TREE_MB_SIZE_EXPONENT = sizeof(unsigned long long) * 8 - 1 -
+    __builtin_clzll(TREE_COMPRESSION_MB * 1024 * 1024 / sizeof(uint64_t)),
+  TREE_SIZE_EXPONENT = TREE_MB_SIZE_EXPONENT < TREE_CHILD_BITS
+    ? TREE_MB_SIZE_EXPONENT : TREE_CHILD_BITS,
+};
 
-  if (tail == 0) {
-    /* There's nothing currently in the queue. */
+/* Stop before the table is so full that probing for a free entry is slow. */
+enum { TREE_FULL_THRESHOLD = 90 };
 
-    assert(double_ptr_extract1(ends) == 0 && "tail of queue 0 while head is "
-      "non-0");
+static uint64_t *tree_nodes;
 
-    struct queue_node *n = queue_node_new();
-    n->s[0] = s;
+/* Number of occupied entries in 'tree_nodes'. */
+static size_t tree_count;
 
-    double_ptr_t new = double_ptr_make(queue_handle_from_node_ptr(n),
-                                       queue_handle_from_node_ptr(n));
+static size_t tree_size(void) {
+  return ((size_t)1) << TREE_SIZE_EXPONENT;
+}
 
-    double_ptr_t old = atomic_cas_val(&q[queue_id].ends, ends, new);
-    if (old != ends) {
-      /* Failed. */
-      queue_node_free(n);
-      ends = old;
-      goto retry;
-    }
+static void tree_init(void) {
+  tree_nodes = xhuge_calloc(tree_size() * sizeof(tree_nodes[0]));
+}
 
-  } else {
-    /* The queue is non-empty, so we'll need to access the last element. */
+static __attribute__((const)) uint64_t tree_node(uint64_t left,
+    uint64_t right) {
+  ASSERT(left < (UINT64_C(1) << TREE_CHILD_BITS) && "tree child out of range");
+  ASSERT(right < (UINT64_C(1) << TREE_CHILD_BITS) && "tree child out of range");
+  return ((left | (UINT64_C(1) << TREE_CHILD_BITS)) << 32) | right;
+}
 
-    /* Try to protect our upcoming access to the tail. */
-    hazard(tail);
-    {
-      double_ptr_t ends_check = atomic_read(&q[queue_id].ends);
-      if (ends != ends_check) {
-        /* Failed. Someone else modified the queue in the meantime. */
-        unhazard(tail);
-        ends = ends_check;
-        goto retry;
-      }
-    }
+/* Find a node in the table, adding it if it is not there yet.
+ *
+ * @return The index of the node
+ */
+static uint64_t tree_intern(uint64_t left, uint64_t right) {
 
-    /* We've now notified other threads that we're going to be accessing the
-     * tail, so we can safely dereference its pointer.
-     */
+  uint64_t node = tree_node(left, right);
 
-    struct queue_node *new_node = NULL;
-    queue_handle_t next_tail = queue_handle_next(tail);
+  size_t mask = tree_size() - 1;
+  for (size_t i = (size_t)MurmurHash64A(&node, sizeof(node)) & mask; ;
+       i = (i + 1) & mask) {
 
-    if (queue_handle_is_state_pptr(next_tail)) {
-      /* There's an available slot in this queue node; no need to create a new
-       * one.
-       */
+    uint64_t c = __atomic_load_n(&tree_nodes[i], __ATOMIC_SEQ_CST);
 
-      {
-        struct state **target = queue_handle_to_state_pptr(next_tail);
-        struct state *null = NULL;
-        if (!__atomic_compare_exchange_n(target, &null, s, false,
-            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
-          /* Failed. Someone else enqueued before we could. */
-          unhazard(tail);
-          goto retry;
+    if (c == 0) {
+      if (__atomic_compare_exchange_n(&tree_nodes[i], &c, node, false,
+          __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        size_t count = __atomic_add_fetch(&tree_count, 1, __ATOMIC_SEQ_CST);
+        if (__builtin_expect(count * 100 / tree_size() >= TREE_FULL_THRESHOLD,
+            0)) {
+          fprintf(stderr, "tree compression node table is full; try a larger "
+            "--tree-compression\n");
+          exit(EXIT_FAILURE);
         }
+        return i;
       }
-
-    } else {
-      /* There's no remaining slot in this queue node. We'll need to create a
-       * new (empty) queue node, add our state to this one and then append this
-       * node to the queue.
-       */
-
-      /* Create the new node. */
-      new_node = queue_node_new();
-      new_node->s[0] = s;
-
-      /* Try to update the chained pointer of the current tail to point to this
-       * new node.
+      /* Someone else claimed this entry. Fall through to see if it was with
+       * our node.
        */
-      struct queue_node **target = queue_handle_to_node_pptr(next_tail);
-      struct queue_node *null = NULL;
-      if (!__atomic_compare_exchange_n(target, &null, new_node, false,
-          __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
-        /* Failed. Someone else enqueued before we could. */
-        queue_node_free(new_node);
-        unhazard(tail);
-        goto retry;
-      }
+    }
 
-      /* We now need the tail to point at our new node. */
-      next_tail = queue_handle_from_node_ptr(new_node);
+    if (c == node) {
+      return i;
     }
+  }
+}
+#endif
 
-    queue_handle_t head = double_ptr_extract1(ends);
-    double_ptr_t new = double_ptr_make(head, next_tail);
+/******************************************************************************/
 
-    /* Try to update the queue. */
-    {
-      double_ptr_t old = atomic_cas_val(&q[queue_id].ends, ends, new);
-      if (old != ends) {
-        /* Failed. Someone else dequeued before we could finish. We know the
-         * operation that beat us was a dequeue and not an enqueue, because by
-         * writing to next_tail we have prevented any other enqueue from
-         * succeeding.
-         */
+/*******************************************************************************
+ * 'Slots', an opaque wrapper around a state pointer                           *
+ *                                                                             *
+ * See usage of this in the state set below for its purpose.                   *
+ ******************************************************************************/
 
-        /* Undo the update of next_tail. We know this is safe (non-racy) because
-         * no other enqueue can proceed and a dequeue will never look into
-         * next_tail due to the way it handles the case when head == tail.
-         */
-        next_tail = queue_handle_next(tail);
-        if (queue_handle_is_state_pptr(next_tail)) {
-          /* We previously wrote into an existing queue node. */
-          struct state **target = queue_handle_to_state_pptr(next_tail);
-          struct state *temp = s;
-          bool r __attribute__((unused)) = __atomic_compare_exchange_n(target,
-            &temp, NULL, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
-          assert(r && "undo of write to next_tail failed");
-        } else {
-          /* We previously wrote into a new queue node. */
-          struct queue_node **target = queue_handle_to_node_pptr(next_tail);
-          struct queue_node *temp = new_node;
-          bool r __attribute__((unused)) = __atomic_compare_exchange_n(target,
-            &temp, NULL, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
-          assert(r && "undo of write to next_tail failed");
-
-          queue_node_free(new_node);
+#if HASH_COMPACTION_BITS > 0 || TREE_COMPRESSION_MB > 0
+/* With hash compaction, a slot holds a fingerprint of a state rather than a
+ * pointer to it, and with tree compression the root node of the state. These
+ * can be wider than a pointer on 32-bit platforms.
+ */
+typedef uint64_t slot_t;
+#elif INLINE_STATES == 16
+/* With inline states, a slot holds the state's data itself. */
+typedef unsigned __int128 slot_t;
+#elif INLINE_STATES == 8
+typedef uint64_t slot_t;
+#else
+typedef uintptr_t slot_t;
+#endif
+
+/* Atomic accesses to a slot. GCC >= 7 turns 16-byte __atomic built-ins into
+ * calls to libatomic, which may take a lock, so 16-byte slots use the __sync
+ * built-ins to get an inline compare-and-swap instead. See
+ * https://gcc.gnu.org/bugzilla/show_bug.cgi?id=80878.
+ */
+static slot_t slot_load(slot_t *NONNULL p) {
+#if INLINE_STATES == 16
+  if (THREADS == 1) {
+    return *p;
+  }
+  return __sync_val_compare_and_swap(p, 0, 0);
+#else
+  return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/* Replace the slot's content with 'new' if it is '*expected'. Otherwise, update
+ * '*expected' to what the slot contains.
+ */
+static bool slot_cas(slot_t *NONNULL p, slot_t *NONNULL expected, slot_t new) {
+#if INLINE_STATES == 16
+  slot_t old;
+  if (THREADS == 1) {
+    old = *p;
+    if (old == *expected) {
+      *p = new;
+    }
+  } else {
+    old = __sync_val_compare_and_swap(p, *expected, new);
+  }
+  if (old == *expected) {
+    return true;
+  }
+  *expected = old;
+  return false;
+#else
+  return __atomic_compare_exchange_n(p, expected, new, false, __ATOMIC_SEQ_CST,
+    __ATOMIC_SEQ_CST);
+#endif
+}
+
+static __attribute__((const)) slot_t slot_empty(void) {
+  return 0;
+}
+
+static __attribute__((const)) bool slot_is_empty(slot_t s) {
+  return s == slot_empty();
+}
+
+static __attribute__((const)) slot_t slot_tombstone(void) {
+  static const slot_t TOMBSTONE = ~(slot_t)0;
+  return TOMBSTONE;
+}
+
+/* A slot that was empty when migrated. Lookups in a set being migrated need to
+ * be able to tell where their probe sequence would have ended.
+ */
+static __attribute__((const)) slot_t slot_tombstone_empty(void) {
+  static const slot_t TOMBSTONE_EMPTY = ~(slot_t)1;
+  return TOMBSTONE_EMPTY;
+}
+
+static __attribute__((const)) bool slot_is_tombstone(slot_t s) {
+  return s == slot_tombstone() || s == slot_tombstone_empty();
+}
+
+#if HASH_COMPACTION_BITS > 0
+_Static_assert(HASH_COMPACTION_BITS <= 64, "HASH_COMPACTION_BITS too large");
+
+/* Form the slot for a state, given its hash. */
+static slot_t state_to_slot(const struct state *s __attribute__((unused)),
+    size_t hash) {
+  slot_t fingerprint = (slot_t)hash;
+  if (HASH_COMPACTION_BITS < 64) {
+    fingerprint &= (UINT64_C(1) << (HASH_COMPACTION_BITS % 64)) - 1;
+  }
+
+  /* Avoid the reserved slot values. Note that this (very slightly) biases
+   * the fingerprint distribution towards 1.
+   */
+  if (slot_is_empty(fingerprint) || slot_is_tombstone(fingerprint)) {
+    fingerprint = 1;
+  }
+
+  return fingerprint;
+}
+
+/* Where in the set a fingerprint is stored. We derive this from the fingerprint
+ * itself, rather than the state's hash, so that migration does not need the
+ * original state.
+ */
+static size_t slot_hash(slot_t s) {
+  ASSERT(!slot_is_empty(s));
+  ASSERT(!slot_is_tombstone(s));
+  return (size_t)(s ^ (s >> 32));
+}
+#elif INLINE_STATES > 0
+/* An inline slot holds the state's data in its low bytes, in little endian
+ * order, and a 1 in its top byte. The generator only stores states inline
+ * when this leaves the top byte free, so an occupied slot cannot be confused
+ * with an empty one or a tombstone.
+ */
+enum { SLOT_MARKER_SHIFT = sizeof(slot_t) * CHAR_BIT - CHAR_BIT };
+_Static_assert(STATE_SIZE_BYTES < sizeof(slot_t),
+  "state too large to store inline in a slot");
+
+/* Form the slot for a state. Two states are equal exactly when their slots are.
+ */
+static slot_t state_to_slot(const struct state *s,
+    size_t hash __attribute__((unused))) {
+#if INLINE_STATES == 16
+  slot_t slot = copy_out128(s->data, sizeof(s->data));
+#else
+  slot_t slot = copy_out64(s->data, sizeof(s->data));
+#endif
+  return slot | ((slot_t)1 << SLOT_MARKER_SHIFT);
+}
+
+/* Where in the set a state is stored. Like hash compaction, we derive this from
+ * the slot so migration does not need the original state.
+ */
+static size_t slot_hash(slot_t s) {
+  ASSERT(!slot_is_empty(s));
+  ASSERT(!slot_is_tombstone(s));
+  return (size_t)MurmurHash64A(&s, sizeof(s));
+}
+#elif TREE_COMPRESSION_MB > 0
+/* Form the slot for a state, the root of its tree. Each level of the tree pairs
+ * up the nodes of the level below, with any odd one out carried up to the next
+ * level, until two remain. As the tree's shape only depends on the number of
+ * leaves, two states are equal exactly when their roots are.
+ */
+static slot_t state_to_slot(const struct state *s,
+    size_t hash __attribute__((unused))) {
+
+  uint64_t level[TREE_LEAVES + 1];
+  for (size_t i = 0; i < TREE_LEAVES; i++) {
+    struct handle h = state_handle(s, TREE_LEAF_OFFSET[i], TREE_LEAF_WIDTH[i]);
+    level[i] = read_raw(h);
+  }
+
+  size_t n = TREE_LEAVES;
+  while (n > 2) {
+    size_t m = 0;
+    for (size_t i = 0; i + 1 < n; i += 2) {
+      level[m] = tree_intern(level[i], level[i + 1]);
+      m++;
+    }
+    if (n % 2 != 0) {
+      level[m] = level[n - 1];
+      m++;
+    }
+    n = m;
+  }
+
+  /* The root is not added to the table, as the set holds it instead. */
+  return tree_node(n > 0 ? level[0] : 0, n > 1 ? level[1] : 0);
+}
+
+/* Where in the set a root is stored. As with hash compaction, we derive this
+ * from the slot itself.
+ */
+static size_t slot_hash(slot_t s) {
+  ASSERT(!slot_is_empty(s));
+  ASSERT(!slot_is_tombstone(s));
+  return (size_t)MurmurHash64A(&s, sizeof(s));
+}
+#else
+/* Number of low bits of a slot that hold a pointer to the state. The remaining
+ * high bits, which are always zero in a user space pointer, hold some bits of
+ * the state's hash as a tag. Lookups can then reject most states that differ
+ * by their tag, without dereferencing the slot. See also PREVIOUS_BITS.
+ */
+#if POINTER_BITS != 0
+  enum { SLOT_POINTER_BITS = POINTER_BITS };
+#elif defined(__linux__) && defined(__x86_64__) && !defined(__ILP32__)
+  /* assume 5-level paging, as for PREVIOUS_BITS above */
+  enum { SLOT_POINTER_BITS = 56 };
+#else
+  enum { SLOT_POINTER_BITS = sizeof(slot_t) * CHAR_BIT };
+#endif
+_Static_assert(SLOT_POINTER_BITS <= sizeof(slot_t) * CHAR_BIT,
+  "pointer bits exceed slot width");
+enum { SLOT_TAG_BITS = sizeof(slot_t) * CHAR_BIT - SLOT_POINTER_BITS };
+
+static slot_t slot_tag(slot_t s) {
+  if (SLOT_TAG_BITS == 0) {
+    return 0;
+  }
+  return s >> (SLOT_POINTER_BITS % (sizeof(slot_t) * CHAR_BIT));
+}
+
+static struct state *slot_to_state(slot_t s) {
+  ASSERT(!slot_is_empty(s));
+  ASSERT(!slot_is_tombstone(s));
+  if (SLOT_TAG_BITS == 0) {
+    return (struct state*)s;
+  }
+  return (struct state*)(s & ((((slot_t)1) << (SLOT_POINTER_BITS
+    % (sizeof(slot_t) * CHAR_BIT))) - 1));
+}
+
+/* Form the slot for a state, given its hash. */
+static slot_t state_to_slot(const struct state *s, size_t hash) {
+  slot_t slot = (slot_t)s;
+  if (SLOT_TAG_BITS == 0) {
+    return slot;
+  }
+
+  ASSERT(slot_tag(slot) == 0 && "state pointer exceeds SLOT_POINTER_BITS; "
+    "try a larger --pointer-bits");
+
+  /* Take the tag from the middle of the hash. The low bits select a bucket,
+   * so are mostly shared by the states we compare against, and the high bits
+   * select the owning process in multi-process exploration.
+   */
+  slot_t tag = (slot_t)(hash >> (sizeof(hash) * CHAR_BIT / 2));
+  return slot | (tag << (SLOT_POINTER_BITS % (sizeof(slot_t) * CHAR_BIT)));
+}
+
+static size_t slot_hash(slot_t s) {
+  return state_hash(slot_to_state(s));
+}
+#endif
+
+/******************************************************************************/
+
+/*******************************************************************************
+ * State set                                                                   *
+ *                                                                             *
+ * The following implementation provides a set for storing the seen states.    *
+ * There is no support for removing elements, only thread-safe insertion of    *
+ * elements.                                                                   *
+ ******************************************************************************/
+
+#if BITSTATE_MB > 0
+/* In a bitstate search, the set is a bit array whose size is given in
+ * megabytes, rounded down to a power of two.
+ */
+enum { INITIAL_SET_SIZE_EXPONENT = sizeof(unsigned long long) * 8 - 1 -
+  __builtin_clzll(BITSTATE_MB * 1024 * 1024 / sizeof(slot_t)) };
+#else
+enum {
+#if !SLOTS_POINT_TO_STATES
+  /* With hash compaction or inline states, the set capacity only needs to
+   * account for the slots themselves.
+   */
+  CAPACITY_SET_SIZE_EXPONENT = sizeof(unsigned long long) * 8 - 1 -
+    __builtin_clzll(SET_CAPACITY / sizeof(slot_t)),
+#else
+  CAPACITY_SET_SIZE_EXPONENT = sizeof(unsigned long long) * 8 - 1 -
+    __builtin_clzll(SET_CAPACITY / sizeof(struct state*) / sizeof(struct state)),
+#endif
+
+  /* With --size-hint, start with a set that can hold as many states as the last
+   * run found without expanding. With external memory the set is only a cache
+   * of recent states, so is left at its configured capacity.
+   */
+#if SIZE_HINT_STATES > 0 && !EXTERNAL_MEMORY
+  HINT_SET_SIZE_EXPONENT = sizeof(unsigned long long) * 8 -
+    __builtin_clzll((SIZE_HINT_STATES + PROCESSES - 1) / PROCESSES * 100
+      / SET_EXPAND_THRESHOLD),
+#else
+  HINT_SET_SIZE_EXPONENT = 0,
+#endif
+
+  INITIAL_SET_SIZE_EXPONENT = HINT_SET_SIZE_EXPONENT > CAPACITY_SET_SIZE_EXPONENT
+    ? HINT_SET_SIZE_EXPONENT : CAPACITY_SET_SIZE_EXPONENT,
+};
+#endif
+
+struct set {
+  slot_t *bucket;
+  size_t size_exponent;
+
+  /* The smaller set this one replaced, while its contents are still being
+   * migrated into this one. NULL once migration is complete.
+   */
+  struct set *previous;
+
+  /* Progress of migrating this set into the larger one that replaced it. See
+   * 'set_migrate_chunk'.
+   */
+  uint8_t *chunk_state;
+  size_t chunk_count;
+  size_t next_chunk;
+  size_t chunks_done;
+  double migration_start; /* milliseconds, when tracing */
+
+  /* Once migration is complete, the epoch at which this set was retired and the
+   * next set awaiting reclamation. See 'set_reclaim'.
+   */
+  size_t retired_epoch;
+  struct set *retired_next;
+};
+
+/* Some utility functions for dealing with exponents. */
+
+static size_t set_size(const struct set *NONNULL set) {
+  return ((size_t)1) << set->size_exponent;
+}
+
+static size_t set_index(const struct set *NONNULL set, size_t index) {
+  return index & (set_size(set) - 1);
+}
+
+/* The states we have encountered. This collection will only ever grow while
+ * checking the model. 'current_seen' is the set states are inserted into. Each
+ * thread keeps its own pointer to it in 'local_seen', which it refreshes at the
+ * start of each insertion.
+ */
+static struct set *current_seen;
+static _Thread_local struct set *local_seen;
+
+/* Number of elements in the global set (i.e. occupancy). */
+static size_t seen_count;
+
+/* When the occupancy of the set exceeds a threshold, it is expanded without
+ * stopping exploration. A set of double the size becomes the current set and
+ * records the old one as its 'previous'. The old set's slots are then migrated
+ * into the new set a chunk at a time:
+ *
+ *   * Before inserting a state, a thread makes sure the chunks of the old set
+ *     its state would be found in have been migrated. So a state is never
+ *     inserted into the new set while a copy of it is still waiting in the old
+ *     set to be migrated.
+ *   * Each insertion also migrates one further chunk, so that migration
+ *     completes while the new set is still sparsely occupied.
+ *   * A thread that needs a chunk another thread is part way through migrating
+ *     waits for it. This is the only time a thread is held up.
+ *
+ * Threads that have not yet noticed the expansion may still insert into the old
+ * set. Such an insertion either lands in a slot not yet migrated, and is carried
+ * over with it, or finds its slot migrated and retries on the new set.
+ *
+ * Once migration is complete, the old set is retired. It is freed when every
+ * thread has since refreshed its 'local_seen' and so can no longer be using it.
+ */
+
+/* Number of slots in a migration chunk. */
+enum { SET_CHUNK_SIZE = 4096 / sizeof(slot_t) };
+
+/* Migration states of a chunk. */
+enum { CHUNK_PENDING, CHUNK_MIGRATING, CHUNK_MIGRATED };
+
+/* Reclamation of retired sets. 'set_epoch' advances each time a set is retired.
+ * Each thread records in 'set_quiescent' the epoch as of which it last
+ * refreshed its 'local_seen', or SIZE_MAX if it is not using the set. A retired
+ * set can be freed once every thread has recorded an epoch at least that of its
+ * retirement.
+ */
+static size_t set_epoch;
+static size_t set_quiescent[THREADS];
+static struct set *set_retired;
+
+/* A mechanism for synchronisation in 'set_expand'. This also protects
+ * 'set_retired'.
+ */
+static pthread_mutex_t set_expand_mutex;
+
+static void set_expand_lock(void) {
+  if (THREADS > 1) {
+    int r __attribute__((unused)) = pthread_mutex_lock(&set_expand_mutex);
+    ASSERT(r == 0);
+  }
+}
+
+static void set_expand_unlock(void) {
+  if (THREADS > 1) {
+    int r __attribute__((unused)) = pthread_mutex_unlock(&set_expand_mutex);
+    ASSERT(r == 0);
+  }
+}
+
+/* Milliseconds on a monotonic clock, for tracing the expansion timeline. */
+static double set_time(void) {
+  struct timespec t;
+  (void)clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec * 1000.0 + (double)t.tv_nsec / 1000000.0;
+}
+
+/* When tracing, the time set_init() was called. */
+static double set_trace_origin;
+
+static void set_init(void) {
+
+  if (THREADS > 1) {
+    int r = pthread_mutex_init(&set_expand_mutex, NULL);
+    if (__builtin_expect(r < 0, 0)) {
+      fprintf(stderr, "pthread_mutex_init failed: %s\n", strerror(r));
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  /* No thread is using the set until it calls set_thread_init(). */
+  for (size_t i = 0; i < THREADS; i++) {
+    set_quiescent[i] = SIZE_MAX;
+  }
+
+  if (TC_SET & TRACES_ENABLED) {
+    set_trace_origin = set_time();
+  }
+
+#if TREE_COMPRESSION_MB > 0
+  tree_init();
+#endif
+
+  /* Allocate the set we'll store seen states in at some conservative initial
+   * size.
+   */
+  struct set *set = xcalloc(1, sizeof(*set));
+  set->size_exponent = INITIAL_SET_SIZE_EXPONENT;
+  set->bucket = xhuge_calloc(set_size(set) * sizeof(set->bucket[0]));
+  numa_interleave(set->bucket, set_size(set) * sizeof(set->bucket[0]));
+
+  /* Stash this somewhere for threads to later retrieve it from. */
+  __atomic_store_n(&current_seen, set, __ATOMIC_SEQ_CST);
+}
+
+static void set_thread_init(void) {
+  /* Record the epoch before taking a pointer to the set, so no set we could see
+   * is freed while we are using it.
+   */
+  __atomic_store_n(&set_quiescent[thread_id],
+    __atomic_load_n(&set_epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+  local_seen = __atomic_load_n(&current_seen, __ATOMIC_SEQ_CST);
+}
+
+/* Stop using the set, so we do not hold up reclamation of retired sets. */
+static void set_thread_exit(void) {
+  local_seen = NULL;
+  __atomic_store_n(&set_quiescent[thread_id], SIZE_MAX, __ATOMIC_SEQ_CST);
+}
+
+/* Free any retired sets no thread can still be using. */
+static void set_reclaim(void) {
+
+  if (__atomic_load_n(&set_retired, __ATOMIC_SEQ_CST) == NULL) {
+    return;
+  }
+
+  size_t oldest = SIZE_MAX;
+  for (size_t i = 0; i < THREADS; i++) {
+    size_t epoch = __atomic_load_n(&set_quiescent[i], __ATOMIC_SEQ_CST);
+    if (epoch < oldest) {
+      oldest = epoch;
+    }
+  }
+
+  set_expand_lock();
+  struct set **p = &set_retired;
+  while (*p != NULL) {
+    struct set *s = *p;
+    if (s->retired_epoch > oldest) {
+      p = &s->retired_next;
+      continue;
+    }
+    __atomic_store_n(p, s->retired_next, __ATOMIC_SEQ_CST);
+    TRACE(TC_SET, "[%.3fms] freed retired set of %zu slots",
+      set_time() - set_trace_origin, set_size(s));
+    huge_free(s->bucket, set_size(s) * sizeof(s->bucket[0]));
+    free(s->chunk_state);
+    free(s);
+  }
+  set_expand_unlock();
+}
+
+/* Pick up the current set. The caller must not hold on to any other pointer to
+ * a set across this, as it allows sets we were using to be freed.
+ */
+static void set_refresh(void) {
+  size_t epoch = __atomic_load_n(&set_epoch, __ATOMIC_SEQ_CST);
+  local_seen = __atomic_load_n(&current_seen, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&set_quiescent[thread_id], __ATOMIC_SEQ_CST) != epoch) {
+    __atomic_store_n(&set_quiescent[thread_id], epoch, __ATOMIC_SEQ_CST);
+    set_reclaim();
+  }
+}
+
+/* Finish a migration, retiring the set that was migrated from. */
+static void set_migration_done(struct set *NONNULL to,
+    struct set *NONNULL from) {
+
+  __atomic_store_n(&to->previous, NULL, __ATOMIC_SEQ_CST);
+
+  TRACE(TC_SET, "[%.3fms] migration into set of %zu slots completed in %.3fms",
+    set_time() - set_trace_origin, set_size(to),
+    set_time() - from->migration_start);
+
+  set_expand_lock();
+  from->retired_epoch = __atomic_add_fetch(&set_epoch, 1, __ATOMIC_SEQ_CST);
+  from->retired_next = set_retired;
+  __atomic_store_n(&set_retired, from, __ATOMIC_SEQ_CST);
+  set_expand_unlock();
+}
+
+/* Move the slots of one chunk of a set into the set that replaced it. */
+static void set_migrate_slots(struct set *NONNULL to, struct set *NONNULL from,
+    size_t chunk) {
+
+  size_t start = chunk * SET_CHUNK_SIZE;
+  size_t end = start + SET_CHUNK_SIZE;
+
+  /* The set may be smaller than a chunk. */
+  if (end > set_size(from)) {
+    end = set_size(from);
+  }
+
+  for (size_t i = start; i < end; i++) {
+
+    /* Retrieve the slot element and mark it as migrated, noting whether it was
+     * empty so lookups can still tell where their probe sequences ended.
+     */
+    slot_t s = slot_load(&from->bucket[i]);
+    for (;;) {
+      ASSERT(!slot_is_tombstone(s) && "attempted double slot migration");
+      slot_t t = slot_is_empty(s) ? slot_tombstone_empty() : slot_tombstone();
+      if (slot_cas(&from->bucket[i], &s, t)) {
+        break;
+      }
+    }
+
+    if (slot_is_empty(s)) {
+      continue;
+    }
+
+    /* Rehash the state and insert it into the new set. We do not need to do
+     * any state comparisons, because no other copy of it can be in the new set
+     * until its chunk is marked migrated.
+     */
+    for (size_t j = set_index(to, slot_hash(s)); ; j = set_index(to, j + 1)) {
+      slot_t c = slot_empty();
+      if (slot_cas(&to->bucket[j], &c, s)) {
+        break;
+      }
+    }
+  }
+}
+
+/* Make sure a chunk of a set has been migrated into the set that replaced it,
+ * migrating it ourselves if no one has started to. If 'wait' is false, we
+ * do not wait for another thread that is already migrating it.
+ */
+static void set_migrate_chunk(struct set *NONNULL to, struct set *NONNULL from,
+    size_t chunk, bool wait) {
+
+  uint8_t state = __atomic_load_n(&from->chunk_state[chunk], __ATOMIC_SEQ_CST);
+  if (state == CHUNK_MIGRATED) {
+    return;
+  }
+
+  if (state == CHUNK_PENDING && __atomic_compare_exchange_n(
+      &from->chunk_state[chunk], &state, CHUNK_MIGRATING, false,
+      __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+    set_migrate_slots(to, from, chunk);
+    __atomic_store_n(&from->chunk_state[chunk], CHUNK_MIGRATED,
+      __ATOMIC_SEQ_CST);
+    if (__atomic_add_fetch(&from->chunks_done, 1, __ATOMIC_SEQ_CST)
+        == from->chunk_count) {
+      set_migration_done(to, from);
+    }
+    return;
+  }
+
+  if (!wait) {
+    return;
+  }
+
+  /* Another thread is migrating this chunk. It only has a chunk's worth of
+   * slots to move, so we will not be waiting long.
+   */
+  while (__atomic_load_n(&from->chunk_state[chunk], __ATOMIC_SEQ_CST)
+      != CHUNK_MIGRATED);
+}
+
+/* Make sure the slots a lookup for the given hash would probe in a set being
+ * migrated have been migrated.
+ */
+static void set_migrate_range(struct set *NONNULL to, struct set *NONNULL from,
+    size_t hash) {
+
+  size_t i = set_index(from, hash);
+  for (size_t visited = 0; visited < from->chunk_count; visited++) {
+
+    size_t chunk = i / SET_CHUNK_SIZE;
+    set_migrate_chunk(to, from, chunk, true);
+
+    /* Look for the slot that was empty when migrated, where the probe sequence
+     * would have ended.
+     */
+    size_t end = (chunk + 1) * SET_CHUNK_SIZE;
+    if (end > set_size(from)) {
+      end = set_size(from);
+    }
+    for (; i < end; i++) {
+      if (slot_load(&from->bucket[i]) == slot_tombstone_empty()) {
+        return;
+      }
+    }
+
+    i = set_index(from, i);
+  }
+}
+
+/* Migrate the next chunk no one has yet claimed, to keep migration moving. */
+static void set_migrate_step(struct set *NONNULL to, struct set *NONNULL from) {
+  size_t chunk = __atomic_fetch_add(&from->next_chunk, 1, __ATOMIC_SEQ_CST);
+  if (chunk < from->chunk_count) {
+    set_migrate_chunk(to, from, chunk, false);
+  }
+}
+
+/* Migrate everything that remains, waiting for any chunks other threads are
+ * migrating.
+ */
+static void set_migrate_all(struct set *NONNULL to, struct set *NONNULL from) {
+  for (size_t i = 0; i < from->chunk_count; i++) {
+    set_migrate_chunk(to, from, i, true);
+  }
+}
+
+#if CHECKPOINT
+/* Checkpointing. These are defined below. */
+static bool checkpoint_is_pending(void);
+static void checkpoint_join(void);
+#endif
+
+static __attribute__((unused)) void set_expand(void) {
+
+  set_expand_lock();
+
+  /* Check, now that we hold the lock, that another thread has not already
+   * expanded the set and that it is not still being filled from an earlier
+   * expansion.
+   */
+  struct set *seen = __atomic_load_n(&current_seen, __ATOMIC_SEQ_CST);
+  if (seen != local_seen
+      || __atomic_load_n(&seen->previous, __ATOMIC_SEQ_CST) != NULL) {
+    set_expand_unlock();
+    TRACE(TC_SET, "attempted expansion failed because another thread got there "
+      "first");
+    return;
+  }
+
+#if CHECKPOINT
+  /* Someone has requested a checkpoint, which cannot be taken while the set is
+   * being migrated. Join them first. Our caller will retry the expansion.
+   */
+  if (checkpoint_is_pending()) {
+    set_expand_unlock();
+    checkpoint_join();
+    return;
+  }
+#endif
+
+  TRACE(TC_SET, "[%.3fms] expanding set from %zu slots to %zu slots",
+    set_time() - set_trace_origin, set_size(seen), set_size(seen) * 2);
+
+  /* Divide the current set into chunks to migrate. */
+  seen->chunk_count = (set_size(seen) + SET_CHUNK_SIZE - 1) / SET_CHUNK_SIZE;
+  seen->chunk_state = xcalloc(seen->chunk_count, sizeof(seen->chunk_state[0]));
+  if (TC_SET & TRACES_ENABLED) {
+    seen->migration_start = set_time();
+  }
+
+  /* Create a set of double the size. */
+  struct set *set = xcalloc(1, sizeof(*set));
+  set->size_exponent = seen->size_exponent + 1;
+  set->bucket = xhuge_calloc(set_size(set) * sizeof(set->bucket[0]));
+  numa_interleave(set->bucket, set_size(set) * sizeof(set->bucket[0]));
+  set->previous = seen;
+
+  /* Publish it. From here, threads insert into the new set and migrate the old
+   * one as they go.
+   */
+  __atomic_store_n(&current_seen, set, __ATOMIC_SEQ_CST);
+
+  set_expand_unlock();
+}
+
+/*******************************************************************************
+ * External memory                                                             *
+ *                                                                             *
+ * With `--external-memory`, the seen set acts as a bounded cache in front of  *
+ * files on disk, following Stern and Dill, "Using magnetic disk instead of    *
+ * main memory in the Murphi verifier," in CAV 1998. Newly seen states are     *
+ * held in the cache until it fills up or the current BFS layer is exhausted.  *
+ * They are then sorted and merged against a sorted file of every state seen   *
+ * so far, and those that turn out to be new are written to the file holding   *
+ * the next BFS layer.                                                         *
+ ******************************************************************************/
+
+#if EXTERNAL_MEMORY
+/* The data of every state seen so far, sorted, and a scratch file to merge into
+ * when updating this.
+ */
+static FILE *visited;
+static FILE *next_visited;
+
+/* Full states of the BFS layer currently being expanded and of the next layer,
+ * with a count of how many states remain in each.
+ */
+static FILE *frontier;
+static size_t frontier_count;
+static FILE *next_frontier;
+static size_t next_frontier_count;
+
+/* States in the seen set cache that have not yet been checked against
+ * 'visited'.
+ */
+static struct state **pending;
+static size_t pending_count;
+static size_t pending_capacity;
+
+static FILE *external_open(void) {
+
+  char path[] = EXTERNAL_MEMORY_DIR "/rumur-XXXXXX";
+  int fd = mkstemp(path);
+  if (__builtin_expect(fd < 0, 0)) {
+    fprintf(stderr, "failed to create file in %s: %s\n", EXTERNAL_MEMORY_DIR,
+      strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  /* We only need the file for as long as we have it open. */
+  (void)unlink(path);
+
+  FILE *f = fdopen(fd, "w+b");
+  if (__builtin_expect(f == NULL, 0)) {
+    fprintf(stderr, "fdopen failed: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  return f;
+}
+
+/* Open the files we need. This must be done before entering the sandbox. */
+static void external_init(void) {
+  visited = external_open();
+  next_visited = external_open();
+  frontier = external_open();
+  next_frontier = external_open();
+}
+
+static void external_write(FILE *NONNULL f, const void *NONNULL p,
+    size_t size) {
+  if (__builtin_expect(fwrite(p, size, 1, f) != 1, 0)) {
+    fprintf(stderr, "failed to write to external memory: %s\n",
+      strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+}
+
+static bool external_read(FILE *NONNULL f, void *NONNULL p, size_t size) {
+  if (fread(p, size, 1, f) == 1) {
+    return true;
+  }
+  if (__builtin_expect(ferror(f), 0)) {
+    fprintf(stderr, "failed to read from external memory: %s\n",
+      strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  return false;
+}
+
+/* Discard the contents of a file and position it for writing. */
+static void external_reset(FILE *NONNULL f) {
+  rewind(f);
+  if (__builtin_expect(ftruncate(fileno(f), 0) != 0, 0)) {
+    fprintf(stderr, "failed to truncate external memory: %s\n",
+      strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void external_defer(struct state *NONNULL s) {
+  if (pending_count == pending_capacity) {
+    pending_capacity = pending_capacity == 0 ? 1024 : pending_capacity * 2;
+    pending = realloc(pending, pending_capacity * sizeof(pending[0]));
+    if (__builtin_expect(pending == NULL, 0)) {
+      oom();
+    }
+  }
+  pending[pending_count] = s;
+  pending_count++;
+}
+
+static int external_cmp(const void *NONNULL a, const void *NONNULL b) {
+  const struct state *const *x = a;
+  const struct state *const *y = b;
+  return state_cmp(*x, *y);
+}
+
+/* Check all pending states against those on disk, empty the seen set cache,
+ * and queue any pending states that were new.
+ */
+static void external_flush(void) {
+
+  TRACE(TC_SET, "checking %zu cached state(s) against external memory",
+    pending_count);
+
+  qsort(pending, pending_count, sizeof(pending[0]), external_cmp);
+
+  rewind(visited);
+  external_reset(next_visited);
+
+  uint8_t record[STATE_SIZE_BYTES];
+  bool have_record = external_read(visited, record, sizeof(record));
+
+  for (size_t i = 0; i < pending_count; i++) {
+    struct state *s = pending[i];
+
+    /* Copy across any older states that sort before this one. */
+    while (have_record && memcmp(record, s->data, sizeof(record)) < 0) {
+      external_write(next_visited, record, sizeof(record));
+      have_record = external_read(visited, record, sizeof(record));
+    }
+
+    if (have_record && memcmp(record, s->data, sizeof(record)) == 0) {
+      /* We saw this state in an earlier layer. */
+      seen_count--;
+    } else {
+      external_write(next_visited, s->data, sizeof(s->data));
+
+      bool expand = true;
+#if BOUND > 0
+      expand = state_bound_get(s) < BOUND;
+#endif
+      if (expand) {
+        external_write(next_frontier, s, sizeof(*s));
+        next_frontier_count++;
+      }
+    }
+
+    state_free(s);
+  }
+
+  /* Copy across the remaining older states. */
+  while (have_record) {
+    external_write(next_visited, record, sizeof(record));
+    have_record = external_read(visited, record, sizeof(record));
+  }
+
+  FILE *f = visited;
+  visited = next_visited;
+  next_visited = f;
+
+  pending_count = 0;
+  memset(local_seen->bucket, 0,
+    set_size(local_seen) * sizeof(local_seen->bucket[0]));
+}
+
+static size_t external_queue_size(void) {
+  return frontier_count + next_frontier_count + pending_count;
+}
+
+static const struct state *external_dequeue(void) {
+
+  for (;;) {
+
+    if (frontier_count > 0) {
+      struct state *s = state_new();
+      bool r __attribute__((unused)) = external_read(frontier, s, sizeof(*s));
+      assert(r && "external memory frontier shorter than expected");
+      frontier_count--;
+      return s;
+    }
+
+    /* We have exhausted the current layer. Settle the next one and move to
+     * it.
+     */
+    if (pending_count > 0) {
+      external_flush();
+    }
+
+    if (next_frontier_count == 0) {
+      return NULL;
+    }
+
+    TRACE(TC_QUEUE, "moving to a BFS layer of %zu state(s) in external memory",
+      next_frontier_count);
+
+    FILE *f = frontier;
+    frontier = next_frontier;
+    frontier_count = next_frontier_count;
+    next_frontier = f;
+    next_frontier_count = 0;
+
+    rewind(frontier);
+    external_reset(next_frontier);
+  }
+}
+#endif
+
+/******************************************************************************/
+
+#if BITSTATE_MB > 0
+/* Number of bits of the bit array set for each state in a bitstate search. */
+enum { BITSTATE_HASHES = 3 };
+
+/* Insertion for a bitstate search. Here the set's buckets are treated as a
+ * Bloom filter. The probe positions are derived from the state's hash by double
+ * hashing, with the second hash being a rehash of the first.
+ */
+static bool bitstate_insert(struct state *NONNULL s, size_t *NONNULL count) {
+
+  enum { SLOT_BITS = sizeof(slot_t) * CHAR_BIT };
+
+  uint64_t h1 = MurmurHash64A(s->data, sizeof(s->data));
+  uint64_t h2 = MurmurHash64A(&h1, sizeof(h1)) | 1;
+  uint64_t mask = (uint64_t)set_size(local_seen) * SLOT_BITS - 1;
+
+  bool is_new = false;
+  for (size_t i = 0; i < BITSTATE_HASHES; i++) {
+    uint64_t bit = (h1 + i * h2) & mask;
+    slot_t b = ((slot_t)1) << (bit % SLOT_BITS);
+    slot_t prior = __atomic_fetch_or(&local_seen->bucket[bit / SLOT_BITS], b,
+      __ATOMIC_SEQ_CST);
+    if (!(prior & b)) {
+      is_new = true;
+    }
+  }
+
+  if (!is_new) {
+    TRACE(TC_SET, "skipped adding state %p whose bits were all set", s);
+    return false;
+  }
+
+  *count = __atomic_add_fetch(&seen_count, 1, __ATOMIC_SEQ_CST);
+  TRACE(TC_SET, "added state %p, set size is now %zu", s, *count);
+
+  size_t depth = 0;
+#if BOUND > 0
+  depth = (size_t)state_bound_get(s);
+#endif
+  register_allocation(depth);
+
+  return true;
+}
+
+/* Estimate the fraction of the state space a bitstate search covered. A state
+ * is wrongly considered seen if all of its bits were already set, so for a bit
+ * array with a fraction f of its bits set, this is 1 - f^k.
+ */
+static __attribute__((unused)) double bitstate_coverage(void) {
+
+  uint64_t set_bits = 0;
+  for (size_t i = 0; i < set_size(local_seen); i++) {
+    set_bits += (uint64_t)__builtin_popcountll(local_seen->bucket[i]);
+  }
+
+  double fill = (double)set_bits
+    / ((double)set_size(local_seen) * sizeof(slot_t) * CHAR_BIT);
+
+  double miss = 1;
+  for (size_t i = 0; i < BITSTATE_HASHES; i++) {
+    miss *= fill;
+  }
+
+  return 1 - miss;
+}
+#endif
+
+#if PROCESSES > 1
+/* Partitioning states among processes. These are defined below. */
+static size_t dist_owner(const struct state *NONNULL s);
+static void dist_forward(size_t owner, const struct state *NONNULL s);
+#endif
+
+/* The hash a state is placed in the seen set by. The set representations that
+ * place a state by its slot, or that hash it themselves, do not need one.
+ */
+static size_t set_hash(struct state *NONNULL s) {
+  if (INLINE_STATES > 0 || TREE_COMPRESSION_MB > 0 || BITSTATE_MB > 0) {
+    return 0;
+  }
+  return state_hash_cache(s);
+}
+
+/* Copy a staged state (see set_insert_hashed) to a state of its own. */
+static struct state *state_unstage(const struct state *NONNULL s) {
+  struct state *n = state_new();
+  memcpy(n, s, sizeof(*n));
+  return n;
+}
+
+/* Insert a state into the seen set, given its set_hash(). If 'staged' is true,
+ * '*s' is a transient copy of the state, like those in 'successors' below. It
+ * is then only copied to a state of its own if it turns out to be new, in
+ * which case '*s' is updated to point to the copy.
+ */
+static bool set_insert_hashed(struct state *NONNULL *NONNULL s, size_t hash,
+    bool staged, size_t *NONNULL count) {
+
+#if PROCESSES > 1
+  /* If another process owns this state, hand it over. Whether it is new is for
+   * that process to determine, so as far as we are concerned it is not.
+   */
+  size_t owner = dist_owner(*s);
+  if (owner != process_id) {
+    dist_forward(owner, *s);
+    return false;
+  }
+#endif
+
+#if BITSTATE_MB > 0
+  if (!bitstate_insert(*s, count)) {
+    return false;
+  }
+  if (staged) {
+    *s = state_unstage(*s);
+  }
+  return true;
+#endif
+
+  /* The staged state, to return to if a copy of it turns out to have been a
+   * duplicate after all.
+   */
+  struct state *original = staged ? *s : NULL;
+
+restart:;
+
+  set_refresh();
+
+#if EXTERNAL_MEMORY
+  /* The cache does not expand. Instead we make room when it fills up. */
+  if (pending_count * 100 / set_size(local_seen) >= SET_EXPAND_THRESHOLD)
+    external_flush();
+#endif
+
+  struct set *previous = __atomic_load_n(&local_seen->previous,
+    __ATOMIC_SEQ_CST);
+
+#if !EXTERNAL_MEMORY
+  if (previous == NULL && __atomic_load_n(&seen_count, __ATOMIC_SEQ_CST) * 100
+      / set_size(local_seen) >= SET_EXPAND_THRESHOLD) {
+    set_expand();
+    goto restart;
+  }
+#endif
+
+  slot_t slot = state_to_slot(*s, hash);
+  size_t index_hash = SLOTS_POINT_TO_STATES ? hash : slot_hash(slot);
+  size_t index = set_index(local_seen, index_hash);
+
+  /* If the set is still being filled from the one it replaced, make sure any
+   * copy of this state in the old set has been carried over before we look in
+   * the new one, and help the migration along.
+   */
+  if (previous != NULL) {
+    double pause_start = (TC_SET & TRACES_ENABLED) ? set_time() : 0;
+    set_migrate_range(local_seen, previous, index_hash);
+    set_migrate_step(local_seen, previous);
+    TRACE(TC_SET, "[%.3fms] insertion paused %.3fms to migrate into set of %zu "
+      "slots", pause_start - set_trace_origin, set_time() - pause_start,
+      set_size(local_seen));
+  }
+
+  size_t attempts = 0;
+  for (size_t i = index; attempts < set_size(local_seen); i = set_index(local_seen, i + 1)) {
+
+    /* Guess that the current slot is empty and try to insert here. */
+    slot_t c = slot_empty();
+#if SLOTS_POINT_TO_STATES
+    /* A slot refers to its state, so a staged state must be copied before it
+     * can be inserted. Check the slot is empty first, so that we do not copy
+     * states that turn out to be duplicates.
+     */
+    if (staged) {
+      c = slot_load(&local_seen->bucket[i]);
+      if (slot_is_empty(c)) {
+        *s = state_unstage(*s);
+        staged = false;
+        slot = state_to_slot(*s, hash);
+      }
+    }
+#endif
+    if (slot_is_empty(c) && slot_cas(&local_seen->bucket[i], &c, slot)) {
+      /* Success */
+      if (staged) {
+        *s = state_unstage(*s);
+      }
+      *count = __atomic_add_fetch(&seen_count, 1, __ATOMIC_SEQ_CST);
+      TRACE(TC_SET, "added state %p, set size is now %zu", *s, *count);
+
+      /* The maximum possible size of the seen state set should be constrained
+       * by the number of possible states based on how many bits we are using to
+       * represent the state data.
+       */
+      if (STATE_SIZE_BITS < sizeof(size_t) * CHAR_BIT) {
+        assert(*count <= ((size_t)1) << STATE_SIZE_BITS && "seen set size "
+          "exceeds total possible number of states");
+      }
+
+      /* Update statistics if `--trace memory_usage` is in effect. Note that we
+       * do this here (when a state is being added to the seen set) rather than
+       * when the state was originally allocated to ensure that the final
+       * allocation figures do not include transient states that we allocated
+       * and then discarded as duplicates.
+       */
+       size_t depth = 0;
+#if BOUND > 0
+       depth = (size_t)state_bound_get(*s);
+#endif
+       register_allocation(depth);
+
+#if EXTERNAL_MEMORY
+      external_defer(*s);
+#endif
+
+      return true;
+    }
+
+    if (slot_is_tombstone(c)) {
+      /* This slot has been migrated. Restart our insertion attempt on the newly
+       * expanded set.
+       */
+      goto restart;
+    }
+
+    /* If we find this already in the set, we're done. With hash compaction,
+     * we can only compare fingerprints, and states whose fingerprints collide
+     * are (wrongly) considered duplicates. An inline slot is the state itself,
+     * and a tree compressed slot identifies it.
+     */
+#if !SLOTS_POINT_TO_STATES
+    if (c == slot) {
+#else
+    if (slot_tag(c) == slot_tag(slot) && state_eq(*s, slot_to_state(c))) {
+#endif
+      TRACE(TC_SET, "skipped adding state %p that was already in set", *s);
+      /* If we copied a staged state, another thread inserted it first. */
+      if (original != NULL && *s != original) {
+        state_free(*s);
+        *s = original;
+      }
+      return false;
+    }
+
+    attempts++;
+  }
+
+  /* If we reach here, the set is full. Expand it and retry the insertion. */
+#if EXTERNAL_MEMORY
+  external_flush();
+#else
+  if (previous != NULL) {
+    set_migrate_all(local_seen, previous);
+  }
+  set_expand();
+#endif
+  goto restart;
+}
+
+static bool set_insert(struct state *NONNULL s, size_t *NONNULL count) {
+  return set_insert_hashed(&s, set_hash(s), false, count);
+}
+
+/* Successor states awaiting insertion into the seen set. The generated
+ * explore() builds successors in place here and inserts them in batches, so
+ * that the cache misses of looking them up can overlap. As most successors
+ * turn out to be duplicates, only those that are new are copied out, by
+ * set_insert_hashed().
+ */
+enum { SUCCESSOR_BATCH = 16 };
+static _Thread_local struct state successors[SUCCESSOR_BATCH];
+static _Thread_local size_t successor_count;
+
+/* Prefetch the parts of the seen set that inserting the given states will
+ * read. This first fetches the bucket each state hashes to and then, once
+ * those have had a chance to arrive, the states already occupying them that
+ * set_insert_hashed() will compare against. Each state's set_hash() is
+ * returned in 'hashes' for the insertion to reuse.
+ */
+static void set_prefetch(struct state *NONNULL states, size_t count,
+    size_t *NONNULL hashes) {
+  assert(count <= SUCCESSOR_BATCH && "prefetching an oversized batch");
+
+  for (size_t i = 0; i < count; i++) {
+    hashes[i] = set_hash(&states[i]);
+  }
+
+  /* The bits of a bitstate search are spread across the set, so there is no
+   * single line to fetch.
+   */
+  if (BITSTATE_MB > 0) {
+    return;
+  }
+
+  /* Forming a tree compressed slot interns the state's nodes, which costs more
+   * than the cache misses prefetching would save.
+   */
+  if (TREE_COMPRESSION_MB > 0) {
+    return;
+  }
+
+  size_t index[SUCCESSOR_BATCH];
+  slot_t want[SUCCESSOR_BATCH];
+  for (size_t i = 0; i < count; i++) {
+    want[i] = state_to_slot(&states[i], hashes[i]);
+    index[i] = set_index(local_seen,
+      SLOTS_POINT_TO_STATES ? hashes[i] : slot_hash(want[i]));
+    __builtin_prefetch(&local_seen->bucket[index[i]]);
+  }
+
+  /* Fingerprints and inline states can be compared without looking further. */
+#if SLOTS_POINT_TO_STATES
+  for (size_t i = 0; i < count; i++) {
+    slot_t slot = __atomic_load_n(&local_seen->bucket[index[i]],
+      __ATOMIC_SEQ_CST);
+    if (!slot_is_empty(slot) && !slot_is_tombstone(slot)
+        && slot_tag(slot) == slot_tag(want[i])) {
+      __builtin_prefetch(slot_to_state(slot));
+    }
+  }
+#else
+  (void)want;
+#endif
+}
+
+/*******************************************************************************
+ * Partial order reduction                                                     *
+ *                                                                             *
+ * With `--partial-order-reduction`, a state is expanded by firing only the    *
+ * enabled rules of a stubborn set, rather than every enabled rule. The        *
+ * generator works out statically which parts of the state each rule reads and *
+ * writes. Two rule instances are dependent if one writes something the other  *
+ * accesses, and an instance may enable a disabled one if it writes something  *
+ * read by the disabled instance's first false guard conjunct. A stubborn set  *
+ * is closed under these relations, so the rules outside it cannot interfere   *
+ * with the ones inside before one of those fires. Elements of an array that   *
+ * are indexed by a ruleset parameter or a constant are tracked separately, so *
+ * instances of the same ruleset touching different elements are independent. *
+ *                                                                             *
+ * A rule is visible if it writes a variable read by a property, or contains   *
+ * an assert, assume, error or cover statement. A stubborn set may not contain *
+ * an enabled visible instance, so a reduced expansion only fires invisible    *
+ * rules and any enabled visible rules are deferred to a later state. If no    *
+ * such set is smaller than the enabled rules, every rule is fired.            *
+ *                                                                             *
+ * A deferred rule must not be ignored forever around a cycle of invisible     *
+ * rules. As a cycle proviso for breadth-first search, if any successor of a   *
+ * reduced expansion was already in the seen set, the rules that were left out *
+ * are fired too. So are they if stuttering deadlock detection is on and none  *
+ * of the rules fired changed the state.                                       *
+ ******************************************************************************/
+
+#if PARTIAL_ORDER_REDUCTION
+/* A condition under which two rule instances conflict. Parameter `a` of the
+ * first must equal parameter `b` of the second. If either of these is -1, the
+ * other parameter is instead compared with `value`.
+ */
+struct por_term {
+  int a;
+  int b;
+  value_t value;
+};
+
+/* The conditions under which instances of two rules conflict. A count of 0
+ * means they never do and SIZE_MAX means they always do.
+ */
+struct por_relation {
+  size_t count;
+  const struct por_term *terms;
+};
+
+/* What we know statically about a rule (`rule<N>`) and its instances. */
+struct por_group {
+  size_t base;      /* index of its first instance */
+  size_t count;     /* number of instances */
+  size_t conjuncts; /* number of top-level conjuncts in its guard */
+  bool visible;     /* could firing it be observed by a property? */
+
+  /* relation to each other rule, indexed by group */
+  const struct por_relation *depends;
+
+  /* relation of each other rule to each guard conjunct, indexed by conjunct *
+   * POR_GROUPS + group */
+  const struct por_relation *enables;
+};
+
+/* The model's rules, followed by a dummy entry. This is generated. */
+static const struct por_group POR_GROUP[POR_GROUPS + 1];
+
+/* Result of each rule instance's guard in the state being expanded. */
+static _Thread_local bool por_enabled[POR_INSTANCES];
+
+/* Index of the first false guard conjunct of each disabled rule instance, or
+ * SIZE_MAX if its guard triggered an error.
+ */
+static _Thread_local size_t por_blocker[POR_INSTANCES];
+
+/* Parameter values of each rule instance. This is given at least one column so
+ * that it is not a zero-length array in a model without quantified rules.
+ */
+static _Thread_local value_t
+  por_values[POR_INSTANCES][POR_QUANTIFIERS > 0 ? POR_QUANTIFIERS : 1];
+
+/* Rule instances to fire from the state being expanded. */
+static _Thread_local bool por_fire[POR_INSTANCES];
+
+/* Was any successor of the state being expanded already in the seen set? */
+static _Thread_local bool por_revisited;
+
+/* Number of states expanded with a reduced set of rules. As for rules_fired,
+ * there is a thread-local count and a global per-thread one for the summary.
+ */
+static _Thread_local uintmax_t por_reduced_local;
+static uintmax_t por_reduced[THREADS];
+
+/* Number of seed rule instances to try building a stubborn set from, per
+ * state.
+ */
+enum { POR_SEEDS = 8 };
+
+/* Evaluate the guard of every rule instance, filling por_enabled, por_blocker
+ * and por_values. This is generated.
+ */
+static void por_guards(const struct state *NONNULL s);
+
+static bool por_conflicts(const struct por_relation *NONNULL r,
+    const value_t *NONNULL a, const value_t *NONNULL b) {
+
+  if (r->count == SIZE_MAX) {
+    return true;
+  }
+
+  for (size_t i = 0; i < r->count; i++) {
+    const struct por_term *t = &r->terms[i];
+    value_t x = t->a == -1 ? t->value : a[t->a];
+    value_t y = t->b == -1 ? t->value : b[t->b];
+    if (x == y) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* Grow a stubborn set from the given enabled instance. Returns the number of
+ * enabled instances in it, or SIZE_MAX if this reached `limit` or the set would
+ * contain an enabled visible instance.
+ */
+static size_t por_closure(size_t seed_group, size_t seed, size_t limit,
+    bool *NONNULL member) {
+
+  static _Thread_local size_t pending[POR_INSTANCES];
+  static _Thread_local size_t pending_group[POR_INSTANCES];
+
+  memset(member, 0, sizeof(member[0]) * POR_INSTANCES);
+  member[seed] = true;
+  pending[0] = seed;
+  pending_group[0] = seed_group;
+  size_t pending_count = 1;
+  size_t enabled = 1;
+
+  while (pending_count > 0) {
+    pending_count--;
+    size_t t = pending[pending_count];
+    const struct por_group *g = &POR_GROUP[pending_group[pending_count]];
+
+    for (size_t c = 0; c < (por_enabled[t] ? 1 : g->conjuncts); c++) {
+
+      /* A guard that errored could be enabled by a write to any of its
+       * conjuncts. Otherwise only its first false one matters.
+       */
+      if (!por_enabled[t] && por_blocker[t] != SIZE_MAX && c != por_blocker[t]) {
+        continue;
+      }
+
+      for (size_t h = 0; h < POR_GROUPS; h++) {
+        const struct por_relation *r = por_enabled[t] ? &g->depends[h]
+          : &g->enables[c * POR_GROUPS + h];
+        if (r->count == 0) {
+          continue;
         }
 
-        unhazard(tail);
-        ends = old;
-        goto retry;
+        const struct por_group *gh = &POR_GROUP[h];
+        for (size_t u = gh->base; u < gh->base + gh->count; u++) {
+          if (member[u] || !por_conflicts(r, por_values[t], por_values[u])) {
+            continue;
+          }
+          if (por_enabled[u]) {
+            enabled++;
+            if (gh->visible || enabled >= limit) {
+              return SIZE_MAX;
+            }
+          }
+          member[u] = true;
+          pending[pending_count] = u;
+          pending_group[pending_count] = h;
+          pending_count++;
+        }
       }
     }
+  }
+
+  return enabled;
+}
 
-    /* Success! */
+/* Decide which rules to fire from the given state, recording this in por_fire.
+ * Returns true if this is fewer than all the enabled rules.
+ */
+static bool por_select(const struct state *NONNULL s) {
+
+  por_guards(s);
+  memcpy(por_fire, por_enabled, sizeof(por_fire));
 
-    unhazard(tail);
+  size_t enabled = 0;
+  for (size_t i = 0; i < POR_INSTANCES; i++) {
+    if (por_enabled[i]) {
+      enabled++;
+    }
   }
 
-  size_t count = __atomic_add_fetch(&q[queue_id].count, 1, __ATOMIC_SEQ_CST);
+  static _Thread_local bool member[POR_INSTANCES];
+  size_t best = enabled;
+  size_t seeds = 0;
 
-  TRACE(TC_QUEUE, "enqueued state %p into queue %zu, queue length is now %zu",
-    s, queue_id, count);
+  for (size_t g = 0; g < POR_GROUPS && seeds < POR_SEEDS && best > 1; g++) {
+    const struct por_group *group = &POR_GROUP[g];
+    if (group->visible) {
+      continue;
+    }
+    for (size_t i = group->base; i < group->base + group->count; i++) {
+      if (!por_enabled[i]) {
+        continue;
+      }
+      size_t n = por_closure(g, i, best, member);
+      if (n < best) {
+        best = n;
+        for (size_t j = 0; j < POR_INSTANCES; j++) {
+          por_fire[j] = member[j] && por_enabled[j];
+        }
+      }
+      seeds++;
+      if (seeds == POR_SEEDS || best == 1) {
+        break;
+      }
+    }
+  }
 
-  return count;
+  return best < enabled;
 }
 
-static const struct state *queue_dequeue(size_t *NONNULL queue_id) {
-  assert(queue_id != NULL && *queue_id < sizeof(q) / sizeof(q[0]) &&
-    "out of bounds queue access");
+/* Switch to firing the enabled rules that por_select() left out. */
+static void por_expand(void) {
+  for (size_t i = 0; i < POR_INSTANCES; i++) {
+    por_fire[i] = por_enabled[i] && !por_fire[i];
+  }
+}
+#endif
+
+/* Find an existing element in the set.
+ *
+ * Why would you ever want to do this? If you already have the state, why do you
+ * want to find a copy of it? The answer is for liveness information. When
+ * checking liveness properties, a duplicate of your current state that is
+ * already contained in the state set might know some of the liveness properties
+ * are satisfied that your current state considers unknown. The other answer is
+ * for counterexample replay, which needs the copy's record of its parent.
+ */
+#if SEEN_SET_RETAINS_STATES
+static __attribute__((unused)) const struct state *set_find(
+    const struct state *NONNULL s) {
 
-  const struct state *s = NULL;
+  assert(s != NULL);
+
+restart:;
 
-  for (size_t attempts = 0; attempts < sizeof(q) / sizeof(q[0]); attempts++) {
+  set_refresh();
 
-    double_ptr_t ends = atomic_read(&q[*queue_id].ends);
+  size_t hash = state_hash(s);
+  size_t index = set_index(local_seen, hash);
+  slot_t want = state_to_slot(s, hash);
 
-retry:;
-    queue_handle_t head = double_ptr_extract1(ends);
+  /* Replay runs while exploration continues, so the set may be mid-migration.
+   * Make sure any copy of this state has been carried over, as in set_insert().
+   */
+  struct set *previous = __atomic_load_n(&local_seen->previous,
+    __ATOMIC_SEQ_CST);
+  if (previous != NULL) {
+    set_migrate_range(local_seen, previous, hash);
+  }
+
+  size_t attempts = 0;
+  for (size_t i = index; attempts < set_size(local_seen); i = set_index(local_seen, i + 1)) {
 
-    if (head != 0) {
-      /* This queue is non-empty. */
+    slot_t slot = __atomic_load_n(&local_seen->bucket[i], __ATOMIC_SEQ_CST);
 
-      /* Try to protect our upcoming accesses to the head. */
-      hazard(head);
-      {
-        double_ptr_t ends_check = atomic_read(&q[*queue_id].ends);
-        if (ends != ends_check) {
-          /* Failed. Someone else updated the queue. */
-          unhazard(head);
-          ends = ends_check;
-          goto retry;
+    if (slot_is_tombstone(slot)) {
+      /* This set has itself been migrated. Retry on its successor. */
+      goto restart;
+    }
+
+    if (slot_is_empty(slot)) {
+      /* reached the end of the linear block in which this state could lie */
+      break;
+    }
+
+    if (slot_tag(slot) != slot_tag(want)) {
+      /* differing hashes, so this cannot be our state */
+      attempts++;
+      continue;
+    }
+
+    const struct state *n = slot_to_state(slot);
+    ASSERT(n != NULL && "null pointer stored in state set");
+
+    if (state_eq(s, n)) {
+      /* found */
+      return n;
+    }
+
+    attempts++;
+  }
+
+  /* not found */
+  return NULL;
+}
+#endif
+
+/******************************************************************************/
+
+/*******************************************************************************
+ * Multi-process exploration                                                   *
+ *                                                                             *
+ * With `--processes`, the state space is partitioned among several processes  *
+ * by state hash. Each process keeps the seen set and queue for the states it  *
+ * owns, and sends successors owned by another process to that process in      *
+ * batches over a UNIX domain socket. Process 0 detects termination using      *
+ * Safra's algorithm, passing a token around the ring of processes, and then   *
+ * collects the others' counts to report.                                      *
+ ******************************************************************************/
+
+#if PROCESSES > 1
+enum {
+  MSG_STATES,    /* a batch of states owned by the receiver */
+  MSG_TOKEN,     /* the termination detection token */
+  MSG_TERMINATE, /* exploration is complete */
+  MSG_ABORT,     /* the sender found an error, so exploration should stop */
+  MSG_STATS,     /* the sender's final counts, sent to process 0 */
+};
+
+struct dist_msg {
+  uint32_t type;
+  uint32_t count;   /* number of states following a MSG_STATES */
+  int64_t balance;  /* message balance accumulated by a MSG_TOKEN */
+  uint64_t black;   /* whether a MSG_TOKEN has been tainted */
+};
+
+struct dist_stats {
+  uint64_t states;
+  uint64_t rules_fired;
+  uint64_t errors;
+  uintmax_t covers[sizeof(covers) / sizeof(covers[0])];
+};
+
+/* Number of states to send to another process at once. */
+enum { DIST_BATCH = 256 };
+
+struct dist_buffer {
+  unsigned char *data;
+  size_t size;
+  size_t capacity;
+};
+
+static struct {
+  int fd;                        /* -1 if the peer has gone away */
+  struct dist_buffer out;        /* bytes waiting to be sent */
+  size_t out_offset;             /* how much of 'out' has been sent */
+  struct dist_buffer in;         /* bytes received but not yet handled */
+  struct state batch[DIST_BATCH];
+  size_t batch_count;
+} peers[PROCESSES];
+
+/* State for Safra's termination detection. 'dist_balance' counts batches of
+ * states sent minus those received, and a process is 'dist_black' if it has
+ * received states since it last passed on the token.
+ */
+static int64_t dist_balance;
+static bool dist_black;
+static bool dist_token_held;
+static int64_t dist_token_balance;
+static bool dist_token_black;
+static bool dist_token_out;
+
+/* Has exploration finished, one way or another? */
+static bool dist_done;
+
+/* Number of the other processes' counts that process 0 has received. */
+static size_t dist_stats_received;
+
+/* Defined in the generated code. */
+static bool check_covers(const struct state *NONNULL s);
+
+static void dist_append(struct dist_buffer *NONNULL b, const void *NONNULL p,
+    size_t size) {
+  if (b->size + size > b->capacity) {
+    b->capacity = b->capacity == 0 ? 4096 : b->capacity;
+    while (b->size + size > b->capacity) {
+      b->capacity *= 2;
+    }
+    b->data = realloc(b->data, b->capacity);
+    if (__builtin_expect(b->data == NULL, 0)) {
+      oom();
+    }
+  }
+  memcpy(b->data + b->size, p, size);
+  b->size += size;
+}
+
+static void dist_send(size_t peer, struct dist_msg msg,
+    const void *NONNULL payload, size_t size) {
+  if (peers[peer].fd < 0) {
+    return;
+  }
+  dist_append(&peers[peer].out, &msg, sizeof(msg));
+  if (size > 0) {
+    dist_append(&peers[peer].out, payload, size);
+  }
+}
+
+static void dist_broadcast(uint32_t type) {
+  for (size_t i = 0; i < PROCESSES; i++) {
+    if (i != process_id) {
+      dist_send(i, (struct dist_msg){ .type = type }, &type, 0);
+    }
+  }
+}
+
+static void dist_flush_batch(size_t peer) {
+  if (peers[peer].batch_count == 0) {
+    return;
+  }
+  struct dist_msg msg = { .type = MSG_STATES,
+    .count = (uint32_t)peers[peer].batch_count };
+  dist_send(peer, msg, peers[peer].batch,
+    peers[peer].batch_count * sizeof(peers[peer].batch[0]));
+  peers[peer].batch_count = 0;
+  dist_balance++;
+}
+
+/* Which process owns the given state? This uses the upper bits of a 64-bit
+ * hash of the state, as the lower bits select its slot in the owner's seen set.
+ * We cannot use state_hash(), as it is only as wide as a size_t.
+ */
+static size_t dist_owner(const struct state *NONNULL s) {
+#if INCREMENTAL_HASH
+  uint64_t h = s->zobrist;
+#else
+  uint64_t h = MurmurHash64A(s->data, sizeof(s->data));
+#endif
+  return (size_t)(((h >> 32) * PROCESSES) >> 32);
+}
+
+/* Send a state to the process that owns it. */
+static void dist_forward(size_t owner, const struct state *NONNULL s) {
+  memcpy(&peers[owner].batch[peers[owner].batch_count], s, sizeof(*s));
+  peers[owner].batch_count++;
+  if (peers[owner].batch_count == DIST_BATCH) {
+    dist_flush_batch(owner);
+  }
+}
+
+/* Send and receive whatever we can, waiting up to 'timeout' milliseconds (or
+ * indefinitely if -1) for something to happen.
+ */
+static void dist_pump(int timeout) {
+
+  struct pollfd fds[PROCESSES];
+  nfds_t count = 0;
+  for (size_t i = 0; i < PROCESSES; i++) {
+    if (i == process_id || peers[i].fd < 0) {
+      continue;
+    }
+    fds[count] = (struct pollfd){ .fd = peers[i].fd, .events = POLLIN };
+    if (peers[i].out_offset < peers[i].out.size) {
+      fds[count].events |= POLLOUT;
+    }
+    count++;
+  }
+  if (count == 0) {
+    return;
+  }
+
+  if (poll(fds, count, timeout) < 0) {
+    if (errno == EINTR) {
+      return;
+    }
+    perror("poll");
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0, j = 0; i < PROCESSES; i++) {
+    if (i == process_id || peers[i].fd < 0) {
+      continue;
+    }
+    short revents = fds[j].revents;
+    j++;
+
+    if (revents & POLLOUT) {
+      ssize_t r = write(peers[i].fd, peers[i].out.data + peers[i].out_offset,
+        peers[i].out.size - peers[i].out_offset);
+      if (r > 0) {
+        peers[i].out_offset += (size_t)r;
+        if (peers[i].out_offset == peers[i].out.size) {
+          peers[i].out.size = 0;
+          peers[i].out_offset = 0;
         }
+      } else if (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK
+          && errno != EINTR) {
+        /* The peer has exited. Drop what we were sending it, but leave the
+         * socket open until we have read what it sent before exiting.
+         */
+        peers[i].out.size = 0;
+        peers[i].out_offset = 0;
+      }
+    }
+
+    if (revents & (POLLIN | POLLHUP | POLLERR)) {
+      unsigned char buffer[65536];
+      ssize_t r = read(peers[i].fd, buffer, sizeof(buffer));
+      if (r > 0) {
+        dist_append(&peers[i].in, buffer, (size_t)r);
+      } else if (r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK
+          && errno != EINTR)) {
+        (void)close(peers[i].fd);
+        peers[i].fd = -1;
+      }
+    }
+  }
+}
+
+/* Add states sent to us by another process to our seen set and queue. */
+static void dist_receive(const struct state *NONNULL states, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    struct state *s = state_new();
+    memcpy(s, &states[i], sizeof(*s));
+    size_t size;
+    if (set_insert(s, &size)) {
+      if (!check_covers(s)) {
+        /* one of the cover properties triggered an error */
+        continue;
+      }
+#if BOUND > 0
+      if (state_bound_get(s) >= BOUND) {
+        continue;
+      }
+#endif
+      (void)queue_enqueue(s, 0);
+    } else {
+      state_free(s);
+    }
+  }
+}
+
+static void dist_handle(const struct dist_msg *NONNULL msg,
+    const unsigned char *NONNULL payload) {
+
+  switch (msg->type) {
+
+    case MSG_STATES:
+      dist_balance--;
+      dist_black = true;
+      if (!dist_done) {
+        dist_receive((const struct state*)payload, msg->count);
+      }
+      break;
+
+    case MSG_TOKEN:
+      dist_token_held = true;
+      dist_token_balance = msg->balance;
+      dist_token_black = msg->black != 0;
+      break;
+
+    case MSG_TERMINATE:
+    case MSG_ABORT:
+      dist_done = true;
+      break;
+
+    case MSG_STATS: {
+      assert(process_id == 0 && "counts sent to a process other than 0");
+      const struct dist_stats *stats = (const struct dist_stats*)payload;
+      seen_count += stats->states;
+      rules_fired[0] += stats->rules_fired;
+      error_count += stats->errors;
+#ifdef __clang__
+  #pragma clang diagnostic push
+  #pragma clang diagnostic ignored "-Wtautological-compare"
+  #pragma clang diagnostic ignored "-Wtautological-unsigned-zero-compare"
+#elif defined(__GNUC__)
+  #pragma GCC diagnostic push
+  #pragma GCC diagnostic ignored "-Wtype-limits"
+#endif
+      for (size_t i = 0; i < sizeof(covers) / sizeof(covers[0]); i++) {
+#ifdef __clang__
+  #pragma clang diagnostic pop
+#elif defined(__GNUC__)
+  #pragma GCC diagnostic pop
+#endif
+        covers[i] += stats->covers[i];
+      }
+      dist_stats_received++;
+      break;
+    }
+
+  }
+}
+
+/* Act on every complete message we have received. */
+static void dist_process(void) {
+  for (size_t i = 0; i < PROCESSES; i++) {
+    struct dist_buffer *in = &peers[i].in;
+    size_t offset = 0;
+    for (;;) {
+      struct dist_msg msg;
+      if (in->size - offset < sizeof(msg)) {
+        break;
+      }
+      memcpy(&msg, in->data + offset, sizeof(msg));
+      size_t size = msg.type == MSG_STATES ? msg.count * sizeof(struct state)
+                  : msg.type == MSG_STATS ? sizeof(struct dist_stats)
+                  : 0;
+      if (in->size - offset - sizeof(msg) < size) {
+        break;
+      }
+
+      /* Copy the payload out so its states are suitably aligned. */
+      unsigned char *payload = xmalloc(size + 1);
+      memcpy(payload, in->data + offset + sizeof(msg), size);
+      offset += sizeof(msg) + size;
+      dist_handle(&msg, payload);
+      free(payload);
+    }
+    if (offset > 0) {
+      memmove(in->data, in->data + offset, in->size - offset);
+      in->size -= offset;
+    }
+  }
+}
+
+/* Called when our queue is empty, to move the termination detection along. */
+static void dist_idle(void) {
+
+  for (size_t i = 0; i < PROCESSES; i++) {
+    dist_flush_batch(i);
+  }
+
+  if (process_id == 0) {
+    if (dist_token_held) {
+      dist_token_held = false;
+      dist_token_out = false;
+      if (!dist_token_black && !dist_black
+          && dist_token_balance + dist_balance == 0) {
+        dist_broadcast(MSG_TERMINATE);
+        dist_done = true;
+        return;
+      }
+    }
+    if (!dist_token_out) {
+      /* Start a new round. */
+      dist_black = false;
+      dist_send(1, (struct dist_msg){ .type = MSG_TOKEN }, &dist_balance, 0);
+      dist_token_out = true;
+    }
+
+  } else if (dist_token_held) {
+    struct dist_msg msg = { .type = MSG_TOKEN,
+      .balance = dist_token_balance + dist_balance,
+      .black = dist_token_black || dist_black };
+    dist_send((process_id + 1) % PROCESSES, msg, &msg, 0);
+    dist_token_held = false;
+    dist_black = false;
+  }
+}
+
+/* Called before taking a state from the queue, to exchange states with the
+ * other processes. Returns false when exploration is over.
+ */
+static bool dist_wait(void) {
+
+  static unsigned countdown;
+
+  if (queue_size(0) > 0 && !dist_done) {
+    /* Periodically check for incoming states while we are busy. */
+    if (countdown > 0) {
+      countdown--;
+      return true;
+    }
+    countdown = 1024;
+    for (size_t i = 0; i < PROCESSES; i++) {
+      dist_flush_batch(i);
+    }
+    dist_pump(0);
+    dist_process();
+    return !dist_done;
+  }
+
+  for (;;) {
+    dist_process();
+    if (dist_done) {
+      return false;
+    }
+    if (queue_size(0) > 0) {
+      return true;
+    }
+    dist_idle();
+    if (dist_done) {
+      return false;
+    }
+    dist_pump(-1);
+  }
+}
+
+/* Send everything we still have queued up, as we are about to exit. */
+static void dist_drain(void) {
+  for (;;) {
+    bool pending = false;
+    for (size_t i = 0; i < PROCESSES; i++) {
+      if (peers[i].fd >= 0 && peers[i].out_offset < peers[i].out.size) {
+        pending = true;
       }
+    }
+    if (!pending) {
+      return;
+    }
+    dist_pump(-1);
+  }
+}
 
-      queue_handle_t tail = double_ptr_extract2(ends);
+/* Report our counts to process 0 and exit. */
+static _Noreturn void dist_report(int status) {
 
-      double_ptr_t new;
-      if (head == tail) {
-        /* There is only a single element in the queue. We will need to update
-         * both head and tail.
-         */
-        new = double_ptr_make(0, 0);
-      } else if (queue_handle_is_state_pptr(head)) {
-        /* There are multiple elements in the queue; we can deal only with the
-         * head.
-         */
-        new = double_ptr_make(queue_handle_next(head), tail);
-      } else {
-        /* The head of the queue is the end of a queue node. I.e. the only thing
-         * remaining in this queue node is the chained pointer to the next queue
-         * node.
-         */
+  if (status != EXIT_SUCCESS) {
+    dist_broadcast(MSG_ABORT);
+  }
 
-        /* Load the next queue node. */
-        struct queue_node **n = queue_handle_to_node_pptr(head);
-        struct queue_node *new_head = __atomic_load_n(n, __ATOMIC_SEQ_CST);
-        new = double_ptr_make(queue_handle_from_node_ptr(new_head), tail);
+  struct dist_stats stats = { .states = seen_count,
+    .rules_fired = rules_fired[0], .errors = error_count };
+  memcpy(stats.covers, covers, sizeof(covers));
+  dist_send(0, (struct dist_msg){ .type = MSG_STATS }, &stats, sizeof(stats));
 
-        /* Try to replace the current head with the next node. */
-        double_ptr_t old = atomic_cas_val(&q[*queue_id].ends, ends, new);
-        /* Either way, now we'll need to retry, but if we succeeded we also need
-         * to free the queue node we just removed.
-         */
-        unhazard(head);
-        if (old == ends) {
-          /* Succeeded. */
-          reclaim(head);
-        }
-        ends = old;
-        goto retry;
-      }
+  dist_drain();
+  exit(status);
+}
 
-      /* Try to remove the head. */
-      {
-        double_ptr_t old = atomic_cas_val(&q[*queue_id].ends, ends, new);
-        if (old != ends) {
-          /* Failed. Someone else either enqueued or dequeued. */
-          unhazard(head);
-          ends = old;
-          goto retry;
-        }
-      }
+/* Collect the counts of the other processes and wait for them to exit. */
+static int dist_gather(int status) {
 
-      /* We now have either a pointer to a state or we've just removed an empty
-       * queue node that was the last in the queue.
-       */
+  if (status != EXIT_SUCCESS) {
+    dist_broadcast(MSG_ABORT);
+  }
 
-      if (queue_handle_is_state_pptr(head)) {
-        struct state **st = queue_handle_to_state_pptr(head);
-        s = *st;
+  for (;;) {
+    bool open = false;
+    for (size_t i = 1; i < PROCESSES; i++) {
+      if (peers[i].fd >= 0) {
+        open = true;
       }
+    }
+    dist_process();
+    if (dist_stats_received == PROCESSES - 1 || !open) {
+      break;
+    }
+    dist_pump(-1);
+  }
 
-      unhazard(head);
+  for (size_t i = 1; i < PROCESSES; i++) {
+    int child_status;
+    if (wait(&child_status) < 0 || !WIFEXITED(child_status)
+        || WEXITSTATUS(child_status) != EXIT_SUCCESS) {
+      status = EXIT_FAILURE;
+    }
+  }
 
-      if (head == tail || !queue_handle_is_state_pptr(head)) {
-        reclaim(head);
-      }
+  return status;
+}
 
-      if (s == NULL) {
-        /* Move to the next queue to try. */
-        *queue_id = (*queue_id + 1) % (sizeof(q) / sizeof(q[0]));
-        continue;
+/* Start the other processes, connected to each other and us by sockets. This
+ * must be done before entering the sandbox.
+ */
+static void dist_init(void) {
+
+  int fds[PROCESSES][PROCESSES];
+  for (size_t i = 0; i < PROCESSES; i++) {
+    fds[i][i] = -1;
+    for (size_t j = i + 1; j < PROCESSES; j++) {
+      int pair[2];
+      if (__builtin_expect(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0,
+          0)) {
+        perror("socketpair");
+        exit(EXIT_FAILURE);
       }
+      fds[i][j] = pair[0];
+      fds[j][i] = pair[1];
+    }
+  }
 
-      size_t count = __atomic_sub_fetch(&q[*queue_id].count, 1,
-        __ATOMIC_SEQ_CST);
+  /* Writing to a process that has already exited should not kill us. */
+  signal(SIGPIPE, SIG_IGN);
 
-      TRACE(TC_QUEUE, "dequeued state %p from queue %zu, queue length is now "
-        "%zu", s, *queue_id, count);
+  /* Do not let the children inherit anything we have yet to print. */
+  fflush(stdout);
 
-      return s;
+  for (size_t i = 1; i < PROCESSES; i++) {
+    pid_t pid = fork();
+    if (__builtin_expect(pid < 0, 0)) {
+      perror("fork");
+      exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+      process_id = i;
+      break;
     }
-
-    /* Move to the next queue to try. */
-    *queue_id = (*queue_id + 1) % (sizeof(q) / sizeof(q[0]));
   }
 
-  return s;
+  for (size_t i = 0; i < PROCESSES; i++) {
+    for (size_t j = 0; j < PROCESSES; j++) {
+      if (i != process_id && fds[i][j] >= 0) {
+        (void)close(fds[i][j]);
+      }
+    }
+    peers[i].fd = fds[process_id][i];
+    if (peers[i].fd >= 0) {
+      int flags = fcntl(peers[i].fd, F_GETFL);
+      if (__builtin_expect(flags < 0 ||
+          fcntl(peers[i].fd, F_SETFL, flags | O_NONBLOCK) < 0, 0)) {
+        perror("fcntl");
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
 }
+#endif
 
 /******************************************************************************/
 
 /*******************************************************************************
- * Reference counted pointers                                                  *
- *                                                                             *
- * These are capable of encapsulating any generic pointer (void*). Note that   *
- * we rely on the existence of double-word atomics. On x86-64, you need to     *
- * use compiler flag '-mcx16' to get an efficient 128-bit cmpxchg.             *
- *                                                                             *
- * Of these functions, only the following are thread safe:                     *
- *                                                                             *
- *   * refcounted_ptr_get                                                      *
- *   * refcounted_ptr_peek                                                     *
- *   * refcounted_ptr_put                                                      *
- *   * refcounted_ptr_set                                                      *
- *                                                                             *
- * The caller is expected to coordinate with other threads to exclude them     *
- * operating on the relevant refcounted_ptr_t when using one of the other      *
- * functions:                                                                  *
- *                                                                             *
- *   * refcounted_ptr_shift                                                    *
+ * Checkpointing                                                               *
  *                                                                             *
+ * With `--checkpoint`, the seen set, the pending queues and the run's         *
+ * counters are periodically written to a file, from which a checker generated *
+ * with `--resume` can later continue. A checkpoint is taken by the leader of  *
+ * a rendezvous, when no other thread is touching the set or the queues.       *
  ******************************************************************************/
 
-struct refcounted_ptr {
-  void *ptr;
-  size_t count;
+#if CHECKPOINT || RESUME
+/* Layout of a checkpoint file. The header is followed by the cover counts, the
+ * slot of each state in the seen set, the states themselves and then the slots
+ * of the states pending expansion. Pointers to previous states are stored as
+ * slot indices plus one, with zero representing NULL.
+ */
+struct checkpoint_header {
+  char magic[8];
+  uint64_t model_id;
+  uint64_t state_size;
+  uint64_t cover_count;
+  uint64_t set_size_exponent;
+  uint64_t state_count;
+  uint64_t queue_count;
+  uint64_t rules_fired;
+  uint64_t error_count;
 };
 
-#if __SIZEOF_POINTER__ <= 4
-  typedef uint64_t refcounted_ptr_t;
-#elif __SIZEOF_POINTER__ <= 8
-  typedef unsigned __int128 refcounted_ptr_t;
-#else
-  #error "unexpected pointer size; what scalar type to use for refcounted_ptr_t?"
+/* Written last, so that a checkpoint interrupted part way through is never
+ * mistaken for a complete one.
+ */
+static const char CHECKPOINT_MAGIC[8] = "rumurckp";
 #endif
 
-_Static_assert(sizeof(struct refcounted_ptr) <= sizeof(refcounted_ptr_t),
-  "refcounted_ptr does not fit in a refcounted_ptr_t, which we need to operate "
-  "on it atomically");
+#if CHECKPOINT
+static FILE *checkpoint_file;
 
-static void refcounted_ptr_set(refcounted_ptr_t *NONNULL p, void *ptr) {
+/* When the next checkpoint should be taken. */
+static time_t checkpoint_due;
 
-#ifndef NDEBUG
-  /* Read the current state of the pointer. */
-  refcounted_ptr_t old = atomic_read(p);
-  struct refcounted_ptr p2;
-  memcpy(&p2, &old, sizeof(old));
-  assert(p2.count == 0 && "overwriting a pointer source while someone still "
-    "has a reference to this pointer");
-#endif
+/* Whether a thread has asked for a checkpoint to be taken. */
+static bool checkpoint_pending;
 
-  /* Set the current source pointer with no outstanding references. */
-  struct refcounted_ptr p3;
-  p3.ptr = ptr;
-  p3.count = 0;
+/* The state each thread is expanding and its count of rules fired before it
+ * started on this state. A checkpoint taken mid-expansion will return the
+ * state to the queue, to be expanded again in full on resumption.
+ */
+static const struct state *checkpoint_expanding[THREADS];
+static uintmax_t checkpoint_rules_fired[THREADS];
 
-  /* Commit the result. */
-  refcounted_ptr_t new;
-  memcpy(&new, &p3, sizeof(p3));
-  atomic_write(p, new);
-}
+/* Number of states to expand before next looking at the clock. */
+static _Thread_local unsigned checkpoint_countdown;
 
-static void *refcounted_ptr_get(refcounted_ptr_t *NONNULL p) {
+static void checkpoint_write(const void *NONNULL p, size_t size) {
+  if (size > 0 && __builtin_expect(fwrite(p, size, 1, checkpoint_file) != 1,
+      0)) {
+    fprintf(stderr, "failed to write checkpoint %s: %s\n", CHECKPOINT_PATH,
+      strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+}
 
-  refcounted_ptr_t old, new;
-  void *ret;
-  bool r;
+/* Flush what we have written through to disk. */
+static void checkpoint_sync(void) {
+  if (__builtin_expect(fflush(checkpoint_file) != 0 ||
+      fsync(fileno(checkpoint_file)) != 0, 0)) {
+    fprintf(stderr, "failed to write checkpoint %s: %s\n", CHECKPOINT_PATH,
+      strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+}
 
-  do {
+/* Find the slot in the seen set that holds the given state. */
+static size_t checkpoint_slot(const struct state *NONNULL s) {
+  for (size_t i = set_index(local_seen, state_hash(s)); ;
+       i = set_index(local_seen, i + 1)) {
+    slot_t slot = local_seen->bucket[i];
+    ASSERT(!slot_is_empty(slot) && "checkpointed state not found in seen set");
+    if (slot_to_state(slot) == s) {
+      return i;
+    }
+  }
+}
 
-    /* Read the current state of the pointer. */
-    old = atomic_read(p);
-    struct refcounted_ptr p2;
-    memcpy(&p2, &old, sizeof(old));
+static void checkpoint_write_slot(const struct state *NONNULL s) {
+  uint64_t slot = checkpoint_slot(s);
+  checkpoint_write(&slot, sizeof(slot));
+}
 
-    /* Take a reference to it. */
-    p2.count++;
-    ret = p2.ptr;
+/* Write a checkpoint. This is run by the leader of a rendezvous. */
+static void checkpoint_take(void) {
 
-    /* Try to commit our results. */
-    memcpy(&new, &p2, sizeof(new));
-    r = atomic_cas(p, old, new);
-  } while (!r);
+  /* If a thread opting out of the rendezvous protocol was the last to arrive,
+   * it will have released the others without taking the checkpoint and the
+   * checkpoint is still pending.
+   */
+  ASSERT(__atomic_load_n(&checkpoint_pending, __ATOMIC_SEQ_CST)
+    && "checkpoint taken without being requested");
 
-  return ret;
-}
+  /* Our own pointer to the seen set may be stale, if another thread expanded
+   * it since we last inserted into it. No migration is in progress, so the
+   * current set holds everything.
+   */
+  local_seen = __atomic_load_n(&current_seen, __ATOMIC_SEQ_CST);
+  ASSERT(local_seen->previous == NULL
+    && "checkpoint taken while the seen set is being migrated");
+
+  struct checkpoint_header header = {
+    .model_id = MODEL_ID,
+    .state_size = sizeof(struct state),
+    .cover_count = sizeof(covers) / sizeof(covers[0]),
+    .set_size_exponent = local_seen->size_exponent,
+    .state_count = seen_count,
+    .error_count = error_count,
+  };
+  for (size_t i = 0; i < THREADS; i++) {
+    header.queue_count += queue_size(i);
+    if (checkpoint_expanding[i] != NULL) {
+      header.queue_count++;
+    }
+    header.rules_fired += checkpoint_rules_fired[i];
+  }
 
-static void refcounted_ptr_put(refcounted_ptr_t *NONNULL p,
-  void *ptr __attribute__((unused))) {
+  /* Overwrite the magic of any previous checkpoint before we start replacing
+   * its contents.
+   */
+  rewind(checkpoint_file);
+  checkpoint_write(&header, sizeof(header));
+  checkpoint_sync();
 
-  refcounted_ptr_t old, new;
-  bool r;
+  checkpoint_write(covers, sizeof(covers));
 
-  do {
+  for (size_t i = 0; i < set_size(local_seen); i++) {
+    if (!slot_is_empty(local_seen->bucket[i])) {
+      uint64_t slot = i;
+      checkpoint_write(&slot, sizeof(slot));
+    }
+  }
 
-    /* Read the current state of the pointer. */
-    old = atomic_read(p);
-    struct refcounted_ptr p2;
-    memcpy(&p2, &old, sizeof(old));
+  for (size_t i = 0; i < set_size(local_seen); i++) {
+    slot_t slot = local_seen->bucket[i];
+    if (slot_is_empty(slot)) {
+      continue;
+    }
+    struct state s;
+    memcpy(&s, slot_to_state(slot), sizeof(s));
+#if STATE_PREVIOUS
+    const struct state *previous = state_previous_get(&s);
+    state_previous_set(&s, previous == NULL ? NULL
+      : (const struct state*)(uintptr_t)(checkpoint_slot(previous) + 1));
+#endif
+    checkpoint_write(&s, sizeof(s));
+  }
 
-    /* Release our reference to it. */
-    ASSERT(p2.ptr == ptr && "releasing a reference to a pointer after someone "
-      "has changed the pointer source");
-    ASSERT(p2.count > 0 && "releasing a reference to a pointer when it had no "
-      "outstanding references");
-    p2.count--;
+  /* The queues are quiescent, so we can read them directly. */
+  for (size_t i = 0; i < THREADS; i++) {
+    for (size_t j = q[i].top; j != q[i].bottom; j++) {
+      checkpoint_write_slot(q[i].array->s[j & (q[i].array->capacity - 1)]);
+    }
+    if (checkpoint_expanding[i] != NULL) {
+      checkpoint_write_slot(checkpoint_expanding[i]);
+    }
+  }
 
-    /* Try to commit our results. */
-    memcpy(&new, &p2, sizeof(new));
-    r = atomic_cas(p, old, new);
-  } while (!r);
-}
+  /* Discard anything left over from a previous, larger, checkpoint and then
+   * mark this one complete.
+   */
+  if (__builtin_expect(fflush(checkpoint_file) != 0 ||
+      ftruncate(fileno(checkpoint_file), ftello(checkpoint_file)) != 0, 0)) {
+    fprintf(stderr, "failed to write checkpoint %s: %s\n", CHECKPOINT_PATH,
+      strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  checkpoint_sync();
+  rewind(checkpoint_file);
+  checkpoint_write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+  checkpoint_sync();
 
-static void *refcounted_ptr_peek(refcounted_ptr_t *NONNULL p) {
+  if (!MACHINE_READABLE_OUTPUT) {
+    flockfile(stdout);
+    put("\t checkpointed ");
+    put_uint(header.state_count);
+    put(" states to " CHECKPOINT_PATH "\n");
+    funlockfile(stdout);
+  }
 
-  /* Read out the state of the pointer. This rather unpleasant expression is
-   * designed to emit an atomic load at a smaller granularity than the entire
-   * refcounted_ptr structure. Because we only need the pointer -- and not the
-   * count -- we can afford to just atomically read the first word.
-   */
-  void *ptr = __atomic_load_n(
-    (void**)((void*)p + __builtin_offsetof(struct refcounted_ptr, ptr)),
+  __atomic_store_n(&checkpoint_due, time(NULL) + CHECKPOINT_EVERY,
     __ATOMIC_SEQ_CST);
+  __atomic_store_n(&checkpoint_pending, false, __ATOMIC_SEQ_CST);
+}
 
-  return ptr;
+static bool checkpoint_is_pending(void) {
+  return __atomic_load_n(&checkpoint_pending, __ATOMIC_SEQ_CST);
 }
 
-static void refcounted_ptr_shift(refcounted_ptr_t *NONNULL current,
-    refcounted_ptr_t *NONNULL next) {
+/* Participate in a checkpoint, if one has been requested. */
+static void checkpoint_join(void) {
+  while (checkpoint_is_pending()) {
+    rendezvous(checkpoint_take);
+  }
+}
 
-  /* None of the operations in this function are performed atomically because we
-   * assume the caller has synchronised with other threads via other means.
-   */
+/* Called before expanding each state, to take a checkpoint if one is due. */
+static void checkpoint_poll(const struct state *NONNULL s) {
 
-  /* The pointer we're about to overwrite should not be referenced. */
-  struct refcounted_ptr p __attribute__((unused));
-  memcpy(&p, current, sizeof(*current));
-  ASSERT(p.count == 0 && "overwriting a pointer that still has outstanding "
-    "references");
+  checkpoint_expanding[thread_id] = s;
+  checkpoint_rules_fired[thread_id] = rules_fired_local;
 
-  /* Shift the next value into the current pointer. */
-  *current = *next;
+  if (checkpoint_countdown > 0) {
+    checkpoint_countdown--;
+  } else {
+    checkpoint_countdown = 1024;
+    if (time(NULL) >= __atomic_load_n(&checkpoint_due, __ATOMIC_SEQ_CST)) {
+      /* Request a checkpoint, unless the seen set is being migrated. In that
+       * case we will try again later.
+       */
+      set_expand_lock();
+      if (__atomic_load_n(&current_seen, __ATOMIC_SEQ_CST)->previous == NULL) {
+        __atomic_store_n(&checkpoint_pending, true, __ATOMIC_SEQ_CST);
+      }
+      set_expand_unlock();
+    }
+  }
 
-  /* Blank the value we just shifted over. */
-  *next = 0;
+  checkpoint_join();
 }
+#endif
 
-/******************************************************************************/
+#if RESUME
+static FILE *resume_file;
 
-/*******************************************************************************
- * Thread rendezvous support                                                   *
- ******************************************************************************/
+static void resume_read(void *NONNULL p, size_t size) {
+  if (size > 0 && __builtin_expect(fread(p, size, 1, resume_file) != 1, 0)) {
+    fprintf(stderr, "failed to read checkpoint %s: %s\n", RESUME_PATH,
+      ferror(resume_file) ? strerror(errno) : "file is truncated");
+    exit(EXIT_FAILURE);
+  }
+}
 
-static pthread_mutex_t rendezvous_lock; /* mutual exclusion mechanism for below. */
-static pthread_cond_t rendezvous_cond;  /* sleep mechanism for below. */
-static size_t running_count = 1;            /* how many threads are opted in to rendezvous? */
-static size_t rendezvous_pending = 1;   /* how many threads are opted in and not sleeping? */
+/* Restore the seen set, pending queue and counters from a checkpoint, in place
+ * of running the start states. Returns the number of states queued.
+ */
+static size_t resume(void) {
 
-static void rendezvous_init(void) {
-  int r = pthread_mutex_init(&rendezvous_lock, NULL);
-  if (__builtin_expect(r != 0, 0)) {
-    fprintf(stderr, "pthread_mutex_init failed: %s\n", strerror(r));
+  struct checkpoint_header header;
+  resume_read(&header, sizeof(header));
+
+  if (memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0) {
+    fprintf(stderr, "%s is not a complete checkpoint\n", RESUME_PATH);
     exit(EXIT_FAILURE);
   }
-
-  r = pthread_cond_init(&rendezvous_cond, NULL);
-  if (__builtin_expect(r != 0, 0)) {
-    fprintf(stderr, "pthread_cond_init failed: %s\n", strerror(r));
+  if (header.model_id != MODEL_ID || header.state_size != sizeof(struct state)
+      || header.cover_count != sizeof(covers) / sizeof(covers[0])) {
+    fprintf(stderr, "%s is a checkpoint of a different model\n", RESUME_PATH);
     exit(EXIT_FAILURE);
   }
-}
-
-/* Call this at the start of a rendezvous point.
- *
- * This is a low level function, not expected to be directly used outside of the
- * context of the rendezvous implementation.
- *
- * @return True if the caller was the last to arrive and henceforth dubbed the
- *   'leader'.
- */
-static bool rendezvous_arrive(void) {
-  int r __attribute__((unused)) = pthread_mutex_lock(&rendezvous_lock);
-  assert(r == 0);
 
-  /* Take a token from the rendezvous down-counter. */
-  assert(rendezvous_pending > 0);
-  rendezvous_pending--;
+  resume_read(covers, sizeof(covers));
 
-  /* If we were the last to arrive then it was our arrival that dropped the
-   * counter to zero.
+  /* Replace the initial seen set with one the same size as the one that was
+   * checkpointed, so each state can go back into the slot it came from without
+   * needing to be rehashed.
    */
-  return rendezvous_pending == 0;
+  huge_free(local_seen->bucket,
+    set_size(local_seen) * sizeof(local_seen->bucket[0]));
+  local_seen->size_exponent = header.set_size_exponent;
+  local_seen->bucket = xhuge_calloc(set_size(local_seen)
+    * sizeof(local_seen->bucket[0]));
+
+  size_t count = header.state_count;
+  uint64_t *slots = xmalloc((count + 1) * sizeof(slots[0]));
+  resume_read(slots, count * sizeof(slots[0]));
+
+  /* All the states live in a single allocation, read in one go. */
+  struct state *states = xmalloc((count + 1) * sizeof(states[0]));
+  resume_read(states, count * sizeof(states[0]));
+
+  for (size_t i = 0; i < count; i++) {
+    if (__builtin_expect(slots[i] >= set_size(local_seen), 0)) {
+      fprintf(stderr, "%s is corrupted\n", RESUME_PATH);
+      exit(EXIT_FAILURE);
+    }
+    local_seen->bucket[slots[i]] = state_to_slot(&states[i],
+      state_hash(&states[i]));
+  }
+  seen_count = count;
+  free(slots);
+
+#if STATE_PREVIOUS
+  for (size_t i = 0; i < count; i++) {
+    uintptr_t previous = (uintptr_t)state_previous_get(&states[i]);
+    state_previous_set(&states[i], previous == 0 ? NULL
+      : slot_to_state(local_seen->bucket[previous - 1]));
+  }
+#endif
+
+  for (size_t i = 0; i < header.queue_count; i++) {
+    uint64_t slot;
+    resume_read(&slot, sizeof(slot));
+    if (__builtin_expect(slot >= set_size(local_seen)
+        || slot_is_empty(local_seen->bucket[slot]), 0)) {
+      fprintf(stderr, "%s is corrupted\n", RESUME_PATH);
+      exit(EXIT_FAILURE);
+    }
+    (void)queue_enqueue(slot_to_state(local_seen->bucket[slot]), 0);
+  }
+
+  rules_fired_local = header.rules_fired;
+  error_count = header.error_count;
+
+  return header.queue_count;
 }
+#endif
 
-/* Call this at the end of a rendezvous point.
- *
- * This is a low level function, not expected to be directly used outside of the
- * context of the rendezvous implementation.
- *
- * @param leader Whether the caller is the 'leader'. If you call this when you
- *   are the 'leader' it will unblock all 'followers' at the rendezvous point.
- * @param action Optional code for the leader to run.
- */
-static void rendezvous_depart(bool leader, void (*action)(void)) {
-  int r __attribute((unused));
+#if CHECKPOINT || RESUME
+/* Open the files we need. This must be done before entering the sandbox. */
+static void checkpoint_init(void) {
+#if RESUME
+  resume_file = fopen(RESUME_PATH, "rb");
+  if (__builtin_expect(resume_file == NULL, 0)) {
+    fprintf(stderr, "failed to open %s: %s\n", RESUME_PATH, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+#endif
+#if CHECKPOINT
+  /* Avoid truncating the file, as it may be the one we are resuming from. */
+  checkpoint_file = fopen(CHECKPOINT_PATH, "r+b");
+  if (checkpoint_file == NULL && errno == ENOENT) {
+    checkpoint_file = fopen(CHECKPOINT_PATH, "w+b");
+  }
+  if (__builtin_expect(checkpoint_file == NULL, 0)) {
+    fprintf(stderr, "failed to open %s: %s\n", CHECKPOINT_PATH,
+      strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  checkpoint_due = time(NULL) + CHECKPOINT_EVERY;
+#endif
+}
+#endif
 
-  if (leader) {
-    if (action != NULL) {
-      action();
-    }
+/******************************************************************************/
 
-    /* Reset the counter for the next rendezvous. */
-    assert(rendezvous_pending == 0 && "a rendezvous point is being exited "
-      "while some participating threads have yet to arrive");
-    rendezvous_pending = running_count;
+/*******************************************************************************
+ * Size hints                                                                  *
+ *                                                                             *
+ * With `--size-hint`, the verifier records how large the run grew in a small  *
+ * text file at exit. Rumur reads this back when next generating a verifier    *
+ * for the model, and starts its seen set at a size that will not need to be   *
+ * expanded.                                                                   *
+ ******************************************************************************/
 
-    /* Wake up the 'followers'. */
-    r = pthread_cond_broadcast(&rendezvous_cond);
-    assert(r == 0);
+#if SIZE_HINT
+static FILE *size_hint_file;
 
-  } else {
+/* Open the statistics file. This must be done before entering the sandbox. */
+static void size_hint_init(void) {
+  /* Avoid truncating the file, so a run that does not finish leaves the last
+   * statistics in place.
+   */
+  size_hint_file = fopen(SIZE_HINT_PATH, "r+");
+  if (size_hint_file == NULL && errno == ENOENT) {
+    size_hint_file = fopen(SIZE_HINT_PATH, "w+");
+  }
+  if (__builtin_expect(size_hint_file == NULL, 0)) {
+    fprintf(stderr, "failed to open %s: %s\n", SIZE_HINT_PATH, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+}
 
-    /* Wait on the 'leader' to wake us up. */
-    r = pthread_cond_wait(&rendezvous_cond, &rendezvous_lock);
-    assert(r == 0);
+/* Write the statistics of this run. This is run single-threaded at exit. */
+static void size_hint_write(void) {
+  FILE *f = size_hint_file;
+  rewind(f);
+
+  fprintf(f, "# statistics of a Rumur verifier run, for --size-hint\n");
+  fprintf(f, "states %zu\n", seen_count);
+  for (size_t i = 0; i < THREADS; i++) {
+    fprintf(f, "queue_peak %zu %zu\n", i, queue_stats[i].peak);
+  }
+  if (BOUND > 0) {
+    for (size_t i = 0; i < sizeof(allocated) / sizeof(allocated[0]); i++) {
+      if (allocated[i] == 0) {
+        break;
+      }
+      fprintf(f, "depth %zu %zu\n", i, allocated[i]);
+    }
   }
 
-  r = pthread_mutex_unlock(&rendezvous_lock);
-  assert(r == 0);
+  /* Drop anything left over from a longer previous version of the file. */
+  if (__builtin_expect(fflush(f) != 0
+      || ftruncate(fileno(f), ftell(f)) != 0, 0)) {
+    fprintf(stderr, "failed to write %s: %s\n", SIZE_HINT_PATH,
+      strerror(errno));
+  }
 }
+#endif
 
-/* Exposed friendly function for performing a rendezvous. */
-static void rendezvous(void (*action)(void)) {
-  bool leader = rendezvous_arrive();
-  if (leader) {
-    TRACE(TC_SET, "arrived at rendezvous point as leader");
-  }
-  rendezvous_depart(leader, action);
+/******************************************************************************/
+
+static time_t START_TIME;
+
+static unsigned long long gettime() {
+  return (unsigned long long)(time(NULL) - START_TIME);
 }
 
-/* Remove the caller from the pool of threads who participate in this
- * rendezvous.
+#if LIVENESS_COUNT > 0
+/* Set one of the liveness bits (i.e. mark the matching property as 'hit') in a
+ * state and all its predecessors.
  */
-static void rendezvous_opt_out(void (*action)(void)) {
+static __attribute__((unused)) void mark_liveness(struct state *NONNULL s,
+    size_t index, bool shared) {
 
-retry:;
+  assert(s != NULL);
+  ASSERT(index < sizeof(s->liveness) * CHAR_BIT
+    && "out of range liveness write");
 
-  /* "Arrive" at the rendezvous to decrement the count of outstanding threads.
-   */
-  bool leader = rendezvous_arrive();
+  size_t word_index = index / (sizeof(s->liveness[0]) * CHAR_BIT);
+  size_t bit_index = index % (sizeof(s->liveness[0]) * CHAR_BIT);
 
-  if (leader && running_count > 1) {
-    /* We unfortunately opted out of this rendezvous while the remaining threads
-     * were arriving at one and we were the last to arrive. Let's pretend we are
-     * participating in the rendezvous and unblock them.
-     */
-    rendezvous_depart(true, action);
+  uintptr_t previous_value;
+  uintptr_t *target = &s->liveness[word_index];
+  uintptr_t mask = ((uintptr_t)1) << bit_index;
 
-    /* Re-attempt opting-out. */
-    goto retry;
+  if (shared) {
+    /* If this state is shared (accessible by other threads) we need to operate
+     * on its liveness data atomically.
+     */
+    previous_value = __atomic_fetch_or(target, mask, __ATOMIC_SEQ_CST);
+  } else {
+    /* Otherwise we can use a cheaper ordinary OR. */
+    previous_value = *target;
+    *target |= mask;
   }
 
-  /* Remove ourselves from the known threads. */
-  assert(running_count > 0);
-  running_count--;
+  /* Cheat a little and cast away the constness of the previous state for which
+   * we may need to update liveness data.
+   */
+  struct state *previous = state_drop_const(state_previous_get(s));
 
-  int r __attribute__((unused)) = pthread_mutex_unlock(&rendezvous_lock);
-  assert(r == 0);
+  /* If the given bit was already set, we know all the predecessors of this
+   * state have already had their corresponding bit marked. However, if it was
+   * not we now need to recurse to mark them. Note that we assume any
+   * predecessors of this state are globally visible and hence shared. The
+   * recursion depth here can be indeterminately deep, but we assume the
+   * compiler can tail-optimise this call.
+   */
+  if ((previous_value & mask) != mask && previous != NULL) {
+    mark_liveness(previous, index, true);
+  }
 }
 
-/******************************************************************************/
-
-/*******************************************************************************
- * 'Slots', an opaque wrapper around a state pointer                           *
- *                                                                             *
- * See usage of this in the state set below for its purpose.                   *
- ******************************************************************************/
+/* number of unknown liveness properties for a given state */
+static unsigned long unknown_liveness(const struct state *NONNULL s) {
 
-typedef uintptr_t slot_t;
+  assert(s != NULL);
 
-static __attribute__((const)) slot_t slot_empty(void) {
-  return 0;
-}
+  unsigned long unknown = 0;
 
-static __attribute__((const)) bool slot_is_empty(slot_t s) {
-  return s == slot_empty();
-}
+  for (size_t i = 0; i < sizeof(s->liveness) / sizeof(s->liveness[0]); i++) {
 
-static __attribute__((const)) slot_t slot_tombstone(void) {
-  static const slot_t TOMBSTONE = ~(slot_t)0;
-  return TOMBSTONE;
-}
+    uintptr_t word = __atomic_load_n(&s->liveness[i], __ATOMIC_SEQ_CST);
 
-static __attribute__((const)) bool slot_is_tombstone(slot_t s) {
-  return s == slot_tombstone();
-}
+    for (size_t j = 0; j < sizeof(s->liveness[0]) * CHAR_BIT; j++) {
+      if (i * sizeof(s->liveness[0]) * CHAR_BIT + j >= LIVENESS_COUNT) {
+        break;
+      }
 
-static struct state *slot_to_state(slot_t s) {
-  ASSERT(!slot_is_empty(s));
-  ASSERT(!slot_is_tombstone(s));
-  return (struct state*)s;
-}
+      if (!((word >> j) & 0x1)) {
+        unknown++;
+      }
+    }
+  }
 
-static slot_t state_to_slot(const struct state *s) {
-  return (slot_t)s;
+  return unknown;
 }
+#endif
 
-/******************************************************************************/
+/* Prototypes for generated functions. */
+static void init(void) __attribute__((unused));
+static _Noreturn void explore(void);
+#if LIVENESS_COUNT > 0 || COUNTEREXAMPLE_REPLAY
+static void state_successors(const struct state *NONNULL s,
+  void (*NONNULL visit)(const struct state *NONNULL s,
+    const struct state *NONNULL n, uint64_t rule_taken));
+#endif
+#if LIVENESS_COUNT > 0
+static unsigned long check_liveness_summarise(void);
+#endif
+#if COUNTEREXAMPLE_REPLAY
+static void start_states(
+  void (*NONNULL visit)(const struct state *NONNULL n, uint64_t rule_taken));
+#endif
 
+#if COUNTEREXAMPLE_REPLAY
 /*******************************************************************************
- * State set                                                                   *
+ * Counterexample replay                                                       *
  *                                                                             *
- * The following implementation provides a set for storing the seen states.    *
- * There is no support for removing elements, only thread-safe insertion of    *
- * elements.                                                                   *
+ * With COUNTEREXAMPLE_REPLAY, a state records only a few bits of the hash of  *
+ * the state it was reached from, rather than a pointer to that state and the  *
+ * rule that was fired. To print a counterexample trace, the path is found     *
+ * again by a breadth-first search from the start states through the seen set, *
+ * following only edges into states whose recorded parent hash matches the     *
+ * state we came from. This mostly retraces the tree exploration built, so the *
+ * search typically touches each state at most once and arrives at the target  *
+ * by the same path a stored pointer would have given.                         *
  ******************************************************************************/
 
-enum { INITIAL_SET_SIZE_EXPONENT = sizeof(unsigned long long) * 8 - 1 -
-  __builtin_clzll(SET_CAPACITY / sizeof(struct state*) / sizeof(struct state)) };
-
-struct set {
-  slot_t *bucket;
-  size_t size_exponent;
-};
-
-/* Some utility functions for dealing with exponents. */
-
-static size_t set_size(const struct set *NONNULL set) {
-  return ((size_t)1) << set->size_exponent;
-}
-
-static size_t set_index(const struct set *NONNULL set, size_t index) {
-  return index & (set_size(set) - 1);
-}
-
-/* The states we have encountered. This collection will only ever grow while
- * checking the model. Note that we have a global reference-counted pointer and
- * a local bare pointer. See below for an explanation.
- */
-static refcounted_ptr_t global_seen;
-static _Thread_local struct set *local_seen;
-
-/* Number of elements in the global set (i.e. occupancy). */
-static size_t seen_count;
+static _Thread_local struct {
+  /* the states reached, in the order they were reached */
+  const struct state **node;
+  size_t count;
+  size_t capacity;
 
-/* The "next" 'global_seen' value. See below for an explanation. */
-static refcounted_ptr_t next_global_seen;
+  /* where each depth starts within `node` */
+  size_t *depth;
+  size_t depth_count;
+  size_t depth_capacity;
 
-/* Now the explanation I teased... When the set capacity exceeds a threshold
- * (see 'set_expand' related logic below) it is expanded and the reference
- * tracking within the 'refcounted_ptr_t's comes in to play. We need to allocate
- * a new seen set ('next_global_seen'), copy over all the elements (done in
- * 'set_migrate'), and then "shift" the new set to become the current set. The
- * role of the reference counts of both 'global_seen' and 'next_global_seen' in
- * all of this is to detect when the last thread releases its reference to the
- * old seen set and hence can deallocate it.
- */
+  uint16_t parent_hash;       /* hash successors of the current state record */
+  const struct state *target; /* state we are looking for */
+  bool found;
 
-/* The next chunk to migrate from the old set to the new set. What exactly a
- * "chunk" is is covered in 'set_migrate'.
- */
-static size_t next_migration;
+  const struct state *want; /* successor whose predecessor is being sought */
+  uint64_t rule_taken;      /* rule found to lead to `want`, or 0 */
+} replay;
 
-/* A mechanism for synchronisation in 'set_expand'. */
-static pthread_mutex_t set_expand_mutex;
+static void replay_add(const struct state *NONNULL n, bool check_parent) {
 
-static void set_expand_lock(void) {
-  if (THREADS > 1) {
-    int r __attribute__((unused)) = pthread_mutex_lock(&set_expand_mutex);
-    ASSERT(r == 0);
+  if (replay.found) {
+    /* we already have what we came for */
+    return;
   }
-}
 
-static void set_expand_unlock(void) {
-  if (THREADS > 1) {
-    int r __attribute__((unused)) = pthread_mutex_unlock(&set_expand_mutex);
-    ASSERT(r == 0);
+  const struct state *t = set_find(n);
+  if (t == NULL) {
+    /* a successor exploration did not keep, e.g. one failing an invariant */
+    return;
   }
-}
-
 
-static void set_init(void) {
-
-  if (THREADS > 1) {
-    int r = pthread_mutex_init(&set_expand_mutex, NULL);
-    if (__builtin_expect(r < 0, 0)) {
-      fprintf(stderr, "pthread_mutex_init failed: %s\n", strerror(r));
-      exit(EXIT_FAILURE);
-    }
+  if (check_parent && state_parent_hash_get(t) != replay.parent_hash) {
+    /* exploration did not reach `t` from this state */
+    return;
   }
 
-  /* Allocate the set we'll store seen states in at some conservative initial
-   * size.
-   */
-  struct set *set = xmalloc(sizeof(*set));
-  set->size_exponent = INITIAL_SET_SIZE_EXPONENT;
-  set->bucket = xcalloc(set_size(set), sizeof(set->bucket[0]));
+  replay.node = array_reserve(replay.node, replay.count, &replay.capacity,
+    sizeof(replay.node[0]));
+  replay.node[replay.count] = t;
+  replay.count++;
 
-  /* Stash this somewhere for threads to later retrieve it from. Note that we
-   * initialize its reference count to zero as we (the setup logic) are not
-   * using it beyond this function.
-   */
-  refcounted_ptr_set(&global_seen, set);
+  if (t == replay.target) {
+    replay.found = true;
+  }
 }
 
-static void set_thread_init(void) {
-  /* Take a local reference to the global seen set. */
-  local_seen = refcounted_ptr_get(&global_seen);
+static void replay_start(const struct state *NONNULL n,
+    uint64_t rule_taken __attribute__((unused))) {
+  replay_add(n, false);
 }
 
-static void set_update(void) {
-  /* Guard against the case where we've been called from exit_with() and we're
-   * not finishing a migration, but just opting out of the rendezvous protocol.
-   */
-  if (refcounted_ptr_peek(&next_global_seen) != NULL) {
-
-    /* Clean up the old set. Note that we are using a pointer we have already
-     * given up our reference count to here, but we rely on the caller to ensure
-     * this access is safe.
-     */
-    free(local_seen->bucket);
-    free(local_seen);
-
-    /* Reset migration state for the next time we expand the set. */
-    next_migration = 0;
+static void replay_successor(const struct state *NONNULL s
+    __attribute__((unused)), const struct state *NONNULL n,
+    uint64_t rule_taken __attribute__((unused))) {
+  replay_add(n, true);
+}
 
-    /* Update the global pointer to the new set. We know all the above
-     * migrations have completed and no one needs the old set.
-     */
-    refcounted_ptr_shift(&global_seen, &next_global_seen);
-  }
+static int replay_node_cmp(const void *NONNULL a, const void *NONNULL b) {
+  uintptr_t x = (uintptr_t)*(const struct state *const*)a;
+  uintptr_t y = (uintptr_t)*(const struct state *const*)b;
+  return x < y ? -1 : x > y ? 1 : 0;
 }
 
-static void set_migrate(void) {
+static void replay_depth_begin(void) {
+  replay.depth = array_reserve(replay.depth, replay.depth_count,
+    &replay.depth_capacity, sizeof(replay.depth[0]));
+  replay.depth[replay.depth_count] = replay.count;
+  replay.depth_count++;
+}
 
-  TRACE(TC_SET, "assisting in set migration...");
+/* Search for the state `target` from the start states, one depth at a time so
+ * we reach it by a path no longer than the one exploration took.
+ */
+static void replay_search(const struct state *NONNULL target) {
 
-  /* Size of a migration chunk. Threads in this function grab a chunk at a time
-   * to migrate.
-   */
-  enum { CHUNK_SIZE = 4096 / sizeof(local_seen->bucket[0]) /* slots */ };
+  replay.count = 0;
+  replay.depth_count = 0;
+  replay.target = target;
+  replay.found = false;
 
-  /* Take a pointer to the target set for the migration. */
-  struct set *next = refcounted_ptr_get(&next_global_seen);
+  replay_depth_begin();
+  start_states(replay_start);
 
   for (;;) {
-
-    size_t chunk = __atomic_fetch_add(&next_migration, 1, __ATOMIC_SEQ_CST);
-    size_t start = chunk * CHUNK_SIZE;
-    size_t end = start + CHUNK_SIZE;
-
-    /* Bail out if we've finished migrating all of the set. */
-    if (start >= set_size(local_seen)) {
+    size_t start = replay.depth[replay.depth_count - 1];
+    if (replay.found || start == replay.count) {
       break;
     }
 
-    // TODO: The following algorithm assumes insertions can collide. That is, it
-    // operates atomically on slots because another thread could be migrating
-    // and also targeting the same slot. If we were to more closely wick to the
-    // Maier design this would not be required.
-
-    for (size_t i = start; i < end; i++) {
-
-      /* retrieve the slot element and mark it as migrated */
-      slot_t s = __atomic_exchange_n(&local_seen->bucket[i], slot_tombstone(),
-        __ATOMIC_SEQ_CST);
-      ASSERT(!slot_is_tombstone(s) && "attempted double slot migration");
-
-      /* If the current slot contained a state, rehash it and insert it into the
-       * new set. Note we don't need to do any state comparisons because we know
-       * everything in the old set is unique.
-       */
-      if (!slot_is_empty(s)) {
-        size_t index = set_index(next, state_hash(slot_to_state(s)));
-        /* insert and shuffle any colliding entries one along */
-        for (size_t j = index; !slot_is_empty(s); j = set_index(next, j + 1)) {
-          s = __atomic_exchange_n(&next->bucket[j], s, __ATOMIC_SEQ_CST);
-        }
+    /* remove duplicates from the depth just completed */
+    qsort(replay.node + start, replay.count - start, sizeof(replay.node[0]),
+      replay_node_cmp);
+    size_t count = start;
+    for (size_t i = start; i < replay.count; i++) {
+      if (count == start || replay.node[count - 1] != replay.node[i]) {
+        replay.node[count] = replay.node[i];
+        count++;
       }
     }
+    replay.count = count;
 
+    replay_depth_begin();
+    for (size_t i = start; i < count && !replay.found; i++) {
+      const struct state *s = replay.node[i];
+      replay.parent_hash = (uint16_t)state_hash(s);
+      state_successors(s, replay_successor);
+    }
   }
+}
 
-  /* Release our reference to the old set now we're done with it. */
-  refcounted_ptr_put(&global_seen, local_seen);
-
-  /* Now we need to make sure all the threads get to this point before any one
-   * thread leaves. The purpose of this is to guarantee we only ever have at
-   * most two seen sets "in flight". Without this rendezvous, one thread could
-   * race ahead, fill the new set, and then decide to expand again while some
-   * are still working on the old set. It's possible to make such a scheme work
-   * but the synchronisation requirements just seem too complicated.
-   */
-  rendezvous(set_update);
+static void replay_link_start(const struct state *NONNULL n,
+    uint64_t rule_taken) {
+  if (replay.rule_taken == 0 && set_find(n) == replay.want) {
+    replay.rule_taken = rule_taken;
+  }
+}
 
-  /* We're now ready to resume model checking. Note that we already have a
-   * (reference counted) pointer to the now-current global seen set, so we don't
-   * need to take a fresh reference to it.
-   */
-  local_seen = next;
+static void replay_link(const struct state *NONNULL s __attribute__((unused)),
+    const struct state *NONNULL n, uint64_t rule_taken) {
+  replay_link_start(n, rule_taken);
 }
 
-static void set_expand(void) {
+static size_t trace_replay(const struct state *NONNULL s,
+    const struct state ***NONNULL states, uint64_t **NONNULL rules) {
 
-  /* Using double-checked locking, we look to see if someone else has already
-   * started expanding the set. We do this by first checking before acquiring
-   * the set mutex, and then later again checking after we've acquired the
-   * mutex. The idea here is that, with multiple threads, you'll frequently find
-   * someone else beat you to expansion and you can jump straight to helping
-   * them with migration without having the expense of acquiring the set mutex.
+  /* If `s` is not itself in the seen set, it is a successor of the state this
+   * thread was expanding that failed to get there, because of this error. Its
+   * path is that of the state being expanded, plus the rule last fired. If we
+   * were not expanding anything, `s` is a start state.
    */
-  if (THREADS > 1 && refcounted_ptr_peek(&next_global_seen) != NULL) {
-    /* Someone else already expanded it. Join them in the migration effort. */
-    TRACE(TC_SET, "attempted expansion failed because another thread got there "
-      "first");
-    set_migrate();
-    return;
+  const struct state *target = s;
+  bool last_step = set_find(s) != s;
+  if (last_step) {
+    target = trace_expanding;
   }
+  uint64_t last_rule = trace_rule;
 
-  set_expand_lock();
+  /* Errors during replay longjmp to our checkpoint, so preserve the one our
+   * caller expects to return to.
+   */
+  sigjmp_buf saved;
+  memcpy(saved, checkpoint, sizeof(saved));
+  trace_replaying = true;
+
+  size_t length = 0;
+  if (target != NULL) {
+    replay_search(target);
+    /* We should always be able to retrace a path exploration took. If not,
+     * fall back to printing `s` alone.
+     */
+    assert(replay.found && "failed to reconstruct counterexample trace");
+    if (replay.found) {
+      length = replay.depth_count;
+    } else {
+      target = NULL;
+      last_step = true;
+      last_rule = 0;
+    }
+  }
+  if (last_step) {
+    length++;
+  }
 
-  /* Check again, as described above. */
-  if (THREADS > 1 && refcounted_ptr_peek(&next_global_seen) != NULL) {
-    set_expand_unlock();
-    TRACE(TC_SET, "attempted expansion failed because another thread got there "
-      "first");
-    set_migrate();
-    return;
+  *states = xcalloc(length, sizeof((*states)[0]));
+  *rules = xcalloc(length, sizeof((*rules)[0]));
+
+  if (last_step) {
+    (*states)[length - 1] = s;
+    (*rules)[length - 1] = last_rule;
   }
 
-  TRACE(TC_SET, "expanding set from %zu slots to %zu slots...",
-    (((size_t)1) << local_seen->size_exponent) / sizeof(slot_t),
-    (((size_t)1) << (local_seen->size_exponent + 1)) / sizeof(slot_t));
+  if (target != NULL) {
+    /* Walk back from the target, finding at each depth a state that leads to
+     * the one after it.
+     */
+    const struct state *next = target;
+    for (size_t d = replay.depth_count; d-- > 0; ) {
+      (*states)[d] = next;
+      replay.want = next;
+      replay.rule_taken = 0;
+      if (d == 0) {
+        start_states(replay_link_start);
+        break;
+      }
+      for (size_t i = replay.depth[d - 1]; i < replay.depth[d]; i++) {
+        const struct state *p = replay.node[i];
+        if ((uint16_t)state_hash(p) == state_parent_hash_get(next)) {
+          state_successors(p, replay_link);
+          if (replay.rule_taken != 0) {
+            next = p;
+            break;
+          }
+        }
+      }
+      assert(replay.rule_taken != 0 && "no predecessor found during replay");
+      (*rules)[d] = replay.rule_taken;
+    }
+    (*rules)[0] = replay.rule_taken;
+  }
 
-  /* Create a set of double the size. */
-  struct set *set = xmalloc(sizeof(*set));
-  set->size_exponent = local_seen->size_exponent + 1;
-  set->bucket = xcalloc(set_size(set), sizeof(set->bucket[0]));
+  trace_replaying = false;
+  memcpy(checkpoint, saved, sizeof(saved));
 
-  /* Advertise this as the newly expanded global set. */
-  refcounted_ptr_set(&next_global_seen, set);
+  free(replay.node);
+  replay.node = NULL;
+  replay.count = 0;
+  replay.capacity = 0;
+  free(replay.depth);
+  replay.depth = NULL;
+  replay.depth_count = 0;
+  replay.depth_capacity = 0;
 
-  /* We now need to migrate all slots from the old set to the new one, but we
-   * can do this multithreaded.
-   */
-  set_expand_unlock();
-  set_migrate();
+  return length;
 }
+#endif
 
-static bool set_insert(struct state *NONNULL s, size_t *NONNULL count) {
+#if LIVENESS_COUNT > 0
+/*******************************************************************************
+ * Final liveness check                                                        *
+ *                                                                             *
+ * During exploration, a liveness property is marked as satisfied in a state   *
+ * when it holds there or in one of the states reached from it along the chain *
+ * of previous pointers. Once exploration is over, the remaining unknown bits  *
+ * are settled by passing what each state knows back along every edge of the   *
+ * state graph, using all threads:                                             *
+ *                                                                             *
+ *   1. Each thread regenerates the successors of the states in its share of   *
+ *      the seen set that still have unknown bits, recording a reverse edge    *
+ *      from each successor to its predecessor. It then sorts these by         *
+ *      successor, so the predecessors of a state can be found by binary       *
+ *      search.                                                                *
+ *   2. Each edge passes on whatever its successor knows and its predecessor   *
+ *      does not. Predecessors that learn something are added to a worklist.   *
+ *   3. In rounds, threads take states from the worklist and pass their bits   *
+ *      on to their predecessors, adding those that learn something to the     *
+ *      next round's worklist, until a round learns nothing.                   *
+ *                                                                             *
+ * An edge is therefore only revisited when its successor has learnt           *
+ * something, rather than on every sweep of the seen set.                      *
+ ******************************************************************************/
 
-restart:;
+struct liveness_edge {
+  const struct state *to; /* successor */
+  struct state *from;     /* predecessor */
+};
 
-  if (__atomic_load_n(&seen_count, __ATOMIC_SEQ_CST) * 100
-      / set_size(local_seen) >= SET_EXPAND_THRESHOLD)
-    set_expand();
+/* Per-thread reverse edges and the states that learnt something this round. */
+static struct {
+  struct liveness_edge *edge;
+  size_t edge_count;
+  size_t edge_capacity;
 
-  size_t index = set_index(local_seen, state_hash(s));
+  struct state **learnt;
+  size_t learnt_count;
+  size_t learnt_capacity;
 
-  size_t attempts = 0;
-  for (size_t i = index; attempts < set_size(local_seen); i = set_index(local_seen, i + 1)) {
+  unsigned long learnt_bits; /* liveness bits learnt so far */
+} liveness_index[THREADS];
 
-    /* Guess that the current slot is empty and try to insert here. */
-    slot_t c = slot_empty();
-    if (__atomic_compare_exchange_n(&local_seen->bucket[i], &c,
-        state_to_slot(s), false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
-      /* Success */
-      *count = __atomic_add_fetch(&seen_count, 1, __ATOMIC_SEQ_CST);
-      TRACE(TC_SET, "added state %p, set size is now %zu", s, *count);
+/* The current round's worklist, which threads take batches of states from. */
+static struct state **liveness_work;
+static size_t liveness_work_count;
+static size_t liveness_work_capacity;
+static size_t liveness_work_taken;
 
-      /* The maximum possible size of the seen state set should be constrained
-       * by the number of possible states based on how many bits we are using to
-       * represent the state data.
-       */
-      if (STATE_SIZE_BITS < sizeof(size_t) * CHAR_BIT) {
-        assert(*count <= ((size_t)1) << STATE_SIZE_BITS && "seen set size "
-          "exceeds total possible number of states");
-      }
+enum { LIVENESS_BATCH = 64 };
 
-      /* Update statistics if `--trace memory_usage` is in effect. Note that we
-       * do this here (when a state is being added to the seen set) rather than
-       * when the state was originally allocated to ensure that the final
-       * allocation figures do not include transient states that we allocated
-       * and then discarded as duplicates.
-       */
-       size_t depth = 0;
-#if BOUND > 0
-       depth = (size_t)state_bound_get(s);
-#endif
-       register_allocation(depth);
+/* Unknown liveness bits left, and progress reporting. Only thread 0 touches
+ * these.
+ */
+static unsigned long liveness_remaining;
+static unsigned long liveness_reported;
+static unsigned long long liveness_last_update;
 
-      return true;
-    }
+/* A barrier for the threads participating in the final liveness check. This
+ * is hand rolled because pthread barriers are not available on macOS.
+ */
+static pthread_mutex_t liveness_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t liveness_cond = PTHREAD_COND_INITIALIZER;
+static size_t liveness_arrived;
+static size_t liveness_generation;
 
-    if (slot_is_tombstone(c)) {
-      /* This slot has been migrated. We need to rendezvous with other migrating
-       * threads and restart our insertion attempt on the newly expanded set.
-       */
-      set_migrate();
-      goto restart;
-    }
+static void liveness_barrier(void) {
 
-    /* If we find this already in the set, we're done. */
-    if (state_eq(s, slot_to_state(c))) {
-      TRACE(TC_SET, "skipped adding state %p that was already in set", s);
-      return false;
-    }
+  if (THREADS == 1) {
+    return;
+  }
 
-    attempts++;
+  int r __attribute__((unused)) = pthread_mutex_lock(&liveness_lock);
+  assert(r == 0);
+
+  size_t generation = liveness_generation;
+  liveness_arrived++;
+  if (liveness_arrived == THREADS) {
+    liveness_arrived = 0;
+    liveness_generation++;
+    r = pthread_cond_broadcast(&liveness_cond);
+    assert(r == 0);
+  } else {
+    while (generation == liveness_generation) {
+      r = pthread_cond_wait(&liveness_cond, &liveness_lock);
+      assert(r == 0);
+    }
   }
 
-  /* If we reach here, the set is full. Expand it and retry the insertion. */
-  set_expand();
-  return set_insert(s, count);
+  r = pthread_mutex_unlock(&liveness_lock);
+  assert(r == 0);
 }
 
-/* Find an existing element in the set.
- *
- * Why would you ever want to do this? If you already have the state, why do you
- * want to find a copy of it? The answer is for liveness information. When
- * checking liveness properties, a duplicate of your current state that is
- * already contained in the state set might know some of the liveness properties
- * are satisfied that your current state considers unknown.
+/* Record that `n` is a successor of `s`. This is called back by the generated
+ * state_successors().
  */
-static __attribute__((unused)) const struct state *set_find(
-    const struct state *NONNULL s) {
+static void liveness_add_edge(const struct state *NONNULL s,
+    const struct state *NONNULL n, uint64_t rule_taken __attribute__((unused))) {
+
+  /* We should be able to find this state in the seen set. Record the edge
+   * against the copy there, because the state our exploration encountered may
+   * not have been the first of its kind seen and thus was de-duped and never
+   * made it into the seen set with a back pointer to `s`.
+   */
+  const struct state *t = set_find(n);
+  ASSERT(t != NULL && "state encountered during final liveness wrap up "
+    "that was not previously seen");
+
+  /* A state can learn nothing from itself. */
+  if (s == t) {
+    return;
+  }
 
-  assert(s != NULL);
+  liveness_index[thread_id].edge = array_reserve(
+    liveness_index[thread_id].edge, liveness_index[thread_id].edge_count,
+    &liveness_index[thread_id].edge_capacity, sizeof(struct liveness_edge));
+  liveness_index[thread_id].edge[liveness_index[thread_id].edge_count] =
+    (struct liveness_edge){ .to = t, .from = state_drop_const(s) };
+  liveness_index[thread_id].edge_count++;
+}
 
-  size_t index = set_index(local_seen, state_hash(s));
+static int liveness_edge_cmp(const void *NONNULL a, const void *NONNULL b) {
+  uintptr_t x = (uintptr_t)((const struct liveness_edge*)a)->to;
+  uintptr_t y = (uintptr_t)((const struct liveness_edge*)b)->to;
+  return x < y ? -1 : x > y ? 1 : 0;
+}
 
-  size_t attempts = 0;
-  for (size_t i = index; attempts < set_size(local_seen); i = set_index(local_seen, i + 1)) {
+/* Pass on to `s` the liveness properties its successor `t` knows are
+ * satisfied. If `s` learns anything, it is added to the next round's worklist.
+ */
+static void liveness_pass_on(struct state *NONNULL s,
+    const struct state *NONNULL t) {
 
-    slot_t slot = __atomic_load_n(&local_seen->bucket[i], __ATOMIC_SEQ_CST);
+  unsigned long learnt = 0;
 
-    /* This function is only expected to be called during the final liveness
-     * scan, in which all threads participate. So we should never encounter a
-     * set undergoing migration.
-     */
-    ASSERT(!slot_is_tombstone(slot)
-      && "tombstone encountered during final phase");
+  for (size_t i = 0; i < sizeof(s->liveness) / sizeof(s->liveness[0]); i++) {
+    uintptr_t add = __atomic_load_n(&t->liveness[i], __ATOMIC_SEQ_CST)
+      & ~__atomic_load_n(&s->liveness[i], __ATOMIC_SEQ_CST);
+    if (add != 0) {
+      /* Another thread may be passing on the same bits, so count only those
+       * we were first to set.
+       */
+      uintptr_t old = __atomic_fetch_or(&s->liveness[i], add, __ATOMIC_SEQ_CST);
+      learnt += (unsigned long)__builtin_popcountll(
+        (unsigned long long)(add & ~old));
+    }
+  }
 
-    if (slot_is_empty(slot)) {
-      /* reached the end of the linear block in which this state could lie */
-      break;
+  if (learnt == 0) {
+    return;
+  }
+
+  liveness_index[thread_id].learnt_bits += learnt;
+  liveness_index[thread_id].learnt = array_reserve(
+    liveness_index[thread_id].learnt, liveness_index[thread_id].learnt_count,
+    &liveness_index[thread_id].learnt_capacity, sizeof(struct state*));
+  liveness_index[thread_id].learnt[liveness_index[thread_id].learnt_count] = s;
+  liveness_index[thread_id].learnt_count++;
+}
+
+/* Pass on what a state knows to all of its predecessors. */
+static void liveness_visit(const struct state *NONNULL t) {
+  for (size_t i = 0; i < THREADS; i++) {
+    const struct liveness_edge *edge = liveness_index[i].edge;
+    size_t count = liveness_index[i].edge_count;
+
+    /* find the first edge to this state */
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+      size_t mid = low + (high - low) / 2;
+      if ((uintptr_t)edge[mid].to < (uintptr_t)t) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
     }
 
-    const struct state *n = slot_to_state(slot);
-    ASSERT(n != NULL && "null pointer stored in state set");
+    for (size_t j = low; j < count && edge[j].to == t; j++) {
+      liveness_pass_on(edge[j].from, t);
+    }
+  }
+}
 
-    if (state_eq(s, n)) {
-      /* found */
-      return n;
+/* Gather the states that learnt something into the next round's worklist.
+ * This is run by thread 0 while the others wait.
+ */
+static void liveness_next_round(void) {
+
+  size_t total = 0;
+  unsigned long learnt_bits = 0;
+  for (size_t i = 0; i < THREADS; i++) {
+    total += liveness_index[i].learnt_count;
+    learnt_bits += liveness_index[i].learnt_bits;
+  }
+
+  if (total > liveness_work_capacity) {
+    liveness_work_capacity = total;
+    free(liveness_work);
+    liveness_work = malloc(liveness_work_capacity * sizeof(liveness_work[0]));
+    if (__builtin_expect(liveness_work == NULL, 0)) {
+      oom();
     }
+  }
 
-    attempts++;
+  liveness_work_count = 0;
+  for (size_t i = 0; i < THREADS; i++) {
+    if (liveness_index[i].learnt_count > 0) {
+      memcpy(&liveness_work[liveness_work_count], liveness_index[i].learnt,
+        liveness_index[i].learnt_count * sizeof(liveness_work[0]));
+    }
+    liveness_work_count += liveness_index[i].learnt_count;
+    liveness_index[i].learnt_count = 0;
   }
+  liveness_work_taken = 0;
 
-  /* not found */
-  return NULL;
+  if (!MACHINE_READABLE_OUTPUT) {
+    unsigned long long t = gettime();
+    if (t > liveness_last_update && learnt_bits > liveness_reported) {
+      put("\t ");
+      put_uint(learnt_bits - liveness_reported);
+      put(" further liveness constraints proved in ");
+      put_uint(t - liveness_last_update);
+      put("s, with ");
+      put(green()); put_uint(liveness_remaining - learnt_bits); put(reset());
+      put(" remaining\n");
+      liveness_reported = learnt_bits;
+      liveness_last_update = t;
+    }
+  }
 }
 
-/******************************************************************************/
+/* The part of the final liveness check each thread runs. */
+static void liveness_work_share(void) {
 
-static time_t START_TIME;
+  /* Record the reverse edges out of our share of the seen set. */
+  size_t start = set_size(local_seen) * thread_id / THREADS;
+  size_t end = set_size(local_seen) * (thread_id + 1) / THREADS;
+  for (size_t i = start; i < end; i++) {
 
-static unsigned long long gettime() {
-  return (unsigned long long)(time(NULL) - START_TIME);
-}
+    slot_t slot = __atomic_load_n(&local_seen->bucket[i], __ATOMIC_SEQ_CST);
 
-#if LIVENESS_COUNT > 0
-/* Set one of the liveness bits (i.e. mark the matching property as 'hit') in a
- * state and all its predecessors.
- */
-static __attribute__((unused)) void mark_liveness(struct state *NONNULL s,
-    size_t index, bool shared) {
+    ASSERT(!slot_is_tombstone(slot)
+      && "seen set being migrated during final liveness check");
 
-  assert(s != NULL);
-  ASSERT(index < sizeof(s->liveness) * CHAR_BIT
-    && "out of range liveness write");
+    if (slot_is_empty(slot)) {
+      /* skip empty entries in the hash table */
+      continue;
+    }
 
-  size_t word_index = index / (sizeof(s->liveness[0]) * CHAR_BIT);
-  size_t bit_index = index % (sizeof(s->liveness[0]) * CHAR_BIT);
+    struct state *s = slot_to_state(slot);
+    ASSERT(s != NULL && "null pointer stored in state set");
 
-  uintptr_t previous_value;
-  uintptr_t *target = &s->liveness[word_index];
-  uintptr_t mask = ((uintptr_t)1) << bit_index;
+    if (unknown_liveness(s) == 0) {
+      /* skip entries where liveness is fully satisfied already */
+      continue;
+    }
 
-  if (shared) {
-    /* If this state is shared (accessible by other threads) we need to operate
-     * on its liveness data atomically.
+#if BOUND > 0
+    /* If we're doing bounded checking and this state is at the bound limit,
+     * it's not valid to expand beyond this.
      */
-    previous_value = __atomic_fetch_or(target, mask, __ATOMIC_SEQ_CST);
-  } else {
-    /* Otherwise we can use a cheaper ordinary OR. */
-    previous_value = *target;
-    *target |= mask;
-  }
-
-  /* Cheat a little and cast away the constness of the previous state for which
-   * we may need to update liveness data.
-   */
-  struct state *previous = state_drop_const(state_previous_get(s));
+    ASSERT(state_bound_get(s) <= BOUND
+      && "a state that exceeded the bound depth was explored");
+    if (state_bound_get(s) == BOUND) {
+      continue;
+    }
+#endif
 
-  /* If the given bit was already set, we know all the predecessors of this
-   * state have already had their corresponding bit marked. However, if it was
-   * not we now need to recurse to mark them. Note that we assume any
-   * predecessors of this state are globally visible and hence shared. The
-   * recursion depth here can be indeterminately deep, but we assume the
-   * compiler can tail-optimise this call.
-   */
-  if ((previous_value & mask) != mask && previous != NULL) {
-    mark_liveness(previous, index, true);
+    state_successors(s, liveness_add_edge);
   }
-}
 
-/* number of unknown liveness properties for a given state */
-static unsigned long unknown_liveness(const struct state *NONNULL s) {
+  qsort(liveness_index[thread_id].edge, liveness_index[thread_id].edge_count,
+    sizeof(struct liveness_edge), liveness_edge_cmp);
 
-  assert(s != NULL);
+  liveness_barrier();
 
-  unsigned long unknown = 0;
+  /* Pass on what is already known along each of our edges. */
+  for (size_t i = 0; i < liveness_index[thread_id].edge_count; i++) {
+    liveness_pass_on(liveness_index[thread_id].edge[i].from,
+      liveness_index[thread_id].edge[i].to);
+  }
 
-  for (size_t i = 0; i < sizeof(s->liveness) / sizeof(s->liveness[0]); i++) {
+  /* Pass on what each state learns to its own predecessors, until nothing
+   * more is learnt.
+   */
+  for (;;) {
+    liveness_barrier();
+    if (thread_id == 0) {
+      liveness_next_round();
+    }
+    liveness_barrier();
 
-    uintptr_t word = __atomic_load_n(&s->liveness[i], __ATOMIC_SEQ_CST);
+    if (liveness_work_count == 0) {
+      break;
+    }
 
-    for (size_t j = 0; j < sizeof(s->liveness[0]) * CHAR_BIT; j++) {
-      if (i * sizeof(s->liveness[0]) * CHAR_BIT + j >= LIVENESS_COUNT) {
+    for (;;) {
+      size_t i = __atomic_fetch_add(&liveness_work_taken, LIVENESS_BATCH,
+        __ATOMIC_SEQ_CST);
+      if (i >= liveness_work_count) {
         break;
       }
-
-      if (!((word >> j) & 0x1)) {
-        unknown++;
+      size_t stop = i + LIVENESS_BATCH;
+      if (stop > liveness_work_count) {
+        stop = liveness_work_count;
+      }
+      for (; i < stop; i++) {
+        liveness_visit(liveness_work[i]);
       }
     }
   }
+}
 
-  return unknown;
+static void *liveness_thread(void *arg) {
+  thread_id = (size_t)(uintptr_t)arg;
+  set_thread_init();
+  liveness_work_share();
+  state_arena_release();
+  set_thread_exit();
+  return NULL;
 }
 
-/* Learn new liveness information about the state `s` from its successor. Note
- * that typically `state_previous_get(successor) != s` because `successor` is
- * actually one of the de-duped aliases of the original successor to `s`.
- *
- * @param s State to learn information about
- * @param successor Successor to s
- * @return Number of new liveness information facts learnt
- */
-static unsigned long learn_liveness(struct state *NONNULL s,
-    const struct state *NONNULL successor) {
+static void check_liveness_final(void) {
 
-  assert(s != NULL);
-  assert(successor != NULL);
+  if (!MACHINE_READABLE_OUTPUT) {
+    put("trying to prove remaining liveness constraints...\n");
 
-  unsigned long new_info = 0;
+    /* find how many liveness bits are unknown */
+    for (size_t i = 0; i < set_size(local_seen); i++) {
 
-  for (size_t i = 0; i < sizeof(s->liveness) / sizeof(s->liveness[0]); i++) {
+      slot_t slot = __atomic_load_n(&local_seen->bucket[i], __ATOMIC_SEQ_CST);
 
-    uintptr_t word_src = __atomic_load_n(&successor->liveness[i],
-      __ATOMIC_SEQ_CST);
-    uintptr_t word_dst = __atomic_load_n(&s->liveness[i], __ATOMIC_SEQ_CST);
+      ASSERT(!slot_is_tombstone(slot)
+        && "seen set being migrated during final liveness check");
 
-    for (size_t j = 0; j < sizeof(s->liveness[0]) * CHAR_BIT; j++) {
-      if (i * sizeof(s->liveness[0]) * CHAR_BIT + j >= LIVENESS_COUNT) {
-        break;
+      if (slot_is_empty(slot)) {
+        /* skip empty entries in the hash table */
+        continue;
       }
 
-      bool live_src = !!((word_src >> j) & 0x1);
-      bool live_dst = !!((word_dst >> j) & 0x1);
+      const struct state *s = slot_to_state(slot);
+      ASSERT(s != NULL && "null pointer stored in state set");
 
-      if (!live_dst && live_src) {
-        mark_liveness(s, i * sizeof(s->liveness[0]) * CHAR_BIT + j, true);
-        new_info++;
-      }
+      liveness_remaining += unknown_liveness(s);
     }
+    put("\t ");
+    put_uint(liveness_remaining);
+    put(" constraints remaining\n");
+    liveness_last_update = gettime();
   }
 
-  return new_info;
-}
+  /* The secondary threads have exited by now, so start fresh ones to share the
+   * work.
+   */
+#ifdef __clang__
+  #pragma clang diagnostic push
+  #pragma clang diagnostic ignored "-Wtautological-compare"
+  #pragma clang diagnostic ignored "-Wtautological-unsigned-zero-compare"
+#elif defined(__GNUC__)
+  #pragma GCC diagnostic push
+  #pragma GCC diagnostic ignored "-Wtype-limits"
+#endif
+  for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+#ifdef __clang__
+  #pragma clang diagnostic pop
+#elif defined(__GNUC__)
+  #pragma GCC diagnostic pop
 #endif
+    int r = pthread_create(&threads[i], NULL, liveness_thread,
+      (void*)(uintptr_t)(i + 1));
+    if (__builtin_expect(r != 0, 0)) {
+      fprintf(stderr, "pthread_create failed: %s\n", strerror(r));
+      exit(EXIT_FAILURE);
+    }
+  }
 
-/* Prototypes for generated functions. */
-static void init(void);
-static _Noreturn void explore(void);
-#if LIVENESS_COUNT > 0
-static void check_liveness_final(void);
-static unsigned long check_liveness_summarise(void);
+  liveness_work_share();
+
+#ifdef __clang__
+  #pragma clang diagnostic push
+  #pragma clang diagnostic ignored "-Wtautological-compare"
+  #pragma clang diagnostic ignored "-Wtautological-unsigned-zero-compare"
+#elif defined(__GNUC__)
+  #pragma GCC diagnostic push
+  #pragma GCC diagnostic ignored "-Wtype-limits"
+#endif
+  for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+#ifdef __clang__
+  #pragma clang diagnostic pop
+#elif defined(__GNUC__)
+  #pragma GCC diagnostic pop
+#endif
+    int r __attribute__((unused)) = pthread_join(threads[i], NULL);
+    assert(r == 0);
+  }
+
+  for (size_t i = 0; i < THREADS; i++) {
+    free(liveness_index[i].edge);
+    free(liveness_index[i].learnt);
+  }
+  free(liveness_work);
+}
 #endif
 
 static int exit_with(int status) {
 
-  /* Opt out of the thread-wide rendezvous protocol. */
-  refcounted_ptr_put(&global_seen, local_seen);
-  rendezvous_opt_out(set_update);
-  local_seen = NULL;
+#if CHECKPOINT
+  /* We are no longer expanding any state. */
+  checkpoint_expanding[thread_id] = NULL;
+  checkpoint_rules_fired[thread_id] = rules_fired_local;
+#endif
+
+  /* Stop using the seen set and opt out of the thread-wide rendezvous
+   * protocol.
+   */
+  set_thread_exit();
+  rendezvous_opt_out(NULL);
 
   /* Make fired rule count visible globally. */
   rules_fired[thread_id] = rules_fired_local;
+#if PARTIAL_ORDER_REDUCTION
+  por_reduced[thread_id] = por_reduced_local;
+#endif
+#if CANONICAL_CACHE
+  canonical_stats[thread_id] = canonical_stats_local;
+#endif
 
   if (thread_id == 0) {
     /* We are the initial thread. Wait on the others before exiting. */
@@ -3658,9 +7123,21 @@ static int exit_with(int status) {
 
     /* Reacquire a pointer to the seen set. Note that this may not be the same
      * value as what we previously had in local_seen because the other threads
-     * may have expanded and migrated the seen set in the meantime.
+     * may have expanded the seen set in the meantime. If they left it part way
+     * through migration, finish that now.
      */
-    local_seen = refcounted_ptr_get(&global_seen);
+    set_thread_init();
+    if (local_seen->previous != NULL) {
+      set_migrate_all(local_seen, local_seen->previous);
+    }
+
+#if PROCESSES > 1
+    /* Only process 0 reports on the run, once it has the others' counts. */
+    if (process_id != 0) {
+      dist_report(status);
+    }
+    status = dist_gather(status);
+#endif
 
     if (error_count == 0) {
       /* If we didn't see any other errors, print cover information. */
@@ -3739,17 +7216,62 @@ static int exit_with(int status) {
       fire_count += rules_fired[i];
     }
 
+#if PARTIAL_ORDER_REDUCTION
+    /* Calculate the total number of states expanded with fewer rules. */
+    uintmax_t reduced_count = 0;
+    for (size_t i = 0; i < sizeof(por_reduced) / sizeof(por_reduced[0]); i++) {
+      reduced_count += por_reduced[i];
+    }
+#endif
+
+#if CANONICAL_CACHE
+    /* Calculate the totals of canonicalisation statistics. */
+    struct canonical_stats canonical_total = { 0 };
+    for (size_t i = 0; i < sizeof(canonical_stats) / sizeof(canonical_stats[0]);
+        i++) {
+      canonical_total.lookups += canonical_stats[i].lookups;
+      canonical_total.hits += canonical_stats[i].hits;
+      canonical_total.skipped += canonical_stats[i].skipped;
+    }
+#endif
+
+    /* Calculate the totals of work-stealing statistics. */
+    uintmax_t steals = 0;
+    uintmax_t states_stolen = 0;
+    uintmax_t failed_steals = 0;
+    for (size_t i = 0; i < sizeof(queue_stats) / sizeof(queue_stats[0]); i++) {
+      steals += queue_stats[i].steals;
+      states_stolen += queue_stats[i].states_stolen;
+      failed_steals += queue_stats[i].failed_steals;
+    }
+
     /* Paranoid check that we didn't miscount during set insertions/expansions.
      */
-#ifndef NDEBUG
+#if !defined(NDEBUG) && BITSTATE_MB == 0 && !EXTERNAL_MEMORY && PROCESSES == 1
     size_t count = 0;
     for (size_t i = 0; i < set_size(local_seen); i++) {
       if (!slot_is_empty(local_seen->bucket[i])) {
         count++;
       }
     }
-#endif
     assert(count == seen_count && "seen set count is inconsistent at exit");
+#endif
+
+#if HASH_COMPACTION_BITS > 0
+    /* With hash compaction, we may have omitted states whose fingerprint
+     * collided with that of an already seen state. Bound the probability of
+     * this having happened, for n states and b-bit fingerprints, by the
+     * probability of any two of them colliding: n(n - 1) / 2^(b + 1).
+     */
+    double omission_probability = (double)seen_count
+      * (double)(seen_count == 0 ? 0 : seen_count - 1) / 2;
+    for (size_t i = 0; i < HASH_COMPACTION_BITS; i++) {
+      omission_probability /= 2;
+    }
+    if (omission_probability > 1) {
+      omission_probability = 1;
+    }
+#endif
 
     if (MACHINE_READABLE_OUTPUT) {
       put("<summary states=\"");
@@ -3760,6 +7282,42 @@ static int exit_with(int status) {
       put_uint(error_count);
       put("\" duration_seconds=\"");
       put_uint(gettime());
+#if HASH_COMPACTION_BITS > 0
+      put("\" omission_probability=\"");
+      put_double(omission_probability);
+#endif
+#if BITSTATE_MB > 0
+      put("\" coverage_estimate=\"");
+      put_double(bitstate_coverage());
+#endif
+#if TREE_COMPRESSION_MB > 0
+      put("\" tree_nodes=\"");
+      put_uint(tree_count);
+#endif
+#if PARTIAL_ORDER_REDUCTION
+      put("\" reduced_states=\"");
+      put_uint(reduced_count);
+#endif
+#if CANONICAL_CACHE
+      put("\" canonical_cache_lookups=\"");
+      put_uint(canonical_total.lookups);
+      put("\" canonical_cache_hits=\"");
+      put_uint(canonical_total.hits);
+      put("\" canonicalisations_skipped=\"");
+      put_uint(canonical_total.skipped);
+#endif
+#if LEVEL_SYNC
+      put("\" depths=\"");
+      put_uint(level + 1);
+#endif
+      if (THREADS > 1) {
+        put("\" steals=\"");
+        put_uint(steals);
+        put("\" states_stolen=\"");
+        put_uint(states_stolen);
+        put("\" failed_steals=\"");
+        put_uint(failed_steals);
+      }
       put("\"/>\n");
       put("</rumur_run>\n");
     } else {
@@ -3772,11 +7330,69 @@ static int exit_with(int status) {
       put(" rules fired in ");
       put_uint(gettime());
       put("s.\n");
+#if HASH_COMPACTION_BITS > 0
+      put("\n"
+          "\tProbability of omitting a state due to hash compaction is at most ");
+      put_double(omission_probability);
+      put(".\n");
+#endif
+#if BITSTATE_MB > 0
+      put("\n"
+          "\tEstimated coverage of the bitstate search is ");
+      put_double(bitstate_coverage());
+      put(".\n");
+#endif
+#if TREE_COMPRESSION_MB > 0
+      put("\n"
+          "\tTree compression stored ");
+      put_uint(tree_count);
+      put(" distinct nodes.\n");
+#endif
+#if PARTIAL_ORDER_REDUCTION
+      put("\n"
+          "\tPartial order reduction expanded ");
+      put_uint(reduced_count);
+      put(" states with a reduced set of rules.\n");
+#endif
+#if CANONICAL_CACHE
+      put("\n"
+          "\tCanonical form cache hit rate was ");
+      put_double(canonical_total.lookups == 0 ? 0
+        : 100.0 * (double)canonical_total.hits
+          / (double)canonical_total.lookups);
+      put("% (");
+      put_uint(canonical_total.hits);
+      put(" of ");
+      put_uint(canonical_total.lookups);
+      put(" lookups), and canonicalisation was skipped for ");
+      put_uint(canonical_total.skipped);
+      put(" states.\n");
+#endif
+#if LEVEL_SYNC
+      put("\n"
+          "\tStates were expanded one depth at a time, over ");
+      put_uint(level + 1);
+      put(" depths.\n");
+#endif
+      if (THREADS > 1) {
+        put("\n"
+            "\tThreads stole ");
+        put_uint(states_stolen);
+        put(" states from each other in ");
+        put_uint(steals);
+        put(" steals, with ");
+        put_uint(failed_steals);
+        put(" failed attempts.\n");
+      }
     }
 
     /* print memory usage statistics if `--trace memory_usage` is in effect */
     print_allocation_summary();
 
+#if SIZE_HINT
+    size_hint_write();
+#endif
+
     exit(status);
   } else {
     pthread_exit((void*)(intptr_t)status);
@@ -3788,6 +7404,8 @@ static void *thread_main(void *arg) {
   /* Initialize (thread-local) thread identifier. */
   thread_id = (size_t)(uintptr_t)arg;
 
+  numa_pin();
+
   set_thread_init();
 
   explore();
@@ -3839,7 +7457,23 @@ int main(void) {
   /* We don't need to read anything from stdin, so discard it. */
   (void)fclose(stdin);
 
-  sandbox();
+#if EXTERNAL_MEMORY
+  external_init();
+#endif
+
+#if CHECKPOINT || RESUME
+  checkpoint_init();
+#endif
+
+#if SIZE_HINT
+  size_hint_init();
+#endif
+
+  /* Find the machine's NUMA topology and available huge pages while we can
+   * still read these from sysfs, before entering the sandbox.
+   */
+  numa_init();
+  huge_pages_init();
 
   if (MACHINE_READABLE_OUTPUT) {
     put("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
@@ -3850,6 +7484,10 @@ int main(void) {
     put_uint(STATE_SIZE_BYTES);
     put("\" hash_table_slots=\"");
     put_uint(((size_t)1) << INITIAL_SET_SIZE_EXPONENT);
+    if (HUGE_PAGES != HUGE_PAGES_OFF) {
+      put("\" page_size=\"");
+      put_uint(huge_page_size);
+    }
     put("\"/>\n");
   } else {
     put("Memory usage:\n"
@@ -3861,10 +7499,70 @@ int main(void) {
     put(" bytes).\n"
         "\t* The size of the hash table is ");
     put_uint(((size_t)1) << INITIAL_SET_SIZE_EXPONENT);
-    put(" slots.\n"
-        "\n");
+    put(" slots.\n");
+    if (SIZE_HINT_STATES > 0 && BITSTATE_MB == 0 && !EXTERNAL_MEMORY) {
+      put("\t* The hash table is large enough for the ");
+      put_uint(SIZE_HINT_STATES);
+      put(" states of a previous run.\n");
+    }
+#if BITSTATE_MB > 0
+    put("\t* Bitstate search is in use, with ");
+    put_uint(BITSTATE_HASHES);
+    put(" bit(s) per state in a table of ");
+    put_uint((((size_t)1) << INITIAL_SET_SIZE_EXPONENT) * sizeof(slot_t)
+      * CHAR_BIT);
+    put(" bits.\n");
+#endif
+    if (EXTERNAL_MEMORY) {
+      put("\t* Seen states are stored on disk in " EXTERNAL_MEMORY_DIR ".\n");
+    }
+    if (HASH_COMPACTION_BITS > 0) {
+      put("\t* Only ");
+      put_uint(HASH_COMPACTION_BITS);
+      put(" bits of each state's hash are stored (hash compaction).\n");
+    }
+#if TREE_COMPRESSION_MB > 0
+    put("\t* States are tree compressed into ");
+    put_uint(TREE_LEAVES);
+    put(" leaf(s), with nodes in a table of ");
+    put_uint(tree_size());
+    put(" entries.\n");
+#endif
+    if (INLINE_STATES > 0) {
+      put("\t* States are stored inline in ");
+      put_uint(sizeof(slot_t));
+      put("-byte seen set slots.\n");
+    }
+    if (PROCESSES > 1) {
+      put("\t* The state space is partitioned among ");
+      put_uint(PROCESSES);
+      put(" processes.\n");
+    }
+    if (HUGE_PAGES != HUGE_PAGES_OFF) {
+      put("\t* The seen set and state arenas are backed by ");
+      put_uint(huge_page_size / 1024);
+      put("KB ");
+      put(huge_page_kind == PAGES_EXPLICIT ? "explicit huge pages.\n"
+        : huge_page_kind == PAGES_TRANSPARENT ? "transparent huge pages.\n"
+        : "pages, as huge pages are unavailable.\n");
+    }
+    if (numa_nodes > 0) {
+      put("\t* Threads are pinned to CPUs across ");
+      put_uint(numa_nodes);
+      put(" NUMA nodes.\n");
+    }
+    put("\n");
   }
 
+#if PROCESSES > 1
+  /* Start the other processes now that the above has been printed, so that
+   * only one copy of it appears.
+   */
+  dist_init();
+#endif
+
+  sandbox();
+
 #ifndef NDEBUG
   state_print_field_offsets();
 #endif
@@ -3877,11 +7575,26 @@ int main(void) {
 
   set_thread_init();
 
-  init();
+#if RESUME
+  size_t queued = resume();
+  if (THREADS > 1 && queued > 20) {
+    start_secondary_threads();
+    phase = RUN;
+  }
+#else
+  if (process_id == 0) {
+    init();
+  }
+#endif
 
-  if (!MACHINE_READABLE_OUTPUT) {
+  if (process_id == 0 && !MACHINE_READABLE_OUTPUT) {
     put("Progress Report:\n\n");
   }
 
+#if PROCESSES > 1
+  /* Make sure anything the other processes print comes after this. */
+  fflush(stdout);
+#endif
+
   explore();
 }
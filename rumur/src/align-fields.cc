@@ -0,0 +1,175 @@
+#include "align-fields.h"
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <gmpxx.h>
+#include <rumur/rumur.h>
+#include <unordered_map>
+
+using namespace rumur;
+
+// simple types this narrow are left bit-packed, on the assumption that they
+// are booleans or small enums that are better kept dense
+static const unsigned long MAX_PACKED_WIDTH = 4;
+
+/* Unused bits each type occupies beyond those needed to represent its values,
+ * keyed by the type's unique_id. Copies of a type (e.g. those reached through
+ * an ExprID) keep the unique_id of the original, so they are padded alike.
+ */
+static std::unordered_map<size_t, mpz_class> paddings;
+
+static mpz_class padding(const TypeExpr &t) {
+  auto it = paddings.find(t.unique_id);
+  if (it == paddings.end())
+    return 0;
+  return it->second;
+}
+
+static void set_padding(const TypeExpr &t, const mpz_class &p) {
+  // types synthesised after indexing have no identity to key them by
+  if (t.unique_id == SIZE_MAX)
+    return;
+  if (p == 0) {
+    paddings.erase(t.unique_id);
+  } else {
+    paddings[t.unique_id] = p;
+  }
+}
+
+// the width of a type, excluding any padding of its own
+static mpz_class natural_width(const TypeExpr &t) {
+  return layout_width(t) - padding(t);
+}
+
+mpz_class layout_width(const TypeExpr &t) {
+
+  // with nothing padded, this is the same as the type's own width
+  if (paddings.empty())
+    return t.width();
+
+  if (auto i = dynamic_cast<const TypeExprID*>(&t)) {
+    if (i->referent == nullptr)
+      return t.width();
+    return layout_width(*i->referent->value);
+  }
+
+  if (auto r = dynamic_cast<const Record*>(&t)) {
+    mpz_class s = padding(t);
+    for (const Ptr<VarDecl> &f : r->fields)
+      s += layout_width(*f->type);
+    return s;
+  }
+
+  if (auto a = dynamic_cast<const Array*>(&t)) {
+    mpz_class i = a->index_type->count();
+    assert(i >= 1 && "index count apparently does not include undefined");
+    i--;
+    return i * layout_width(*a->element_type) + padding(t);
+  }
+
+  return t.width() + padding(t);
+}
+
+mpz_class layout_size_bits(const Model &m) {
+  mpz_class s = 0;
+  for (const Ptr<Node> &c : m.children) {
+    if (auto v = dynamic_cast<const VarDecl*>(c.get()))
+      s += layout_width(*v->type);
+  }
+  return s;
+}
+
+// widen a simple type to the next byte-aligned power-of-2 width
+static void align(const TypeExpr &t) {
+
+  set_padding(t, 0);
+  mpz_class w = natural_width(t);
+
+  if (w <= MAX_PACKED_WIDTH)
+    return;
+
+  mpz_class target = 8;
+  while (target < w)
+    target *= 2;
+
+  // simple types are never read wider than 64 bits
+  if (target > 64)
+    return;
+
+  set_padding(t, target - w);
+}
+
+// a traversal that pads types
+namespace { class Aligner : public Traversal {
+
+ public:
+  // Like the field reordering traversal, we need to descend into the referents
+  // of ExprIDs and TypeExprIDs, because they can hold the only copy of a type
+  // (e.g. that of a quantified variable).
+  void visit_exprid(ExprID &n) final {
+    dispatch(*n.value);
+  }
+
+  void visit_typeexprid(TypeExprID &n) final {
+    dispatch(*n.referent);
+  }
+
+  void visit_enum(Enum &n) final {
+    align(n);
+  }
+
+  void visit_range(Range &n) final {
+    dispatch(*n.min);
+    dispatch(*n.max);
+    align(n);
+  }
+
+  void visit_scalarset(Scalarset &n) final {
+    dispatch(*n.bound);
+    align(n);
+  }
+
+  void visit_record(Record &n) final {
+
+    // first act on our children
+    for (Ptr<VarDecl> &f : n.fields)
+      dispatch(*f);
+
+    // If any field is now byte-sized, round the record up to a whole number of
+    // bytes. Field reordering places such fields first, so this keeps them
+    // aligned when this record is an array element or followed by another
+    // variable.
+    set_padding(n, 0);
+    bool has_aligned = false;
+    for (const Ptr<VarDecl> &f : n.fields) {
+      mpz_class w = layout_width(*f->type);
+      if (w > 0 && w % 8 == 0)
+        has_aligned = true;
+    }
+    mpz_class w = natural_width(n);
+    if (has_aligned && w % 8 != 0)
+      set_padding(n, 8 - w % 8);
+  }
+
+  void visit_model(Model &n) final {
+
+    // first act on our children
+    for (Ptr<Node> &c : n.children)
+      dispatch(*c);
+
+    // the offset of each variable within the model state is now inaccurate, so
+    // recalculate them
+    mpz_class offset = 0;
+    for (Ptr<Node> &c : n.children) {
+      if (auto v = dynamic_cast<VarDecl*>(c.get())) {
+        v->offset = offset;
+        offset += layout_width(*v->type);
+      }
+    }
+  }
+}; }
+
+void align_fields(Model &m) {
+  Aligner a;
+  a.dispatch(m);
+}
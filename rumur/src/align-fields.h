@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <gmpxx.h>
+#include <rumur/rumur.h>
+
+// widen variables and record fields so most of them can be accessed with
+// byte-aligned loads and stores instead of bit-level reads and writes
+void align_fields(rumur::Model &m);
+
+// the number of bits a value of this type occupies in the verifier's state,
+// including any widening by align_fields()
+mpz_class layout_width(const rumur::TypeExpr &t);
+
+// the size of the model's state in bits, including any widening by
+// align_fields()
+mpz_class layout_size_bits(const rumur::Model &m);
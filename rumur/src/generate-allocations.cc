@@ -1,3 +1,4 @@
+#include "align-fields.h"
 #include <cstddef>
 #include "generate.h"
 #include <iostream>
@@ -32,7 +33,7 @@ class Generator : public ConstTraversal {
  private:
   void define_backing_mem(size_t id, const TypeExpr *t) {
     if (t != nullptr && !t->is_simple())
-      *out << "  uint8_t ret" << id << "[BITS_TO_BYTES(" << t->width()
+      *out << "  uint8_t ret" << id << "[BITS_TO_BYTES(" << layout_width(*t)
         << ")];\n";
   }
 };
@@ -1,3 +1,4 @@
+#include "align-fields.h"
 #include <cassert>
 #include <cstddef>
 #include "generate.h"
@@ -42,16 +43,16 @@ void generate_decl(std::ostream &out, const Decl &d) {
     // If this has a valid offset, it's a state variable.
     if (v->offset >= 0) {
       out << "const struct handle ru_" << v->name << " __attribute__((unused)) "
-        << "= state_handle(s, " << v->offset << "ull, " << v->type->width()
-        << "ull)";
+        << "= state_handle(s, " << v->offset << "ull, "
+        << layout_width(*v->type) << "ull)";
 
     // Otherwise we need to allocate backing memory for it.
     } else {
       out << "uint8_t _ru_" << v->name << "[BITS_TO_BYTES("
-        << v->type->width() << ")] = { 0 };\n"
+        << layout_width(*v->type) << ")] = { 0 };\n"
         << "  const struct handle ru_" << v->name << " __attribute__((unused)) "
         << "= { .base = _ru_" << v->name << ", .offset = 0ul, .width = "
-        << v->type->width() << "ull }";
+        << layout_width(*v->type) << "ull }";
 
     }
 
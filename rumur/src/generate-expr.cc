@@ -1,3 +1,4 @@
+#include "align-fields.h"
 #include <cassert>
 #include <cstddef>
 #include "generate.h"
@@ -10,6 +11,80 @@
 
 using namespace rumur;
 
+// find the bounds of an array's index type
+static void index_bounds(const Array &a, mpz_class &min, mpz_class &max) {
+
+  const Ptr<TypeExpr> t = a.index_type->resolve();
+  assert(t != nullptr && "array with invalid index type");
+
+  if (auto r = dynamic_cast<const Range*>(t.get())) {
+    min = r->min->constant_fold();
+    max = r->max->constant_fold();
+  } else if (auto e = dynamic_cast<const Enum*>(t.get())) {
+    min = 0;
+    max = e->count() - 1;
+  } else if (auto s = dynamic_cast<const Scalarset*>(t.get())) {
+    min = 0;
+    max = s->bound->constant_fold() - 1;
+  } else {
+    assert(false && "array with invalid index type");
+  }
+}
+
+/* If this expression is a chain of field accesses and array accesses with
+ * constant indices, find the variable or alias at its root and the offset in
+ * bits of the expression's value from the start of the root.
+ */
+static bool fixed_position(const Expr &e, const ExprID *&root,
+    mpz_class &offset) {
+
+  if (auto i = dynamic_cast<const ExprID*>(&e)) {
+    if (!isa<AliasDecl>(i->value) && !isa<VarDecl>(i->value))
+      return false;
+    if (!i->is_lvalue())
+      return false;
+    root = i;
+    offset = 0;
+    return true;
+  }
+
+  if (auto f = dynamic_cast<const Field*>(&e)) {
+    if (!fixed_position(*f->record, root, offset))
+      return false;
+    const Ptr<TypeExpr> t = f->record->type()->resolve();
+    auto r = dynamic_cast<const Record*>(t.get());
+    if (r == nullptr)
+      return false;
+    for (const Ptr<VarDecl> &field : r->fields) {
+      if (field->name == f->field)
+        return true;
+      offset += layout_width(*field->type);
+    }
+    return false;
+  }
+
+  if (auto el = dynamic_cast<const Element*>(&e)) {
+    if (!el->index->constant())
+      return false;
+    if (!fixed_position(*el->array, root, offset))
+      return false;
+    const Ptr<TypeExpr> t = el->array->type()->resolve();
+    auto a = dynamic_cast<const Array*>(t.get());
+    if (a == nullptr)
+      return false;
+    mpz_class min, max;
+    index_bounds(*a, min, max);
+    // leave out-of-range indices to be diagnosed at runtime by handle_index()
+    mpz_class index = el->index->constant_fold();
+    if (index < min || index > max)
+      return false;
+    offset += (index - min) * layout_width(*a->element_type);
+    return true;
+  }
+
+  return false;
+}
+
 namespace {
 
 class Generator : public ConstExprTraversal {
@@ -33,6 +108,31 @@ class Generator : public ConstExprTraversal {
     return *this;
   }
 
+  /* Emit an expression of the given type whose position relative to its root
+   * variable is known now, so it can be accessed without computing a chain of
+   * handles at runtime. Returns false if the position is not fixed.
+   */
+  bool fixed(const Expr &e, const TypeExpr &type) {
+
+    const ExprID *root = nullptr;
+    mpz_class offset;
+    if (!fixed_position(e, root, offset))
+      return false;
+
+    if (!lvalue && type.is_simple()) {
+      const std::string lb = type.lower_bound();
+      const std::string ub = type.upper_bound();
+      *out << "handle_read_fixed(" << to_C_string(e.loc) << ", rule_name, "
+        << to_C_string(e) << ", s, " << lb << ", " << ub << ", ru_"
+        << root->id << ", " << offset << "ull, " << layout_width(type)
+        << "ull)";
+    } else {
+      *out << "handle_narrow(ru_" << root->id << ", " << offset << "ull, "
+        << layout_width(type) << "ull)";
+    }
+    return true;
+  }
+
   void visit_add(const Add &n) final {
     if (lvalue)
       invalid(n);
@@ -83,26 +183,15 @@ class Generator : public ConstExprTraversal {
     assert(t2 != nullptr && "array with invalid type");
 
     auto a = dynamic_cast<const Array&>(*t2);
-    mpz_class element_width = a.element_type->width();
+    mpz_class element_width = layout_width(*a.element_type);
 
-    // Second, determine the minimum and maximum values of the array's index type
+    if (fixed(n, *a.element_type))
+      return;
 
-    const Ptr<TypeExpr> t3 = a.index_type->resolve();
-    assert(t3 != nullptr && "array with invalid index type");
+    // Second, determine the minimum and maximum values of the array's index type
 
     mpz_class min, max;
-    if (auto r = dynamic_cast<const Range*>(t3.get())) {
-      min = r->min->constant_fold();
-      max = r->max->constant_fold();
-    } else if (auto e = dynamic_cast<const Enum*>(t3.get())) {
-      min = 0;
-      max = e->count() - 1;
-    } else if (auto s = dynamic_cast<const Scalarset*>(t3.get())) {
-      min = 0;
-      max = s->bound->constant_fold() - 1;
-    } else {
-      assert(false && "array with invalid index type");
-    }
+    index_bounds(a, min, max);
 
     if (!lvalue && a.element_type->is_simple()) {
       const std::string lb = a.element_type->lower_bound();
@@ -174,6 +263,8 @@ class Generator : public ConstExprTraversal {
       assert((!n.is_lvalue() || t != nullptr) && "lvalue without a type");
 
       if (!lvalue && n.is_lvalue() && t->is_simple()) {
+        if (fixed(n, *t))
+          return;
         const std::string lb = t->lower_bound();
         const std::string ub = t->upper_bound();
         *out << "handle_read(" << to_C_string(n.loc) << ", rule_name, "
@@ -203,6 +294,8 @@ class Generator : public ConstExprTraversal {
       mpz_class offset = 0;
       for (const Ptr<VarDecl> &f : r->fields) {
         if (f->name == n.field) {
+          if (fixed(n, *f->type))
+            return;
           if (!lvalue && f->type->is_simple()) {
             const std::string lb = f->type->lower_bound();
             const std::string ub = f->type->upper_bound();
@@ -215,12 +308,12 @@ class Generator : public ConstExprTraversal {
           } else {
             generate_rvalue(*out, *n.record);
           }
-          *out << ", " << offset << ", " << f->type->width() << ")";
+          *out << ", " << offset << ", " << layout_width(*f->type) << ")";
           if (!lvalue && f->type->is_simple())
             *out << ")";
           return;
         }
-        offset += f->type->width();
+        offset += layout_width(*f->type);
       }
       throw Error("no field named \"" + n.field + "\" in record", n.loc);
     }
@@ -340,10 +433,11 @@ class Generator : public ConstExprTraversal {
 
         if (method == 1 || method == 2 || method == 3)
           *out
-            << "uint8_t " << storage << "[BITS_TO_BYTES(" << p->width()
-              << ")] = { 0 }; "
+            << "uint8_t " << storage << "[BITS_TO_BYTES("
+              << layout_width(*p->type) << ")] = { 0 }; "
             << "struct handle " << handle << " = { .base = " << storage
-              << ", .offset = 0, .width = " << p->width() << "ull }; ";
+              << ", .offset = 0, .width = " << layout_width(*p->type)
+              << "ull }; ";
 
         if (method == 1) {
           const std::string lb = p->get_type()->lower_bound();
@@ -381,11 +475,12 @@ class Generator : public ConstExprTraversal {
             << "} ";
 
         } else if (method == 3) {
-          assert(a->type()->width() == p->width() && "complex function "
-            "parameter receiving an argument of a differing width");
+          assert(layout_width(*a->type()) == layout_width(*p->type) &&
+            "complex function parameter receiving an argument of a differing "
+            "width");
 
           *out
-            << "handle_copy(" << handle << ", ";
+            << "handle_copy(s, " << handle << ", ";
           generate_lvalue(*out, *a);
           *out << "); ";
 
@@ -401,7 +496,8 @@ class Generator : public ConstExprTraversal {
     // Pass the return type output parameter if required.
     if (return_type != nullptr && !return_type->is_simple())
       *out << ", (struct handle){ .base = ret" << n.unique_id
-        << ", .offset = 0ul, .width = " << return_type->width() << "ull }";
+        << ", .offset = 0ul, .width = " << layout_width(*return_type)
+        << "ull }";
 
     // Now emit the arguments to the function.
     {
@@ -579,6 +675,16 @@ void generate_lvalue(std::ostream &out, const Expr &e) {
   g.dispatch(e);
 }
 
+bool generate_fixed_handle(std::ostream &out, const Expr &e) {
+  const ExprID *root = nullptr;
+  mpz_class offset;
+  if (!fixed_position(e, root, offset))
+    return false;
+  out << "ru_" << root->id << ", " << offset << "ull, "
+    << layout_width(*e.type()) << "ull";
+  return true;
+}
+
 void generate_rvalue(std::ostream &out, const Expr &e) {
   Generator g(out, false);
   g.dispatch(e);
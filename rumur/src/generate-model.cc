@@ -5,6 +5,8 @@
 #include <gmpxx.h>
 #include <iostream>
 #include <memory>
+#include "options.h"
+#include "partial-order-reduction.h"
 #include <rumur/rumur.h>
 #include <string>
 #include "symmetry-reduction.h"
@@ -222,6 +224,57 @@ void generate_model(std::ostream &out, const Model &m) {
             << std::string(s->aliases.size(), '}') << "\n"
             << "}\n\n";
 
+          // write a variant of the guard for partial order reduction that
+          // tells us which of its conjuncts is false
+          if (options.partial_order_reduction) {
+            out << "static int por_guard" << rule_index
+              << "(const struct state *NONNULL s __attribute__((unused))";
+            for (const Quantifier &q : s->quantifiers)
+              out << ", struct handle ru_" << q.name
+                << " __attribute__((unused))";
+            out << ") {\n";
+
+            out << "  static const char *rule_name __attribute__((unused)) = \""
+              << "guard of rule " << rule_name_string(*s, rule_index) << "\";\n";
+
+            out
+              << "  if (JMP_BUF_NEEDED) {\n"
+              << "    if (sigsetjmp(checkpoint, 0)) {\n"
+              << "      /* this guard triggered an error */\n"
+              << "      return -1;\n"
+              << "    }\n"
+              << "  }\n";
+
+            for (const Ptr<Node> &c : m.children) {
+              if (child.get() == c.get())
+                break;
+              if (auto d = dynamic_cast<const VarDecl*>(c.get())) {
+                out << "  ";
+                generate_decl(out, *d);
+                out << ";\n";
+              }
+            }
+
+            for (const Ptr<AliasDecl> &a : s->aliases) {
+              out << "   {\n  ";
+              generate_decl(out, *a);
+              out << ";\n";
+            }
+
+            // return the (1-based) index of the first false conjunct
+            const std::vector<const Expr*> cs = guard_conjuncts(*s);
+            for (size_t i = 0; i < cs.size(); i++) {
+              out << "  if (!";
+              generate_rvalue(out, *cs[i]);
+              out << ") {\n"
+                << "    return " << (i + 1) << ";\n"
+                << "  }\n";
+            }
+            out << "  return 0;\n"
+              << std::string(s->aliases.size(), '}') << "\n"
+              << "}\n\n";
+          }
+
           // write the body
           out << "static bool rule" << rule_index << "(struct state *NONNULL s";
           for (const Quantifier &q : s->quantifiers)
@@ -537,183 +590,9 @@ void generate_model(std::ostream &out, const Model &m) {
       << "}\n\n";
   }
 
-  // Write final liveness checker, the one that runs just prior to termination
+  // Write the final liveness summary
   {
     out
-      << "static void check_liveness_final(void) {\n"
-      << "\n"
-      << "  static const char *rule_name __attribute__((unused)) = NULL;\n"
-      << "\n"
-      << "  if (!MACHINE_READABLE_OUTPUT) {\n"
-      << "    put(\"trying to prove remaining liveness constraints...\\n\");\n"
-      << "  }\n"
-      << "\n"
-      << "  /* find how many liveness bits are unknown */\n"
-      << "  unsigned long remaining = 0;\n"
-      << "  unsigned long long last_update = 0;\n"
-      << "  unsigned long learned_since_last = 0;\n"
-      << "  if (!MACHINE_READABLE_OUTPUT) {\n"
-      << "    for (size_t i = 0; i < set_size(local_seen); i++) {\n"
-      << "\n"
-      << "      slot_t slot = __atomic_load_n(&local_seen->bucket[i], __ATOMIC_SEQ_CST);\n"
-      << "\n"
-      << "      ASSERT(!slot_is_tombstone(slot)\n"
-      << "        && \"seen set being migrated during final liveness check\");\n"
-      << "\n"
-      << "      if (slot_is_empty(slot)) {\n"
-      << "        /* skip empty entries in the hash table */\n"
-      << "        continue;\n"
-      << "      }\n"
-      << "\n"
-      << "      struct state *s = slot_to_state(slot);\n"
-      << "      ASSERT(s != NULL && \"null pointer stored in state set\");\n"
-      << "\n"
-      << "      remaining += unknown_liveness(s);\n"
-      << "    }\n"
-      << "    put(\"\\t \");\n"
-      << "    put_uint(remaining);\n"
-      << "    put(\" constraints remaining\\n\");\n"
-      << "    last_update = gettime();\n"
-      << "  }\n"
-      << "\n"
-      << "  bool progress = true;\n"
-      << "  while (progress) {\n"
-      << "    progress = false;\n"
-      << "\n"
-      << "    /* Run through all seen states trying to learn new liveness information. */\n"
-      << "    for (size_t i = 0; i < set_size(local_seen); i++) {\n"
-      << "\n"
-      << "      slot_t slot = __atomic_load_n(&local_seen->bucket[i], __ATOMIC_SEQ_CST);\n"
-      << "\n"
-      << "      ASSERT(!slot_is_tombstone(slot)\n"
-      << "        && \"seen set being migrated during final liveness check\");\n"
-      << "\n"
-      << "      if (slot_is_empty(slot)) {\n"
-      << "        /* skip empty entries in the hash table */\n"
-      << "        continue;\n"
-      << "      }\n"
-      << "\n"
-      << "      struct state *s = slot_to_state(slot);\n"
-      << "      ASSERT(s != NULL && \"null pointer stored in state set\");\n"
-      << "\n"
-      << "      if (unknown_liveness(s) == 0) {\n"
-      << "        /* skip entries where liveness is fully satisfied already */\n"
-      << "        continue;\n"
-      << "      }\n"
-      << "\n"
-      << "#if BOUND > 0\n"
-      << "      /* If we're doing bounded checking and this state is at the bound limit,\n"
-      << "       * it's not valid to expand beyond this.\n"
-      << "       */\n"
-      << "      ASSERT(state_bound_get(s) <= BOUND && \"a state that exceeded the bound depth was explored\");\n"
-      << "      if (state_bound_get(s) == BOUND) {\n"
-      << "        continue;\n"
-      << "      }\n"
-      << "#endif\n"
-      << "\n";
-    size_t index = 0;
-    for (const Ptr<Node> &c : m.children) {
-      if (auto rule = dynamic_cast<const Rule*>(c.get())) {
-        const std::vector<Ptr<Rule>> rs = rule->flatten();
-        for (const Ptr<Rule> &r : rs) {
-          if (isa<SimpleRule>(r)) {
-
-            assert(index < rule_index
-              && "miscounted simple rules during model generation");
-
-            // open a scope so we do not have to think about name collisions
-            out << "      {\n";
-
-            for (const Quantifier &q : r->quantifiers)
-              generate_quantifier_header(out, q);
-
-            out
-              // use a dummy do-while to give us 'break' as a local goto
-              << "        do {\n"
-              << "          struct state *n = state_dup(s);\n"
-              << "\n"
-              << "          int g = guard" << index << "(n";
-            for (const Quantifier &q : r->quantifiers)
-              out << ", ru_" << q.name;
-            out << ");\n"
-              << "          if (g == -1) {\n"
-              << "            /* guard triggered an error */\n"
-              << "            state_free(n);\n"
-              << "            break;\n"
-              << "          } else if (g == 1) {\n"
-              << "            if (!rule" << index << "(n";
-            for (const Quantifier &q : r->quantifiers)
-              out << ", ru_" << q.name;
-            out << ")) {\n"
-              << "              /* this rule triggered an error */\n"
-              << "              state_free(n);\n"
-              << "              break;\n"
-              << "            }\n"
-              << "            state_canonicalise(n);\n"
-              << "            if (!check_assumptions(n)) {\n"
-              << "              /* assumption violated */\n"
-              << "              state_free(n);\n"
-              << "              break;\n"
-              << "            }\n"
-              << "\n"
-              << "            /* note that we can skip an invariant check because we already know it\n"
-              << "             * passed from prior expansion of this state.\n"
-              << "             */\n"
-              << "\n"
-              << "            /* We should be able to find this state in the seen set. */\n"
-              << "            const struct state *t = set_find(n);\n"
-              << "            ASSERT(t != NULL && \"state encountered during final liveness wrap up \"\n"
-              << "              \"that was not previously seen\");\n"
-              << "\n"
-              << "            /* See if this successor state learned a liveness property it never\n"
-              << "             * passed back to us. This can occur if the state our exploration\n"
-              << "             * encountered (`n`) was not the first of its kind seen and thus was\n"
-              << "             * de-duped and never made it into the seen set with a back pointer\n"
-              << "             * to `s`.\n"
-              << "             */\n"
-              << "            unsigned long learned = learn_liveness(s, t);\n"
-              << "            if (learned > 0) {\n"
-              << "              if (!MACHINE_READABLE_OUTPUT) {\n"
-              << "                learned_since_last += learned;\n"
-              << "                remaining -= learned;\n"
-              << "                unsigned long long t = gettime();\n"
-              << "                if (t > last_update) {\n"
-              << "                  put(\"\\t \");\n"
-              << "                  put_uint(learned_since_last);\n"
-              << "                  put(\" further liveness constraints proved in \");\n"
-              << "                  put_uint(t - last_update);\n"
-              << "                  put(\"s, with \");\n"
-              << "                  put(green()); put_uint(remaining); put(reset());\n"
-              << "                  put(\" remaining\\n\");\n"
-              << "                  learned_since_last = 0;\n"
-              << "                  last_update = t;\n"
-              << "                }\n"
-              << "              }\n"
-              << "              progress = true;\n"
-              << "            }\n"
-              << "          }\n"
-              << "          /* we don't need this state anymore. */\n"
-              << "          state_free(n);\n"
-              << "        } while (0);\n";
-
-            // close the quantifier loops
-            for (auto it = r->quantifiers.rbegin(); it != r->quantifiers.rend(); it++)
-              generate_quantifier_footer(out, *it);
-
-            // close this rule's scope
-            out << "}\n";
-
-            ++index;
-          }
-        }
-      }
-    }
-    out
-      << "    }\n"
-      << "  }\n"
-      << "}\n"
-      << "\n"
-      << "\n"
       << "static unsigned long check_liveness_summarise(void) {\n"
       << "\n"
       << "  /* We can now finally check whether all liveness properties were hit. */\n"
@@ -735,7 +614,7 @@ void generate_model(std::ostream &out, const Model &m) {
       << "    ASSERT(s != NULL && \"null pointer stored in state set\");\n"
       << "\n"
       << "    size_t index __attribute__((unused)) = 0;\n";
-    index = 0;
+    size_t index = 0;
     for (const Ptr<Node> &c : m.children) {
       if (auto rule = dynamic_cast<const Rule*>(c.get())) {
         const std::vector<Ptr<Rule>> rs = rule->flatten();
@@ -809,6 +688,93 @@ void generate_model(std::ostream &out, const Model &m) {
       << "\n";
   }
 
+  // Write the successor generator used by the final liveness check and by
+  // counterexample replay
+  {
+    out
+      << "#if LIVENESS_COUNT > 0 || COUNTEREXAMPLE_REPLAY\n"
+      << "static void state_successors(const struct state *NONNULL s,\n"
+      << "    void (*NONNULL visit)(const struct state *NONNULL s,\n"
+      << "      const struct state *NONNULL n, uint64_t rule_taken)) {\n"
+      << "\n"
+      << "  static const char *rule_name __attribute__((unused)) = NULL;\n"
+      << "  uint64_t rule_taken = 1;\n"
+      << "\n";
+    size_t index = 0;
+    for (const Ptr<Node> &c : m.children) {
+      if (auto rule = dynamic_cast<const Rule*>(c.get())) {
+        const std::vector<Ptr<Rule>> rs = rule->flatten();
+        for (const Ptr<Rule> &r : rs) {
+          if (isa<SimpleRule>(r)) {
+
+            assert(index < rule_index
+              && "miscounted simple rules during model generation");
+
+            // open a scope so we do not have to think about name collisions
+            out << "  {\n";
+
+            for (const Quantifier &q : r->quantifiers)
+              generate_quantifier_header(out, q);
+
+            out
+              // use a dummy do-while to give us 'break' as a local goto
+              << "    do {\n"
+              << "      int g = guard" << index << "(s";
+            for (const Quantifier &q : r->quantifiers)
+              out << ", ru_" << q.name;
+            out << ");\n"
+              << "      if (g == -1) {\n"
+              << "        /* guard triggered an error */\n"
+              << "        break;\n"
+              << "      } else if (g == 1) {\n"
+              << "        struct state *n = state_dup(s);\n"
+              << "        if (!rule" << index << "(n";
+            for (const Quantifier &q : r->quantifiers)
+              out << ", ru_" << q.name;
+            out << ")) {\n"
+              << "          /* this rule triggered an error */\n"
+              << "          state_free(n);\n"
+              << "          break;\n"
+              << "        }\n"
+              << "        state_canonicalise_successor(n, "
+                << (may_write_symmetric(m,
+                  static_cast<const SimpleRule&>(*r)) ? "true" : "false") << ");\n"
+              << "        if (!check_assumptions(n)) {\n"
+              << "          /* assumption violated */\n"
+              << "          state_free(n);\n"
+              << "          break;\n"
+              << "        }\n"
+              << "\n"
+              << "        /* note that we can skip an invariant check because the\n"
+              << "         * caller only wants successors it can find in the seen set\n"
+              << "         */\n"
+              << "\n"
+              << "        visit(s, n, rule_taken);\n"
+              << "\n"
+              << "        /* we don't need this state anymore. */\n"
+              << "        state_free(n);\n"
+              << "      }\n"
+              << "    } while (0);\n"
+              << "    rule_taken++;\n";
+
+            // close the quantifier loops
+            for (auto it = r->quantifiers.rbegin(); it != r->quantifiers.rend(); it++)
+              generate_quantifier_footer(out, *it);
+
+            // close this rule's scope
+            out << "  }\n";
+
+            ++index;
+          }
+        }
+      }
+    }
+    out
+      << "}\n"
+      << "#endif\n"
+      << "\n";
+  }
+
   // Write initialisation
   {
     out
@@ -901,6 +867,177 @@ void generate_model(std::ostream &out, const Model &m) {
     out << "}\n\n";
   }
 
+  // Write the start state generator used by counterexample replay
+  {
+    out
+      << "#if COUNTEREXAMPLE_REPLAY\n"
+      << "static void start_states(\n"
+      << "    void (*NONNULL visit)(const struct state *NONNULL n,\n"
+      << "      uint64_t rule_taken)) {\n"
+      << "  static const char *rule_name __attribute__((unused)) = NULL;\n"
+      << "  uint64_t rule_taken = 1;\n";
+
+    size_t index = 0;
+    for (const Ptr<Node> &c : m.children) {
+      if (auto rule = dynamic_cast<const Rule*>(c.get())) {
+        const std::vector<Ptr<Rule>> rs = rule->flatten();
+        for (const Ptr<Rule> &r : rs) {
+          if (isa<StartState>(r)) {
+
+            assert(index < start_index
+              && "miscounted start states during model generation");
+
+            // open a scope so we do not have to think about name collisions
+            out << "  {\n";
+
+            //  Define the state variable because the code emitted for
+            // quantifiers expects it. They do not need a non-NULL value.
+            out << "    struct state *s = NULL;\n";
+
+            // set up quantifiers
+            for (const Quantifier &q : r->quantifiers)
+              generate_quantifier_header(out, q);
+
+            out
+              // use a dummy do-while to give us 'break' as a local goto
+              << "    do {\n"
+              << "      s = state_new();\n"
+              << "      memset(s, 0, sizeof(*s));\n"
+              << "      if (!startstate" << index << "(s";
+            for (const Quantifier &q : r->quantifiers)
+              out << ", ru_" << q.name;
+            out << ")) {\n"
+              << "        /* startstate triggered an error */\n"
+              << "        state_free(s);\n"
+              << "        break;\n"
+              << "      }\n"
+              << "      state_canonicalise(s);\n"
+              << "      if (!check_assumptions(s)) {\n"
+              << "        /* assumption violated */\n"
+              << "        state_free(s);\n"
+              << "        break;\n"
+              << "      }\n"
+              << "      visit(s, rule_taken);\n"
+              << "      state_free(s);\n"
+              << "    } while (0);\n"
+              << "    rule_taken++;\n";
+
+            // close the quantifier loops
+            for (auto it = r->quantifiers.rbegin(); it != r->quantifiers.rend(); it++)
+              generate_quantifier_footer(out, *it);
+
+            // close this startstate's scope
+            out << "  }\n";
+
+            ++index;
+          }
+        }
+      }
+    }
+    out
+      << "}\n"
+      << "#endif\n"
+      << "\n";
+  }
+
+  // Write the partial order reduction tables
+  generate_por(m, out);
+
+  // Write the insertion of a batch of successor states
+  {
+    out
+      << "/* Insert the pending successor states into the seen set, queueing those\n"
+      << " * that are new.\n"
+      << " */\n"
+      << "static void explore_flush(size_t *NONNULL last_queue_size,\n"
+      << "    size_t *NONNULL queue_id) {\n"
+      << "\n"
+      << "  /* Start fetching the parts of the seen set we are about to look at. */\n"
+      << "  size_t hashes[SUCCESSOR_BATCH];\n"
+      << "  set_prefetch(successors, successor_count, hashes);\n"
+      << "\n"
+      << "  for (size_t i = 0; i < successor_count; i++) {\n"
+      << "    struct state *n = &successors[i];\n"
+      << "    do {\n"
+      << "      size_t size;\n"
+      << "      if (set_insert_hashed(&n, hashes[i], true, &size)) {\n"
+      << "\n"
+      << "        if (!check_covers(n)) {\n"
+      << "          /* one of the cover properties triggered an error */\n"
+      << "          break;\n"
+      << "        }\n"
+      << "#if LIVENESS_COUNT > 0\n"
+      << "        if (!check_liveness(n)) {\n"
+      << "          /* one of the liveness properties triggered an error */\n"
+      << "          break;\n"
+      << "        }\n"
+      << "#endif\n"
+      << "\n"
+      << "#if BOUND > 0\n"
+      << "        if (state_bound_get(n) < BOUND) {\n"
+      << "#endif\n"
+      << "#if LEVEL_SYNC\n"
+      << "        /* hold this state back until the current depth is finished */\n"
+      << "        size_t queue_size = level_defer(n);\n"
+      << "#else\n"
+      << "        size_t queue_size = queue_enqueue(n, thread_id);\n"
+      << "#endif\n"
+      << "        *queue_id = thread_id;\n"
+      << "\n"
+      << "        if (process_id == 0 && size % 10000 == 0 && ftrylockfile(stdout) == 0) {\n"
+      << "          if (MACHINE_READABLE_OUTPUT) {\n"
+      << "            put(\"<progress states=\\\"\");\n"
+      << "            put_uint(size);\n"
+      << "            put(\"\\\" duration_seconds=\\\"\");\n"
+      << "            put_uint(gettime());\n"
+      << "            put(\"\\\" rules_fired=\\\"\");\n"
+      << "            put_uint(rules_fired_local);\n"
+      << "            put(\"\\\" queue_size=\\\"\");\n"
+      << "            put_uint(queue_size);\n"
+      << "            put(\"\\\" thread_id=\\\"\");\n"
+      << "            put_uint(thread_id);\n"
+      << "            put(\"\\\"/>\\n\");\n"
+      << "          } else {\n"
+      << "            put(\"\\t \");\n"
+      << "            if (THREADS > 1) {\n"
+      << "              put(\"thread \");\n"
+      << "              put_uint(thread_id);\n"
+      << "              put(\": \");\n"
+      << "            }\n"
+      << "            put_uint(size);\n"
+      << "            put(\" states explored in \");\n"
+      << "            put_uint(gettime());\n"
+      << "            put(\"s, with \");\n"
+      << "            put_uint(rules_fired_local);\n"
+      << "            put(\" rules fired and \");\n"
+      << "            put(queue_size > *last_queue_size ? yellow() : green());\n"
+      << "            put_uint(queue_size);\n"
+      << "            put(reset());\n"
+      << "            put(\" states in the queue.\\n\");\n"
+      << "          }\n"
+      << "          funlockfile(stdout);\n"
+      << "          *last_queue_size = queue_size;\n"
+      << "        }\n"
+      << "\n"
+      << "        if (THREADS > 1 && thread_id == 0 && phase == WARMUP && queue_size > 20) {\n"
+      << "          start_secondary_threads();\n"
+      << "          phase = RUN;\n"
+      << "        }\n"
+      << "\n"
+      << "#if BOUND > 0\n"
+      << "        }\n"
+      << "#endif\n"
+      << "      } else {\n"
+      << "#if PARTIAL_ORDER_REDUCTION\n"
+      << "        por_revisited = true;\n"
+      << "#endif\n"
+      << "      }\n"
+      << "    } while (0);\n"
+      << "  }\n"
+      << "  successor_count = 0;\n"
+      << "}\n\n";
+  }
+
   // Write exploration logic
   {
     out
@@ -927,7 +1064,19 @@ void generate_model(std::ostream &out, const Model &m) {
       << "      break;\n"
       << "    }\n"
       << "\n"
+      << "#if CHECKPOINT\n"
+      << "    checkpoint_poll(s);\n"
+      << "#endif\n"
+      << "#if COUNTEREXAMPLE_REPLAY\n"
+      << "    trace_expanding = s;\n"
+      << "#endif\n"
+      << "\n"
       << "    bool possible_deadlock = true;\n"
+      << "#if PARTIAL_ORDER_REDUCTION\n"
+      << "    bool reduced = por_select(s);\n"
+      << "    por_revisited = false;\n"
+      << "  por_again:;\n"
+      << "#endif\n"
       << "    uint64_t rule_taken = 1;\n";
     size_t index = 0;
     for (const Ptr<Node> &c : m.children) {
@@ -948,110 +1097,63 @@ void generate_model(std::ostream &out, const Model &m) {
             out
               // use a dummy do-while to give us 'break' as a local goto
               << "      do {\n"
-              << "        struct state *n = state_dup(s);\n"
-              << "#if COUNTEREXAMPLE_TRACE != CEX_OFF\n"
-              << "        state_rule_taken_set(n, rule_taken);\n"
+              << "#if PARTIAL_ORDER_REDUCTION\n"
+              << "        if (!por_fire[rule_taken - 1]) {\n"
+              << "          break;\n"
+              << "        }\n"
               << "#endif\n"
-              << "        int g = guard" << index << "(n";
+              << "        /* Evaluate the guard against the state being expanded, so\n"
+              << "         * we only need to copy it for rules that are enabled. With\n"
+              << "         * partial order reduction, the guard was already evaluated\n"
+              << "         * when selecting which rules to fire.\n"
+              << "         */\n"
+              << "        int g = 1;\n"
+              << "        if (!PARTIAL_ORDER_REDUCTION) {\n"
+              << "          guard_enter(rule_taken);\n"
+              << "          g = guard" << index << "(s";
             for (const Quantifier &q : r->quantifiers)
               out << ", ru_" << q.name;
             out << ");\n"
+              << "          guard_leave();\n"
+              << "        }\n"
               << "        if (g == -1) {\n"
               << "          /* error() was called */\n"
-              << "          state_free(n);\n"
               << "          break;\n"
               << "        } else if (g == 1) {\n"
+              << "          struct state *n = &successors[successor_count];\n"
+              << "          state_dup_into(n, s);\n"
+              << "#if COUNTEREXAMPLE_TRACE != CEX_OFF\n"
+              << "          state_rule_taken_set(n, rule_taken);\n"
+              << "#endif\n"
               << "          if (!rule" << index << "(n";
             for (const Quantifier &q : r->quantifiers)
               out << ", ru_" << q.name;
             out << ")) {\n"
               << "            /* this rule triggered an error */\n"
-              << "            state_free(n);\n"
               << "            break;\n"
               << "          }\n"
               << "          rules_fired_local++;\n"
               << "          if (DEADLOCK_DETECTION != DEADLOCK_DETECTION_STUTTERING || !state_eq(s, n)) {\n"
               << "            possible_deadlock = false;\n"
               << "          }\n"
-              << "          state_canonicalise(n);\n"
+              << "          state_canonicalise_successor(n, "
+                << (may_write_symmetric(m,
+                  static_cast<const SimpleRule&>(*r)) ? "true" : "false") << ");\n"
               << "          if (!check_assumptions(n)) {\n"
               << "            /* assumption violated */\n"
-              << "            state_free(n);\n"
               << "            break;\n"
               << "          }\n"
               << "          if (!check_invariants(n)) {\n"
               << "            /* invariant violated */\n"
-              << "            state_free(n);\n"
               << "            break;\n"
               << "          }\n"
-              << "          size_t size;\n"
-              << "          if (set_insert(n, &size)) {\n"
-              << "\n"
-              << "            if (!check_covers(n)) {\n"
-              << "              /* one of the cover properties triggered an error */\n"
-              << "              break;\n"
-              << "            }\n"
-              << "#if LIVENESS_COUNT > 0\n"
-              << "            if (!check_liveness(n)) {\n"
-              << "              /* one of the liveness properties triggered an error */\n"
-              << "              break;\n"
-              << "            }\n"
-              << "#endif\n"
-              << "\n"
-              << "#if BOUND > 0\n"
-              << "            if (state_bound_get(n) < BOUND) {\n"
-              << "#endif\n"
-              << "            size_t queue_size = queue_enqueue(n, thread_id);\n"
-              << "            queue_id = thread_id;\n"
-              << "\n"
-              << "            if (size % 10000 == 0 && ftrylockfile(stdout) == 0) {\n"
-              << "              if (MACHINE_READABLE_OUTPUT) {\n"
-              << "                put(\"<progress states=\\\"\");\n"
-              << "                put_uint(size);\n"
-              << "                put(\"\\\" duration_seconds=\\\"\");\n"
-              << "                put_uint(gettime());\n"
-              << "                put(\"\\\" rules_fired=\\\"\");\n"
-              << "                put_uint(rules_fired_local);\n"
-              << "                put(\"\\\" queue_size=\\\"\");\n"
-              << "                put_uint(queue_size);\n"
-              << "                put(\"\\\" thread_id=\\\"\");\n"
-              << "                put_uint(thread_id);\n"
-              << "                put(\"\\\"/>\\n\");\n"
-              << "              } else {\n"
-              << "                put(\"\\t \");\n"
-              << "                if (THREADS > 1) {\n"
-              << "                  put(\"thread \");\n"
-              << "                  put_uint(thread_id);\n"
-              << "                  put(\": \");\n"
-              << "                }\n"
-              << "                put_uint(size);\n"
-              << "                put(\" states explored in \");\n"
-              << "                put_uint(gettime());\n"
-              << "                put(\"s, with \");\n"
-              << "                put_uint(rules_fired_local);\n"
-              << "                put(\" rules fired and \");\n"
-              << "                put(queue_size > last_queue_size ? yellow() : green());\n"
-              << "                put_uint(queue_size);\n"
-              << "                put(reset());\n"
-              << "                put(\" states in the queue.\\n\");\n"
-              << "              }\n"
-              << "              funlockfile(stdout);\n"
-              << "              last_queue_size = queue_size;\n"
-              << "            }\n"
-              << "\n"
-              << "            if (THREADS > 1 && thread_id == 0 && phase == WARMUP && queue_size > 20) {\n"
-              << "              start_secondary_threads();\n"
-              << "              phase = RUN;\n"
-              << "            }\n"
-              << "\n"
-              << "#if BOUND > 0\n"
-              << "            }\n"
-              << "#endif\n"
-              << "          } else {\n"
-              << "            state_free(n);\n"
+              << "          /* Defer insertion into the seen set until we have a batch\n"
+              << "           * of successors, to overlap their cache misses.\n"
+              << "           */\n"
+              << "          successor_count++;\n"
+              << "          if (successor_count == SUCCESSOR_BATCH) {\n"
+              << "            explore_flush(&last_queue_size, &queue_id);\n"
               << "          }\n"
-              << "        } else {\n"
-              << "          state_free(n);\n"
               << "        }\n"
               << "      } while (0);\n"
               << "      rule_taken++;\n";
@@ -1069,6 +1171,26 @@ void generate_model(std::ostream &out, const Model &m) {
       }
     }
     out
+      << "    explore_flush(&last_queue_size, &queue_id);\n"
+      << "\n"
+      << "#if PARTIAL_ORDER_REDUCTION\n"
+      << "    if (reduced) {\n"
+      << "      /* If one of the successors we generated had already been seen,\n"
+      << "       * the rules we skipped could be postponed forever around a cycle\n"
+      << "       * (the cycle proviso). If none of the rules we fired changed the\n"
+      << "       * state, we cannot tell a deadlock from the ones we skipped. In\n"
+      << "       * either case, fire the rest.\n"
+      << "       */\n"
+      << "      if (por_revisited || (DEADLOCK_DETECTION ==\n"
+      << "          DEADLOCK_DETECTION_STUTTERING && possible_deadlock)) {\n"
+      << "        por_expand();\n"
+      << "        reduced = false;\n"
+      << "        goto por_again;\n"
+      << "      }\n"
+      << "      por_reduced_local++;\n"
+      << "    }\n"
+      << "#endif\n"
+      << "\n"
       << "    /* If we did not toggle 'possible_deadlock' off by this point, we\n"
       << "     * have a deadlock.\n"
       << "     */\n"
@@ -1076,6 +1198,11 @@ void generate_model(std::ostream &out, const Model &m) {
       << "      deadlock(s);\n"
       << "    }\n"
       << "\n"
+      << "#if !SEEN_SET_RETAINS_STATES\n"
+      << "    /* Nothing refers to this state now that it has been expanded. */\n"
+      << "    state_free(state_drop_const(s));\n"
+      << "#endif\n"
+      << "\n"
       << "  }\n"
       << "  exit_with(EXIT_SUCCESS);\n"
       << "}\n\n";
@@ -1103,18 +1230,19 @@ void generate_model(std::ostream &out, const Model &m) {
 
   // Write a function to print state transitions.
   out
-    << "static void print_transition(const struct state *NONNULL s "
-      << "__attribute__((unused))) {\n"
+    << "static void print_transition(const struct state *previous "
+      << "__attribute__((unused)), const struct state *NONNULL s "
+      << "__attribute__((unused)), uint64_t taken __attribute__((unused))) {\n"
     << "  ASSERT(s != NULL);\n"
     << "  static const char *rule_name __attribute__((unused)) = NULL;\n"
     << "#if COUNTEREXAMPLE_TRACE != CEX_OFF\n"
     << "\n"
-    << "  ASSERT(state_rule_taken_get(s) != 0 && \"unknown state transition\");\n"
+    << "  ASSERT(taken != 0 && \"unknown state transition\");\n"
     << "\n";
 
   {
     out
-      << "  if (state_previous_get(s) == NULL) {\n"
+      << "  if (previous == NULL) {\n"
       << "    uint64_t rule_taken = 1;\n";
 
     mpz_class base = 1;
@@ -1135,7 +1263,7 @@ void generate_model(std::ostream &out, const Model &m) {
               generate_quantifier_header(out, q);
 
             out
-              << "  if (state_rule_taken_get(s) == rule_taken) {\n"
+              << "  if (taken == rule_taken) {\n"
               << "    if (MACHINE_READABLE_OUTPUT) {\n"
               << "      put(\"<transition>\");\n"
               << "      xml_printf(\"Startstate "
@@ -1284,7 +1412,7 @@ void generate_model(std::ostream &out, const Model &m) {
               generate_quantifier_header(out, q);
 
             out
-              << "  if (state_rule_taken_get(s) == rule_taken) {\n"
+              << "  if (taken == rule_taken) {\n"
               << "    if (MACHINE_READABLE_OUTPUT) {\n"
               << "      put(\"<transition>\");\n"
               << "      xml_printf(\"Rule " << rule_name_string(*r, index)
@@ -1365,7 +1493,7 @@ void generate_model(std::ostream &out, const Model &m) {
                       << "        if (USE_SCALARSET_SCHEDULES) {\n"
                       // note that we read from the *previous* state’s schedule here
                       // because that is what this value is relative to
-                      << "          size_t index = schedule_read_" << id->name << "(state_previous_get(s));\n"
+                      << "          size_t index = schedule_read_" << id->name << "(previous);\n"
                       << "          size_t stack[" << b << "];\n"
                       << "          index_to_permutation(index, schedule, stack, " << b << ");\n"
                       << "        }\n";
@@ -1440,7 +1568,7 @@ void generate_model(std::ostream &out, const Model &m) {
     << "  }\n"
     << "\n"
     << "  /* give some helpful output for debugging problems with this function. */\n"
-    << "  fprintf(stderr, \"no rule found to link to state at depth %zu\\n\", state_depth(s));\n"
+    << "  fprintf(stderr, \"no rule found to link to state via rule %\" PRIu64 \"\\n\", taken);\n"
     << "  ASSERT(!\"unreachable\");\n"
     << "#endif\n"
     << "}\n\n";
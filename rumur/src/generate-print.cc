@@ -1,3 +1,4 @@
+#include "align-fields.h"
 #include <cassert>
 #include <cstddef>
 #include "../../common/escape.h"
@@ -147,7 +148,7 @@ class Generator : public ConstTypeTraversal {
       p << "]";
 
       // construct a dynamic handle to the current element
-      mpz_class w = n.element_type->width();
+      mpz_class w = layout_width(*n.element_type);
       const std::string o = "(" + i + " * ((size_t)" + w.get_str() + "ull))";
       const std::string h = derive_handle(current_handle, o, w);
       const std::string ph = derive_handle(previous_handle, o, w);
@@ -288,7 +289,7 @@ class Generator : public ConstTypeTraversal {
       p << "]";
 
       // construct a dynamic handle to the current element
-      mpz_class w = n.element_type->width();
+      mpz_class w = layout_width(*n.element_type);
       const std::string o = "(" + j + " * ((size_t)" + w.get_str() + "ull))";
       const std::string h = derive_handle(current_handle, o, w);
 
@@ -315,7 +316,7 @@ class Generator : public ConstTypeTraversal {
     if (auto e = dynamic_cast<const Enum*>(t.get())) {
 
       mpz_class preceding_offset = 0;
-      mpz_class w = n.element_type->width();
+      mpz_class w = layout_width(*n.element_type);
       for (const std::pair<std::string, location> &m : e->members) {
         Printf p = prefix;
         p << "[" << m.first << "]";
@@ -414,7 +415,7 @@ class Generator : public ConstTypeTraversal {
   void visit_record(const Record &n) final {
     mpz_class preceding_offset = 0;
     for (auto &f : n.fields) {
-      mpz_class w = f->width();
+      mpz_class w = layout_width(*f->type);
       Printf p = prefix;
       p << "." << f->name;
       const std::string h = derive_handle(current_handle, preceding_offset, w);
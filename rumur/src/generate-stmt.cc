@@ -1,3 +1,4 @@
+#include "align-fields.h"
 #include <cassert>
 #include <cstddef>
 #include "../../common/escape.h"
@@ -21,7 +22,7 @@ static void clear(std::ostream &out, const TypeExpr &t,
     out << indent << "handle_write_raw(s, (struct handle){ .base = root.base + "
       << "(root.offset + " << offset << ") / CHAR_BIT, .offset = "
       << "(root.offset + " << offset << ") % CHAR_BIT, .width = "
-      << t.width() << "ull }, 1);\n";
+      << layout_width(t) << "ull }, 1);\n";
 
     return;
   }
@@ -36,7 +37,7 @@ static void clear(std::ostream &out, const TypeExpr &t,
 
     // The bit size of each array element as a C code string
     const std::string width = "((size_t)" +
-      a->element_type->width().get_str() + "ull)";
+      layout_width(*a->element_type).get_str() + "ull)";
 
     // Generate a loop to iterate over all the elements
     const std::string var = "i" + std::to_string(depth);
@@ -63,7 +64,7 @@ static void clear(std::ostream &out, const TypeExpr &t,
       clear(out, *f->type, off, depth);
 
       // Jump over this field to get the offset of the next field
-      const std::string width = "((size_t)" + f->type->width().get_str()
+      const std::string width = "((size_t)" + layout_width(*f->type).get_str()
         + "ull)";
       off += " + " + width;
     }
@@ -108,15 +109,22 @@ class Generator : public ConstStmtTraversal {
       const std::string lb = s.lhs->type()->lower_bound();
       const std::string ub = s.lhs->type()->upper_bound();
 
-      *out << "handle_write(" << to_C_string(s.loc) << ", rule_name, "
-        << to_C_string(*s.lhs) << ", s, " << lb << ", " << ub << ", ";
-      generate_lvalue(*out, *s.lhs);
-      *out << ", ";
+      std::ostringstream fixed;
+      if (generate_fixed_handle(fixed, *s.lhs)) {
+        *out << "handle_write_fixed(" << to_C_string(s.loc) << ", rule_name, "
+          << to_C_string(*s.lhs) << ", s, " << lb << ", " << ub << ", "
+          << fixed.str() << ", ";
+      } else {
+        *out << "handle_write(" << to_C_string(s.loc) << ", rule_name, "
+          << to_C_string(*s.lhs) << ", s, " << lb << ", " << ub << ", ";
+        generate_lvalue(*out, *s.lhs);
+        *out << ", ";
+      }
       generate_rvalue(*out, *s.rhs);
       *out << ")";
 
     } else {
-      *out << "handle_copy(";
+      *out << "handle_copy(s, ";
       generate_lvalue(*out, *s.lhs);
       *out << ", ";
       generate_rvalue(*out, *s.rhs);
@@ -316,7 +324,7 @@ class Generator : public ConstStmtTraversal {
          */
         *out
           << "do {\n"
-          << "  handle_copy(ret, ";
+          << "  handle_copy(s, ret, ";
         generate_rvalue(*out, *s.expr);
         *out << ");\n"
           << "  return ret;\n"
@@ -367,7 +375,7 @@ class Generator : public ConstStmtTraversal {
   }
 
   void visit_undefine(const Undefine &s) final {
-    *out << "handle_zero(";
+    *out << "handle_zero(s, ";
     generate_lvalue(*out, *s.rhs);
     *out << ")";
   }
@@ -37,6 +37,11 @@ void generate_property(std::ostream &out, const rumur::Property &p);
 void generate_lvalue(std::ostream &out, const rumur::Expr &e);
 void generate_rvalue(std::ostream &out, const rumur::Expr &e);
 
+// If the given lvalue is at a fixed position relative to the variable or alias
+// it is rooted at, generate "<root handle>, <offset>, <width>" as arguments to
+// handle_read_fixed() or handle_write_fixed() and return true
+bool generate_fixed_handle(std::ostream &out, const rumur::Expr &e);
+
 void generate_quantifier_header(std::ostream &out, const rumur::Quantifier &q);
 void generate_quantifier_footer(std::ostream &out, const rumur::Quantifier &q);
 
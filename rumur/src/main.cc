@@ -1,3 +1,4 @@
+#include "align-fields.h"
 #include <algorithm>
 #include <cassert>
 #include <cstddef>
@@ -28,6 +29,7 @@
 #include <utility>
 #include "utils.h"
 #include "ValueType.h"
+#include <vector>
 
 using namespace rumur;
 
@@ -46,22 +48,52 @@ static unsigned string_to_percentage(const std::string &s) {
   return (unsigned)p;
 }
 
+// the option selecting an alternative representation of the seen set that
+// does not retain states, or nullptr if the default representation is in use
+static const char *seen_set_option() {
+  if (options.bitstate > 0)
+    return "--bitstate";
+  if (options.external_memory != "")
+    return "--external-memory";
+  if (options.hash_compaction > 0)
+    return "--hash-compaction";
+  if (options.tree_compression > 0)
+    return "--tree-compression";
+  return nullptr;
+}
+
 static void parse_args(int argc, char **argv) {
 
   for (;;) {
     enum {
-      OPT_BOUND = 128,
+      OPT_BITSTATE = 128,
+      OPT_BOUND,
+      OPT_CACHE_HASH,
+      OPT_CANONICAL_CACHE,
+      OPT_CHECKPOINT,
+      OPT_CHECKPOINT_EVERY,
       OPT_COLOUR,
+      OPT_COUNTEREXAMPLE_REPLAY,
       OPT_COUNTEREXAMPLE_TRACE,
       OPT_DEADLOCK_DETECTION,
+      OPT_EXTERNAL_MEMORY,
+      OPT_HASH_COMPACTION,
+      OPT_HUGE_PAGES,
+      OPT_INCREMENTAL_HASH,
       OPT_MAX_ERRORS,
+      OPT_MINIMAL_TRACES,
       OPT_MONOPOLISE,
+      OPT_NUMA,
       OPT_OUTPUT_FORMAT,
       OPT_PACK_STATE,
+      OPT_PARTIAL_ORDER_REDUCTION,
       OPT_POINTER_BITS,
+      OPT_PROCESSES,
       OPT_REORDER_FIELDS,
+      OPT_RESUME,
       OPT_SANDBOX,
       OPT_SCALARSET_SCHEDULES,
+      OPT_SIZE_HINT,
       OPT_SMT_ARG,
       OPT_SMT_BITVECTORS,
       OPT_SMT_BUDGET,
@@ -69,33 +101,52 @@ static void parse_args(int argc, char **argv) {
       OPT_SMT_PATH,
       OPT_SMT_PRELUDE,
       OPT_SMT_SIMPLIFICATION,
+      OPT_STATE_LAYOUT,
       OPT_SYMMETRY_REDUCTION,
       OPT_TRACE,
+      OPT_TREE_COMPRESSION,
       OPT_VALUE_TYPE,
       OPT_VERSION,
     };
 
     static struct option opts[] = {
+      { "bitstate", required_argument, 0, OPT_BITSTATE },
       { "bound", required_argument, 0, OPT_BOUND },
+      { "cache-hash", required_argument, 0, OPT_CACHE_HASH },
+      { "canonical-cache", required_argument, 0, OPT_CANONICAL_CACHE },
+      { "checkpoint", required_argument, 0, OPT_CHECKPOINT },
+      { "checkpoint-every", required_argument, 0, OPT_CHECKPOINT_EVERY },
       { "color", required_argument, 0, OPT_COLOUR },
       { "colour", required_argument, 0, OPT_COLOUR },
+      { "counterexample-replay", required_argument, 0, OPT_COUNTEREXAMPLE_REPLAY },
       { "counterexample-trace", required_argument, 0, OPT_COUNTEREXAMPLE_TRACE },
       { "deadlock-detection", required_argument, 0, OPT_DEADLOCK_DETECTION },
       { "debug", no_argument, 0, 'd' },
+      { "external-memory", required_argument, 0, OPT_EXTERNAL_MEMORY },
+      { "hash-compaction", required_argument, 0, OPT_HASH_COMPACTION },
       { "help", no_argument, 0, 'h' },
+      { "huge-pages", required_argument, 0, OPT_HUGE_PAGES },
+      { "incremental-hash", required_argument, 0, OPT_INCREMENTAL_HASH },
       { "max-errors", required_argument, 0, OPT_MAX_ERRORS },
+      { "minimal-traces", required_argument, 0, OPT_MINIMAL_TRACES },
       { "monopolise", no_argument, 0, OPT_MONOPOLISE },
       { "monopolize", no_argument, 0, OPT_MONOPOLISE },
+      { "numa", required_argument, 0, OPT_NUMA },
       { "output", required_argument, 0, 'o' },
       { "output-format", required_argument, 0, OPT_OUTPUT_FORMAT },
       { "pack-state", required_argument, 0, OPT_PACK_STATE },
+      { "partial-order-reduction", required_argument, 0,
+        OPT_PARTIAL_ORDER_REDUCTION },
       { "pointer-bits", required_argument, 0, OPT_POINTER_BITS },
+      { "processes", required_argument, 0, OPT_PROCESSES },
       { "quiet", no_argument, 0, 'q' },
       { "reorder-fields", required_argument, 0, OPT_REORDER_FIELDS },
+      { "resume", required_argument, 0, OPT_RESUME },
       { "sandbox", required_argument, 0, OPT_SANDBOX },
       { "scalarset-schedules", required_argument, 0, OPT_SCALARSET_SCHEDULES },
       { "set-capacity", required_argument, 0, 's' },
       { "set-expand-threshold", required_argument, 0, 'e' },
+      { "size-hint", required_argument, 0, OPT_SIZE_HINT },
       { "smt-arg", required_argument, 0, OPT_SMT_ARG },
       { "smt-bitvectors", required_argument, 0, OPT_SMT_BITVECTORS },
       { "smt-budget", required_argument, 0, OPT_SMT_BUDGET },
@@ -103,9 +154,11 @@ static void parse_args(int argc, char **argv) {
       { "smt-path", required_argument, 0, OPT_SMT_PATH },
       { "smt-prelude", required_argument, 0, OPT_SMT_PRELUDE },
       { "smt-simplification", required_argument, 0, OPT_SMT_SIMPLIFICATION },
+      { "state-layout", required_argument, 0, OPT_STATE_LAYOUT },
       { "symmetry-reduction", required_argument, 0, OPT_SYMMETRY_REDUCTION },
       { "threads", required_argument, 0, 't' },
       { "trace", required_argument, 0, OPT_TRACE },
+      { "tree-compression", required_argument, 0, OPT_TREE_COMPRESSION },
       { "value-type", required_argument, 0, OPT_VALUE_TYPE },
       { "verbose", no_argument, 0, 'v' },
       { "version", no_argument, 0, OPT_VERSION },
@@ -252,6 +305,112 @@ static void parse_args(int argc, char **argv) {
         }
         break;
 
+      case OPT_EXTERNAL_MEMORY: { // --external-memory ...
+        if (strcmp(optarg, "off") == 0) {
+          options.external_memory = "";
+          break;
+        }
+        struct stat buf;
+        if (stat(optarg, &buf) < 0 || !S_ISDIR(buf.st_mode)) {
+          std::cerr << "invalid --external-memory argument \"" << optarg
+            << "\": not a directory\n";
+          exit(EXIT_FAILURE);
+        }
+        options.external_memory = optarg;
+        break;
+      }
+
+      case OPT_CHECKPOINT: // --checkpoint ...
+        if (strcmp(optarg, "off") == 0) {
+          options.checkpoint = "";
+        } else {
+          options.checkpoint = optarg;
+        }
+        break;
+
+      case OPT_CHECKPOINT_EVERY: { // --checkpoint-every ...
+        bool valid = true;
+        try {
+          options.checkpoint_every = optarg;
+          if (options.checkpoint_every < 0)
+            valid = false;
+        } catch (std::invalid_argument&) {
+          valid = false;
+        }
+        if (!valid) {
+          std::cerr << "invalid --checkpoint-every argument \"" << optarg
+            << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+
+      case OPT_PROCESSES: { // --processes ...
+        bool valid = true;
+        try {
+          options.processes = optarg;
+          if (options.processes < 1)
+            valid = false;
+        } catch (std::invalid_argument&) {
+          valid = false;
+        }
+        if (!valid) {
+          std::cerr << "invalid --processes argument \"" << optarg << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+
+      case OPT_RESUME: { // --resume ...
+        if (strcmp(optarg, "off") == 0) {
+          options.resume = "";
+          break;
+        }
+        struct stat buf;
+        if (stat(optarg, &buf) < 0 || !S_ISREG(buf.st_mode)) {
+          std::cerr << "invalid --resume argument \"" << optarg
+            << "\": not a file\n";
+          exit(EXIT_FAILURE);
+        }
+        options.resume = optarg;
+        break;
+      }
+
+      case OPT_SIZE_HINT: // --size-hint ...
+        if (strcmp(optarg, "off") == 0) {
+          options.size_hint = "";
+        } else {
+          options.size_hint = optarg;
+        }
+        break;
+
+      case OPT_HASH_COMPACTION: { // --hash-compaction ...
+        if (strcmp(optarg, "off") == 0) {
+          options.hash_compaction = 0;
+          break;
+        }
+        bool valid = true;
+        try {
+          options.hash_compaction = optarg;
+          if (options.hash_compaction > 64)
+            valid = false;
+        } catch (std::invalid_argument&) {
+          valid = false;
+        }
+        if (!valid) {
+          std::cerr << "invalid --hash-compaction argument \"" << optarg << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        // below this, the chance of two states sharing a fingerprint grows too
+        // quickly for the search to be useful
+        if (options.hash_compaction < 40) {
+          std::cerr << "--hash-compaction argument \"" << optarg << "\" is too "
+            << "small; fingerprints must be between 40 and 64 bits\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+
       case OPT_MONOPOLISE: { // --monopolise
 
         long pagesize = sysconf(_SC_PAGESIZE);
@@ -278,6 +437,78 @@ static void parse_args(int argc, char **argv) {
         break;
       }
 
+      case OPT_HUGE_PAGES: // --huge-pages ...
+        if (strcmp(optarg, "off") == 0) {
+          options.huge_pages = HugePages::OFF;
+        } else if (strcmp(optarg, "transparent") == 0) {
+          options.huge_pages = HugePages::TRANSPARENT;
+        } else if (strcmp(optarg, "explicit") == 0) {
+          options.huge_pages = HugePages::EXPLICIT;
+        } else {
+          std::cerr << "invalid argument to --huge-pages, \"" << optarg
+            << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case OPT_NUMA: // --numa ...
+        if (strcmp(optarg, "on") == 0) {
+          options.numa = true;
+        } else if (strcmp(optarg, "off") == 0) {
+          options.numa = false;
+        } else {
+          std::cerr << "invalid argument to --numa, \"" << optarg << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case OPT_MINIMAL_TRACES: // --minimal-traces ...
+        if (strcmp(optarg, "on") == 0) {
+          options.minimal_traces = true;
+        } else if (strcmp(optarg, "off") == 0) {
+          options.minimal_traces = false;
+        } else {
+          std::cerr << "invalid argument to --minimal-traces, \"" << optarg
+            << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case OPT_CACHE_HASH: // --cache-hash ...
+        if (strcmp(optarg, "on") == 0) {
+          options.cache_hash = true;
+        } else if (strcmp(optarg, "off") == 0) {
+          options.cache_hash = false;
+        } else {
+          std::cerr << "invalid argument to --cache-hash, \"" << optarg << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case OPT_CANONICAL_CACHE: // --canonical-cache ...
+        if (strcmp(optarg, "on") == 0) {
+          options.canonical_cache = true;
+        } else if (strcmp(optarg, "off") == 0) {
+          options.canonical_cache = false;
+        } else {
+          std::cerr << "invalid argument to --canonical-cache, \"" << optarg
+            << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case OPT_INCREMENTAL_HASH: // --incremental-hash ...
+        if (strcmp(optarg, "on") == 0) {
+          options.incremental_hash = true;
+        } else if (strcmp(optarg, "off") == 0) {
+          options.incremental_hash = false;
+        } else {
+          std::cerr << "invalid argument to --incremental-hash, \"" << optarg
+            << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
       case OPT_PACK_STATE: // --pack-state ...
         if (strcmp(optarg, "on") == 0) {
           options.pack_state = true;
@@ -289,6 +520,18 @@ static void parse_args(int argc, char **argv) {
         }
         break;
 
+      case OPT_PARTIAL_ORDER_REDUCTION: // --partial-order-reduction ...
+        if (strcmp(optarg, "on") == 0) {
+          options.partial_order_reduction = true;
+        } else if (strcmp(optarg, "off") == 0) {
+          options.partial_order_reduction = false;
+        } else {
+          std::cerr << "invalid argument to --partial-order-reduction, \""
+            << optarg << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
       case OPT_POINTER_BITS: // --pointer-bits ...
         if (strcmp(optarg, "auto") == 0) {
           options.pointer_bits = 0;
@@ -316,6 +559,8 @@ static void parse_args(int argc, char **argv) {
           options.symmetry_reduction = SymmetryReduction::HEURISTIC;
         } else if (strcmp(optarg, "exhaustive") == 0) {
           options.symmetry_reduction = SymmetryReduction::EXHAUSTIVE;
+        } else if (strcmp(optarg, "signature") == 0) {
+          options.symmetry_reduction = SymmetryReduction::SIGNATURE;
         } else {
           std::cerr << "invalid argument to --symmetry-reduction, \"" << optarg
             << "\"\n";
@@ -362,6 +607,18 @@ static void parse_args(int argc, char **argv) {
         break;
       }
 
+      case OPT_COUNTEREXAMPLE_REPLAY: // --counterexample-replay ...
+        if (strcmp(optarg, "on") == 0) {
+          options.counterexample_replay = true;
+        } else if (strcmp(optarg, "off") == 0) {
+          options.counterexample_replay = false;
+        } else {
+          std::cerr << "invalid argument to --counterexample-replay, \""
+            << optarg << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
       case OPT_COUNTEREXAMPLE_TRACE: // --counterexample-trace ...
         if (strcmp(optarg, "full") == 0) {
           options.counterexample_trace = CounterexampleTrace::FULL;
@@ -410,6 +667,47 @@ static void parse_args(int argc, char **argv) {
         break;
       }
 
+      case OPT_BITSTATE: { // --bitstate ...
+        if (strcmp(optarg, "off") == 0) {
+          options.bitstate = 0;
+          break;
+        }
+        bool valid = true;
+        try {
+          options.bitstate = optarg;
+          if (options.bitstate <= 0)
+            valid = false;
+        } catch (std::invalid_argument&) {
+          valid = false;
+        }
+        if (!valid) {
+          std::cerr << "invalid --bitstate argument \"" << optarg << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+
+      case OPT_TREE_COMPRESSION: { // --tree-compression ...
+        if (strcmp(optarg, "off") == 0) {
+          options.tree_compression = 0;
+          break;
+        }
+        bool valid = true;
+        try {
+          options.tree_compression = optarg;
+          if (options.tree_compression <= 0)
+            valid = false;
+        } catch (std::invalid_argument&) {
+          valid = false;
+        }
+        if (!valid) {
+          std::cerr << "invalid --tree-compression argument \"" << optarg
+            << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+
       case OPT_VALUE_TYPE: // --value-type ...
         options.value_type = optarg;
         break;
@@ -501,6 +799,18 @@ static void parse_args(int argc, char **argv) {
         }
         break;
 
+      case OPT_STATE_LAYOUT: // --state-layout ...
+        if (strcmp(optarg, "packed") == 0) {
+          options.state_layout = StateLayout::PACKED;
+        } else if (strcmp(optarg, "fast") == 0) {
+          options.state_layout = StateLayout::FAST;
+        } else {
+          std::cerr << "invalid argument to --state-layout, \"" << optarg
+            << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
       default:
         std::cerr << "unexpected error\n";
         exit(EXIT_FAILURE);
@@ -550,6 +860,133 @@ static void parse_args(int argc, char **argv) {
       << "solver (--smt-path ...), so it will be disabled\n";
     options.smt.simplification = SmtSimplification::OFF;
   }
+
+  // the alternative seen set representations are mutually exclusive
+  {
+    std::vector<std::string> modes;
+    if (options.bitstate > 0)
+      modes.push_back("--bitstate");
+    if (options.external_memory != "")
+      modes.push_back("--external-memory");
+    if (options.hash_compaction > 0)
+      modes.push_back("--hash-compaction");
+    if (options.tree_compression > 0)
+      modes.push_back("--tree-compression");
+    if (modes.size() > 1) {
+      std::cerr << modes[0] << " and " << modes[1] << " cannot be used "
+        << "together\n";
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // with any of these, states are discarded after expansion so there is
+  // nothing to walk back through when printing a counterexample
+  if (seen_set_option() != nullptr &&
+      options.counterexample_trace != CounterexampleTrace::OFF) {
+    *info << "counterexample traces are unavailable with " << seen_set_option()
+      << ", so they will be disabled\n";
+    options.counterexample_trace = CounterexampleTrace::OFF;
+  }
+
+  // checkpoints contain the seen set's states, so cannot be taken when it does
+  // not retain them
+  if (seen_set_option() != nullptr) {
+    if (options.checkpoint != "") {
+      std::cerr << "--checkpoint and " << seen_set_option() << " cannot be used "
+        << "together\n";
+      exit(EXIT_FAILURE);
+    }
+    if (options.resume != "") {
+      std::cerr << "--resume and " << seen_set_option() << " cannot be used "
+        << "together\n";
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // each process in a multi-process run has its own seen set and queue, so
+  // none of the options that assume a single one of each are supported
+  if (options.processes > 1) {
+    const char *incompatible = nullptr;
+    if (options.bitstate > 0)
+      incompatible = "--bitstate";
+    if (options.external_memory != "")
+      incompatible = "--external-memory";
+    if (options.checkpoint != "")
+      incompatible = "--checkpoint";
+    if (options.resume != "")
+      incompatible = "--resume";
+    if (incompatible != nullptr) {
+      std::cerr << "--processes and " << incompatible << " cannot be used "
+        << "together\n";
+      exit(EXIT_FAILURE);
+    }
+    if (options.counterexample_trace != CounterexampleTrace::OFF) {
+      *info << "counterexample traces are unavailable with --processes, so "
+        << "they will be disabled\n";
+      options.counterexample_trace = CounterexampleTrace::OFF;
+    }
+    if (options.threads > 1) {
+      *info << "--processes runs a single thread in each process, so the "
+        << "verifier will use one thread per process\n";
+      options.threads = 1;
+    }
+  }
+
+  // the cycle proviso of partial order reduction relies on learning whether a
+  // successor has been seen before when it is generated, which external
+  // memory exploration only finds out at the end of each layer
+  if (options.partial_order_reduction && options.external_memory != "") {
+    std::cerr << "--partial-order-reduction and --external-memory cannot be "
+      << "used together\n";
+    exit(EXIT_FAILURE);
+  }
+
+  // checkpoints record the queues but not the states held back for the next
+  // depth, and are taken at a rendezvous that would interleave with the ones
+  // between depths
+  if (options.minimal_traces) {
+    if (options.checkpoint != "") {
+      std::cerr << "--minimal-traces and --checkpoint cannot be used "
+        << "together\n";
+      exit(EXIT_FAILURE);
+    }
+    if (options.resume != "") {
+      std::cerr << "--minimal-traces and --resume cannot be used together\n";
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // external memory exploration is single threaded
+  if (options.external_memory != "" && options.threads > 1) {
+    *info << "--external-memory only supports a single thread, so the "
+      << "verifier will use one thread\n";
+    options.threads = 1;
+  }
+
+  // pick up the statistics left behind by a previous run's verifier, if any
+  if (options.size_hint != "") {
+    std::ifstream hint(options.size_hint);
+    std::string line;
+    while (hint.is_open() && std::getline(hint, line)) {
+      std::istringstream fields(line);
+      std::string key, value;
+      if (!(fields >> key >> value) || key != "states")
+        continue;
+      bool valid = true;
+      try {
+        options.size_hint_states = value;
+        if (options.size_hint_states < 0)
+          valid = false;
+      } catch (std::invalid_argument&) {
+        valid = false;
+      }
+      if (!valid) {
+        *warn << "ignoring invalid state count \"" << value << "\" in "
+          << options.size_hint << "\n";
+        options.size_hint_states = 0;
+      }
+    }
+  }
 }
 
 static bool use_colors() {
@@ -673,6 +1110,31 @@ int main(int argc, char **argv) {
     return EXIT_FAILURE;
   }
 
+  // the final liveness pass needs every state in the seen set
+  if (seen_set_option() != nullptr && m->liveness_count() > 0) {
+    std::cerr << seen_set_option() << " cannot be used with a model that has "
+      << "liveness properties\n";
+    return EXIT_FAILURE;
+  }
+  if (options.processes > 1 && m->liveness_count() > 0) {
+    std::cerr << "--processes cannot be used with a model that has liveness "
+      << "properties\n";
+    return EXIT_FAILURE;
+  }
+  if (options.partial_order_reduction && m->liveness_count() > 0) {
+    std::cerr << "--partial-order-reduction cannot be used with a model that "
+      << "has liveness properties\n";
+    return EXIT_FAILURE;
+  }
+
+  // liveness checking keeps a pointer to each state's predecessor regardless,
+  // so there is nothing to save by replaying
+  if (options.counterexample_replay && m->liveness_count() > 0) {
+    *info << "--counterexample-replay has no effect on a model with liveness "
+      << "properties, so it will be disabled\n";
+    options.counterexample_replay = false;
+  }
+
   // Check whether we have a start state.
   if (!has_start_state(*m))
     *warn << "warning: model has no start state\n";
@@ -691,6 +1153,12 @@ int main(int argc, char **argv) {
     }
   }
 
+  // widen fields so they can be accessed without bit manipulation
+  if (options.state_layout == StateLayout::FAST) {
+    *debug << "aligning fields...\n";
+    align_fields(*m);
+  }
+
   // re-order fields to optimise access to them
   if (options.reorder_fields) {
     *debug << "optimising field ordering...\n";
@@ -1,3 +1,4 @@
+#include "align-fields.h"
 #include <cstddef>
 #include <gmpxx.h>
 #include "max-simple-width.h"
@@ -21,7 +22,7 @@ namespace { class Measurer : public ConstTraversal {
   }
 
   void visit_enum(const Enum &n) final {
-    mpz_class w = n.width();
+    mpz_class w = layout_width(n);
     if (w > max)
       max = w;
   }
@@ -41,7 +42,7 @@ namespace { class Measurer : public ConstTraversal {
   }
 
   void visit_range(const Range &n) final {
-    mpz_class w = n.width();
+    mpz_class w = layout_width(n);
     if (w > max)
       max = w;
   }
@@ -52,14 +53,14 @@ namespace { class Measurer : public ConstTraversal {
   }
 
   void visit_scalarset(const Scalarset &n) final {
-    mpz_class w = n.width();
+    mpz_class w = layout_width(n);
     if (w > max)
       max = w;
   }
 
   void visit_typeexprid(const TypeExprID &n) final {
     if (n.is_simple()) {
-      mpz_class w = n.width();
+      mpz_class w = layout_width(n);
       if (w > max)
         max = w;
     }
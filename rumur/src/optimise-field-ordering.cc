@@ -1,7 +1,9 @@
+#include "align-fields.h"
 #include <cstddef>
 #include <gmpxx.h>
 #include "log.h"
 #include "optimise-field-ordering.h"
+#include "options.h"
 #include <rumur/rumur.h>
 #include <string>
 #include <unordered_map>
@@ -21,8 +23,8 @@ static bool is_onehot(mpz_class v) {
 // compare two fields based on size
 static bool comp(const Ptr<VarDecl> &a, const Ptr<VarDecl> &b) {
 
-  mpz_class width_a = a->type->width();
-  mpz_class width_b = b->type->width();
+  mpz_class width_a = layout_width(*a->type);
+  mpz_class width_b = layout_width(*b->type);
 
   // zero-width fields trump anything else
   if (width_a == 0) {
@@ -31,6 +33,15 @@ static bool comp(const Ptr<VarDecl> &a, const Ptr<VarDecl> &b) {
     return false;
   }
 
+  // with the fast state layout, fields of a whole number of bytes trump others
+  // so they all start on a byte boundary
+  if (options.state_layout == StateLayout::FAST) {
+    if (width_a % 8 == 0 && width_b % 8 != 0)
+      return true;
+    if (width_a % 8 != 0 && width_b % 8 == 0)
+      return false;
+  }
+
   // power-of-2 fields trump non-power-of-2 fields
   if (is_onehot(width_a) && !is_onehot(width_b))
     return true;
@@ -126,7 +137,7 @@ namespace { class Reorderer : public Traversal {
     std::unordered_map<std::string, mpz_class> offsets;
     for (Ptr<VarDecl> &v : vars) {
       offsets[v->name] = offset;
-      offset += v->type->width();
+      offset += layout_width(*v->type);
     }
 
     // apply these updated offsets to the original VarDecls
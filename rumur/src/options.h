@@ -44,6 +44,18 @@ enum struct SymmetryReduction {
   OFF,
   HEURISTIC,
   EXHAUSTIVE,
+  SIGNATURE,
+};
+
+enum struct StateLayout {
+  PACKED,
+  FAST,
+};
+
+enum struct HugePages {
+  OFF,
+  TRANSPARENT,
+  EXPLICIT,
 };
 
 enum struct SmtSimplification {
@@ -83,6 +95,10 @@ struct Options {
   // How to print counterexample traces
   CounterexampleTrace counterexample_trace = CounterexampleTrace::DIFF;
 
+  // whether to reconstruct counterexample traces by replaying exploration,
+  // instead of storing a path back to a start state in every state
+  bool counterexample_replay = false;
+
   // Print output as XML?
   bool machine_readable_output = false;
 
@@ -95,6 +111,31 @@ struct Options {
   // whether to bit-pack members of the state struct
   bool pack_state = true;
 
+  // how to lay out model variables within the state
+  StateLayout state_layout = StateLayout::PACKED;
+
+  // whether to pin verifier threads to CPUs and place memory by NUMA node
+  bool numa = false;
+
+  // what kind of pages to back the seen set and state arenas with
+  HugePages huge_pages = HugePages::OFF;
+
+  // whether to store each state's hash alongside it
+  bool cache_hash = false;
+
+  // whether to cache recent canonicalisations during symmetry reduction
+  bool canonical_cache = false;
+
+  // whether to maintain each state's hash incrementally as it is written
+  bool incremental_hash = false;
+
+  // whether to fire only a stubborn subset of the enabled rules in each state
+  bool partial_order_reduction = false;
+
+  // whether to expand states one depth at a time, for minimal counterexample
+  // traces from a multithreaded verifier
+  bool minimal_traces = false;
+
   // whether to optimise state variable and record fields ordering
   bool reorder_fields = true;
 
@@ -104,6 +145,41 @@ struct Options {
   // number of relevant bits in a pointer on the target platform (0 == auto)
   mpz_class pointer_bits = 0;
 
+  // number of bits of each state's hash to store in the seen set instead of
+  // the state itself (0 == disabled)
+  mpz_class hash_compaction = 0;
+
+  // size in megabytes of the bit array to use for a bitstate search instead of
+  // the seen set (0 == disabled)
+  mpz_class bitstate = 0;
+
+  // size in megabytes of the node table to use for storing states in the seen
+  // set as trees (0 == disabled)
+  mpz_class tree_compression = 0;
+
+  // directory in which to store seen states and pending states on disk ("" ==
+  // disabled)
+  std::string external_memory;
+
+  // path to periodically write a checkpoint of the run to ("" == disabled)
+  std::string checkpoint;
+
+  // interval in seconds between checkpoints
+  mpz_class checkpoint_every = 600;
+
+  // path of a checkpoint to resume from ("" == disabled)
+  std::string resume;
+
+  // path of a file of statistics from a previous run to size the seen set from,
+  // and to which the verifier writes its own at exit ("" == disabled)
+  std::string size_hint;
+
+  // number of states recorded in the size hint file (0 == none)
+  mpz_class size_hint_states = 0;
+
+  // number of processes to partition the state space among
+  mpz_class processes = 1;
+
   // options related to SMT solver interaction
   struct {
 
@@ -1,16 +1,22 @@
+#include "align-fields.h"
 #include "assume-statements-count.h"
+#include "../../common/escape.h"
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include "generate.h"
 #include "max-simple-width.h"
 #include "options.h"
+#include "partial-order-reduction.h"
 #include "prints-scalarsets.h"
 #include "resources.h"
 #include <rumur/rumur.h>
+#include <sstream>
 #include <string>
 #include "symmetry-reduction.h"
+#include "tree-compression.h"
 #include <utility>
 #include "utils.h"
 #include "ValueType.h"
@@ -72,6 +78,30 @@ static std::ostream &operator<<(std::ostream &out, SymmetryReduction s) {
       out << "SYMMETRY_REDUCTION_EXHAUSTIVE";
       break;
 
+    case SymmetryReduction::SIGNATURE:
+      out << "SYMMETRY_REDUCTION_SIGNATURE";
+      break;
+
+  }
+
+  return out;
+}
+
+static std::ostream &operator<<(std::ostream &out, HugePages h) {
+  switch (h) {
+
+    case HugePages::OFF:
+      out << "HUGE_PAGES_OFF";
+      break;
+
+    case HugePages::TRANSPARENT:
+      out << "HUGE_PAGES_TRANSPARENT";
+      break;
+
+    case HugePages::EXPLICIT:
+      out << "HUGE_PAGES_EXPLICIT";
+      break;
+
   }
 
   return out;
@@ -172,6 +202,40 @@ static mpz_class schedule_bits(const Model &model) {
   return bits;
 }
 
+// size in bytes of the seen set slots states should be stored inline in, or 0
+// if the seen set should point to states instead
+static unsigned inline_states(const Model &model) {
+
+  // states must outlive their insertion into the set when a counterexample
+  // trace, liveness check or checkpoint refers back to them, and the
+  // alternative seen set representations have their own slot formats
+  if (options.counterexample_trace != CounterexampleTrace::OFF ||
+      model.liveness_count() > 0 || options.checkpoint != "" ||
+      options.resume != "" || options.bitstate > 0 ||
+      options.external_memory != "" || options.hash_compaction > 0 ||
+      options.tree_compression > 0)
+    return 0;
+
+  // the top byte of a slot is reserved to distinguish it from an empty one
+  const mpz_class bytes = (layout_size_bits(model) + 7) / 8;
+  if (bytes < 8)
+    return 8;
+  if (bytes < 16)
+    return 16;
+  return 0;
+}
+
+// FNV-1a hash of some text, used to recognise checkpoints written by a checker
+// for a different model
+static uint64_t fingerprint(const std::string &s) {
+  uint64_t h = UINT64_C(0xcbf29ce484222325);
+  for (char c : s) {
+    h ^= static_cast<unsigned char>(c);
+    h *= UINT64_C(0x100000001b3);
+  }
+  return h;
+}
+
 int output_checker(const std::string &path, const Model &model,
     const std::pair<ValueType, ValueType> &value_types) {
 
@@ -179,9 +243,21 @@ int output_checker(const std::string &path, const Model &model,
   if (!out)
     return -1;
 
+  // generate the model itself up front, so we can identify it in checkpoints
+  std::ostringstream model_code;
+  generate_model(model_code, model);
+  std::ostringstream model_id;
+  model_id << "UINT64_C(0x" << std::hex << fingerprint(model_code.str())
+    << ")";
+
   if (options.log_level < LogLevel::DEBUG)
     out << "#define NDEBUG 1\n\n";
 
+  // NUMA placement and huge pages use Linux extensions to pin threads to CPUs
+  // and map memory
+  if (options.numa || options.huge_pages != HugePages::OFF)
+    out << "#define _GNU_SOURCE 1\n\n";
+
   out
 
     // #includes
@@ -210,18 +286,22 @@ int output_checker(const std::string &path, const Model &model,
     << "  SYMMETRY_REDUCTION_OFF = 0,\n"
     << "  SYMMETRY_REDUCTION_HEURISTIC = 1,\n"
     << "  SYMMETRY_REDUCTION_EXHAUSTIVE = 2,\n"
+    << "  SYMMETRY_REDUCTION_SIGNATURE = 3,\n"
     << "};\n"
     << "#define SYMMETRY_REDUCTION " << options.symmetry_reduction << "\n\n"
     << "enum { SANDBOX_ENABLED = " << options.sandbox_enabled << " };\n\n"
     << "enum { MAX_ERRORS = " << options.max_errors << "ul };\n\n"
     << "enum { THREADS = " << options.threads << "ul };\n\n"
-    << "enum { STATE_SIZE_BITS = " << model.size_bits() << "ul };\n\n"
+    << "enum { STATE_SIZE_BITS = " << layout_size_bits(model) << "ul };\n\n"
     << "enum { ASSUME_STATEMENTS_COUNT = " << assume_statements_count(model) << "ul };\n\n"
     << "#define LIVENESS_COUNT " << model.liveness_count() << "\n\n"
     << "#define CEX_OFF 0\n"
     << "#define DIFF 1\n"
     << "#define FULL 2\n"
-    << "#define COUNTEREXAMPLE_TRACE " << options.counterexample_trace << "\n\n"
+    << "#define COUNTEREXAMPLE_TRACE " << options.counterexample_trace << "\n"
+    << "#define COUNTEREXAMPLE_REPLAY " << (options.counterexample_replay &&
+      options.counterexample_trace != CounterexampleTrace::OFF ? 1 : 0)
+      << "\n\n"
     << "enum { MACHINE_READABLE_OUTPUT = " << options.machine_readable_output
       << " };\n\n"
     << "enum { MAX_SIMPLE_WIDTH = " << max_simple_width(model) << " };\n\n"
@@ -237,6 +317,21 @@ int output_checker(const std::string &path, const Model &model,
     << "#define PRIRAWVAL " << value_types.second.pri << "\n\n"
     << "#define RULE_TAKEN_LIMIT " << rule_taken_limit(model) << "\n"
     << "#define PACK_STATE " << (options.pack_state ? 1 : 0) << "\n"
+    << "#define NUMA " << (options.numa ? 1 : 0) << "\n"
+    << "#define HUGE_PAGES_OFF 0\n"
+    << "#define HUGE_PAGES_TRANSPARENT 1\n"
+    << "#define HUGE_PAGES_EXPLICIT 2\n"
+    << "#define HUGE_PAGES " << options.huge_pages << "\n"
+    << "#define FAST_LAYOUT "
+      << (options.state_layout == StateLayout::FAST ? 1 : 0) << "\n"
+    << "#define CACHE_HASH " << (options.cache_hash ? 1 : 0) << "\n"
+    << "#define CANONICAL_CACHE " << (options.canonical_cache &&
+      options.symmetry_reduction != SymmetryReduction::OFF ? 1 : 0) << "\n"
+    << "#define INCREMENTAL_HASH " << (options.incremental_hash ? 1 : 0) << "\n"
+    << "#define PARTIAL_ORDER_REDUCTION "
+      << (options.partial_order_reduction ? 1 : 0) << "\n"
+    << "#define LEVEL_SYNC " << (options.minimal_traces &&
+      options.external_memory == "" && options.processes == 1 ? 1 : 0) << "\n"
     << "#define SCHEDULE_BITS " << schedule_bits(model) << "ul\n"
     << "#define PRINTS_SCALARSETS " << (prints_scalarsets(model) ? "1" : "0") << "\n"
     << "\n"
@@ -244,17 +339,39 @@ int output_checker(const std::string &path, const Model &model,
     << "#define USE_SCALARSET_SCHEDULES (" << (options.scalarset_schedules ? "1" : "0")
       << " && SYMMETRY_REDUCTION != SYMMETRY_REDUCTION_OFF && \\\n"
     << "  (COUNTEREXAMPLE_TRACE != CEX_OFF || PRINTS_SCALARSETS))\n"
-    << "#define POINTER_BITS " << options.pointer_bits << "\n";
+    << "#define POINTER_BITS " << options.pointer_bits << "\n"
+    << "#define HASH_COMPACTION_BITS " << options.hash_compaction << "\n"
+    << "#define INLINE_STATES " << inline_states(model) << "\n"
+    << "#define BITSTATE_MB " << options.bitstate << "ull\n"
+    << "#define TREE_COMPRESSION_MB " << options.tree_compression << "ull\n"
+    << "#define EXTERNAL_MEMORY " << (options.external_memory == "" ? "0" : "1")
+      << "\n"
+    << "#define EXTERNAL_MEMORY_DIR \"" << escape(options.external_memory)
+      << "\"\n"
+    << "#define CHECKPOINT " << (options.checkpoint == "" ? "0" : "1") << "\n"
+    << "#define CHECKPOINT_PATH \"" << escape(options.checkpoint) << "\"\n"
+    << "#define CHECKPOINT_EVERY " << options.checkpoint_every << "\n"
+    << "#define RESUME " << (options.resume == "" ? "0" : "1") << "\n"
+    << "#define RESUME_PATH \"" << escape(options.resume) << "\"\n"
+    << "#define SIZE_HINT " << (options.size_hint == "" ? "0" : "1") << "\n"
+    << "#define SIZE_HINT_PATH \"" << escape(options.size_hint) << "\"\n"
+    << "#define SIZE_HINT_STATES " << options.size_hint_states << "ull\n"
+    << "#define MODEL_ID " << model_id.str() << "\n"
+    << "#define PROCESSES " << options.processes << "\n";
 
   generate_cover_array(out, model);
 
+  generate_por_constants(model, out);
+
+  generate_tree_leaves(model, out);
+
     // Static boiler plate code
   out
     << std::string((const char*)resources_header_c, resources_header_c_len)
     << "\n";
 
   // the model itself
-  generate_model(out, model);
+  out << model_code.str();
 
   return 0;
 }
@@ -0,0 +1,567 @@
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include "generate.h"
+#include <gmpxx.h>
+#include <iostream>
+#include <map>
+#include "options.h"
+#include "partial-order-reduction.h"
+#include <rumur/rumur.h>
+#include <set>
+#include <sstream>
+#include <string>
+#include "utils.h"
+#include <vector>
+
+using namespace rumur;
+
+namespace {
+
+// an access to (part of) a state variable
+struct Access {
+
+  // unique_id of the state variable, or SIZE_MAX for any state variable
+  size_t var = SIZE_MAX;
+
+  enum {
+    WHOLE,      // the whole variable
+    QUANTIFIER, // the element indexed by one of the rule's quantifiers
+    CONSTANT,   // the element indexed by a constant
+  } kind = WHOLE;
+
+  // index of the quantifier within the rule's quantifiers, for QUANTIFIER
+  size_t quantifier = 0;
+
+  // index of the element, for CONSTANT
+  mpz_class constant;
+};
+
+// the state a rule can access, as far as we can tell statically
+struct Footprint {
+
+  // state read by each top-level conjunct of the guard
+  std::vector<std::vector<Access>> conjuncts;
+
+  // state read by the guard or body
+  std::vector<Access> reads;
+
+  // state written by the body
+  std::vector<Access> writes;
+
+  // does firing this rule do something that could be observed besides its
+  // change to the state, like failing an assertion?
+  bool observable = false;
+};
+
+}
+
+// is this the quantifier with the given index among a rule's quantifiers?
+static bool is_quantifier(const Expr &e, const std::vector<Quantifier> &qs,
+    size_t &index) {
+  auto id = dynamic_cast<const ExprID*>(&e);
+  if (id == nullptr || !isa<VarDecl>(id->value))
+    return false;
+  for (size_t i = 0; i < qs.size(); i++) {
+    if (qs[i].decl->unique_id == id->value->unique_id) {
+      index = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+// does this expression name a state variable, looking through aliases?
+static const VarDecl *state_variable(const Expr &e) {
+  auto id = dynamic_cast<const ExprID*>(&e);
+  if (id == nullptr)
+    return nullptr;
+  if (auto a = dynamic_cast<const AliasDecl*>(id->value.get()))
+    return state_variable(*a->value);
+  auto v = dynamic_cast<const VarDecl*>(id->value.get());
+  if (v == nullptr || !v->is_in_state())
+    return nullptr;
+  return v;
+}
+
+/* Determine which part of the state an lvalue-like expression refers to. An
+ * element of a top-level array can be distinguished when it is indexed by one
+ * of the rule's quantifiers or a constant. Anything more complicated is
+ * considered an access to the whole variable.
+ */
+static bool root_access(const Expr &e, const std::vector<Quantifier> &qs,
+    Access &a) {
+
+  if (auto id = dynamic_cast<const ExprID*>(&e)) {
+    if (auto alias = dynamic_cast<const AliasDecl*>(id->value.get()))
+      return root_access(*alias->value, qs, a);
+    const VarDecl *v = state_variable(e);
+    if (v == nullptr)
+      return false;
+    a = Access();
+    a.var = v->unique_id;
+    return true;
+  }
+
+  if (auto f = dynamic_cast<const Field*>(&e))
+    return root_access(*f->record, qs, a);
+
+  if (auto el = dynamic_cast<const Element*>(&e)) {
+    if (!root_access(*el->array, qs, a))
+      return false;
+    if (a.kind == Access::WHOLE && state_variable(*el->array) != nullptr) {
+      size_t index;
+      if (is_quantifier(*el->index, qs, index)) {
+        a.kind = Access::QUANTIFIER;
+        a.quantifier = index;
+      } else if (el->index->constant()) {
+        a.kind = Access::CONSTANT;
+        a.constant = el->index->constant_fold();
+      }
+    }
+    return true;
+  }
+
+  return false;
+}
+
+namespace {
+
+class AccessCollector : public ConstTraversal {
+
+ private:
+  // quantifiers of the rule being analysed
+  std::vector<Quantifier> quantifiers;
+
+  // functions whose bodies we have already accounted for
+  std::set<std::string> seen_functions;
+
+ public:
+  std::vector<Access> reads;
+  std::vector<Access> writes;
+  bool observable = false;
+
+  explicit AccessCollector(const std::vector<Quantifier> &quantifiers_):
+    quantifiers(quantifiers_) { }
+
+  void visit_assignment(const Assignment &n) final {
+    write(*n.lhs);
+    dispatch(*n.rhs);
+  }
+
+  void visit_clear(const Clear &n) final {
+    write(*n.rhs);
+  }
+
+  void visit_element(const Element &n) final {
+    read(n);
+  }
+
+  void visit_errorstmt(const ErrorStmt&) final {
+    observable = true;
+  }
+
+  void visit_exprid(const ExprID &n) final {
+    read(n);
+  }
+
+  void visit_field(const Field &n) final {
+    read(n);
+  }
+
+  void visit_functioncall(const FunctionCall &n) final {
+
+    for (size_t i = 0; i < n.arguments.size(); i++) {
+      dispatch(*n.arguments[i]);
+      // a var parameter may be written by the callee
+      if (n.function == nullptr || i >= n.function->parameters.size() ||
+          !n.function->parameters[i]->readonly) {
+        if (n.arguments[i]->is_lvalue())
+          write(*n.arguments[i]);
+      }
+    }
+
+    // if we could not see the definition, assume it can do anything
+    if (n.function == nullptr) {
+      if (seen_functions.count(n.name) == 0) {
+        reads.push_back(Access());
+        writes.push_back(Access());
+        observable = true;
+      }
+      return;
+    }
+
+    // account for the state the callee accesses directly, which can only be
+    // whole variables as it cannot see our quantifiers
+    if (seen_functions.insert(n.name).second) {
+      std::vector<Quantifier> qs;
+      qs.swap(quantifiers);
+      for (const Ptr<Decl> &d : n.function->decls)
+        dispatch(*d);
+      for (const Ptr<Stmt> &s : n.function->body)
+        dispatch(*s);
+      qs.swap(quantifiers);
+    }
+  }
+
+  void visit_propertystmt(const PropertyStmt &n) final {
+    observable = true;
+    dispatch(n.property);
+  }
+
+  void visit_undefine(const Undefine &n) final {
+    write(*n.rhs);
+  }
+
+ private:
+  void read(const Expr &e) {
+    Access a;
+    if (root_access(e, quantifiers, a))
+      reads.push_back(a);
+    indices(e);
+  }
+
+  void write(const Expr &e) {
+    Access a;
+    if (root_access(e, quantifiers, a))
+      writes.push_back(a);
+    indices(e);
+  }
+
+  // account for reads made in computing which part of the state an lvalue
+  // refers to
+  void indices(const Expr &e) {
+    if (auto id = dynamic_cast<const ExprID*>(&e)) {
+      if (auto alias = dynamic_cast<const AliasDecl*>(id->value.get()))
+        indices(*alias->value);
+    } else if (auto f = dynamic_cast<const Field*>(&e)) {
+      indices(*f->record);
+    } else if (auto el = dynamic_cast<const Element*>(&e)) {
+      indices(*el->array);
+      dispatch(*el->index);
+    } else {
+      dispatch(e);
+    }
+  }
+};
+
+}
+
+// split an expression into its top-level conjuncts
+static void conjuncts(const Expr &e, std::vector<const Expr*> &out) {
+  if (auto a = dynamic_cast<const And*>(&e)) {
+    conjuncts(*a->lhs, out);
+    conjuncts(*a->rhs, out);
+    return;
+  }
+  out.push_back(&e);
+}
+
+std::vector<const Expr*> guard_conjuncts(const SimpleRule &r) {
+  std::vector<const Expr*> cs;
+  if (r.guard != nullptr)
+    conjuncts(*r.guard, cs);
+  return cs;
+}
+
+static Footprint get_footprint(const SimpleRule &r) {
+
+  Footprint f;
+
+  for (const Expr *c : guard_conjuncts(r)) {
+    AccessCollector ac(r.quantifiers);
+    ac.dispatch(*c);
+    f.conjuncts.push_back(ac.reads);
+    f.reads.insert(f.reads.end(), ac.reads.begin(), ac.reads.end());
+    f.observable |= ac.observable;
+  }
+
+  AccessCollector ac(r.quantifiers);
+  for (const Ptr<Decl> &d : r.decls)
+    ac.dispatch(*d);
+  for (const Ptr<Stmt> &s : r.body)
+    ac.dispatch(*s);
+  f.reads.insert(f.reads.end(), ac.reads.begin(), ac.reads.end());
+  f.writes = ac.writes;
+  f.observable |= ac.observable;
+
+  return f;
+}
+
+// all simple rules in the model, in the order the generated code numbers them
+static std::vector<Ptr<Rule>> simple_rules(const Model &m) {
+  std::vector<Ptr<Rule>> rules;
+  for (const Ptr<Node> &c : m.children) {
+    if (auto r = dynamic_cast<const Rule*>(c.get())) {
+      for (const Ptr<Rule> &f : r->flatten()) {
+        if (isa<SimpleRule>(f))
+          rules.push_back(f);
+      }
+    }
+  }
+  return rules;
+}
+
+// number of instances of a rule when its quantifiers are expanded
+static mpz_class instances(const Rule &r) {
+  mpz_class count = 1;
+  for (const Quantifier &q : r.quantifiers) {
+    assert(q.constant() && "non-constant quantifier used in rule "
+      "(unvalidated AST?)");
+    count *= q.count();
+  }
+  return count;
+}
+
+void generate_por_constants(const Model &m, std::ostream &out) {
+
+  if (!options.partial_order_reduction)
+    return;
+
+  const std::vector<Ptr<Rule>> rules = simple_rules(m);
+
+  mpz_class total = 0;
+  size_t quantifiers = 0;
+  for (const Ptr<Rule> &r : rules) {
+    total += instances(*r);
+    if (r->quantifiers.size() > quantifiers)
+      quantifiers = r->quantifiers.size();
+  }
+
+  out
+    << "enum { POR_GROUPS = " << rules.size() << "ul };\n"
+    << "enum { POR_INSTANCES = " << total << "ul };\n"
+    << "enum { POR_QUANTIFIERS = " << quantifiers << "ul };\n\n";
+}
+
+namespace {
+
+// C source for a list of por_terms, or "" if the relation always holds
+struct Relation {
+  bool always = false;
+  std::set<std::string> terms;
+};
+
+}
+
+// add the conditions under which accesses `a` of one rule instance and `b` of
+// another touch the same part of the state
+static void conflict(const Access &a, const Access &b, Relation &r) {
+
+  if (a.var != b.var && a.var != SIZE_MAX && b.var != SIZE_MAX)
+    return;
+
+  if (a.var == SIZE_MAX || b.var == SIZE_MAX ||
+      a.kind == Access::WHOLE || b.kind == Access::WHOLE) {
+    r.always = true;
+    return;
+  }
+
+  if (a.kind == Access::CONSTANT && b.kind == Access::CONSTANT) {
+    if (a.constant == b.constant)
+      r.always = true;
+    return;
+  }
+
+  const std::string qa = a.kind == Access::QUANTIFIER
+    ? std::to_string(a.quantifier) : "-1";
+  const std::string qb = b.kind == Access::QUANTIFIER
+    ? std::to_string(b.quantifier) : "-1";
+  const std::string value = a.kind == Access::CONSTANT
+    ? a.constant.get_str() : b.kind == Access::CONSTANT
+    ? b.constant.get_str() : "0";
+
+  r.terms.insert("{ " + qa + ", " + qb + ", VALUE_C(" + value + ") }");
+}
+
+static void conflicts(const std::vector<Access> &as,
+    const std::vector<Access> &bs, Relation &r) {
+  for (const Access &a : as) {
+    for (const Access &b : bs) {
+      if (r.always)
+        return;
+      conflict(a, b, r);
+    }
+  }
+}
+
+namespace {
+
+// deduplicating emitter of the por_relation initialisers
+class RelationTable {
+
+ private:
+  std::ostream &out;
+  std::map<std::set<std::string>, std::string> emitted;
+
+ public:
+  explicit RelationTable(std::ostream &out_): out(out_) { }
+
+  // emit any supporting definitions needed for a relation and return its
+  // initialiser
+  std::string operator()(const Relation &r) {
+
+    if (r.always)
+      return "{ SIZE_MAX, NULL }";
+
+    if (r.terms.empty())
+      return "{ 0, NULL }";
+
+    auto it = emitted.find(r.terms);
+    if (it == emitted.end()) {
+      const std::string name = "por_terms_" + std::to_string(emitted.size());
+      out << "static const struct por_term " << name << "[] = {\n";
+      for (const std::string &t : r.terms)
+        out << "  " << t << ",\n";
+      out << "};\n";
+      it = emitted.insert(std::make_pair(r.terms, name)).first;
+    }
+
+    return "{ " + std::to_string(r.terms.size()) + ", " + it->second + " }";
+  }
+};
+
+}
+
+// variables read by any property, which rules must not change if they are to
+// be left out of a state's expansion
+static std::vector<Access> property_reads(const Model &m) {
+  std::vector<Access> reads;
+  for (const Ptr<Node> &c : m.children) {
+    if (auto r = dynamic_cast<const Rule*>(c.get())) {
+      for (const Ptr<Rule> &f : r->flatten()) {
+        if (auto p = dynamic_cast<const PropertyRule*>(f.get())) {
+          AccessCollector ac(p->quantifiers);
+          ac.dispatch(p->property);
+          for (Access a : ac.reads) {
+            // the property may look at any element
+            a.kind = Access::WHOLE;
+            reads.push_back(a);
+          }
+        }
+      }
+    }
+  }
+  return reads;
+}
+
+void generate_por(const Model &m, std::ostream &out) {
+
+  if (!options.partial_order_reduction)
+    return;
+
+  const std::vector<Ptr<Rule>> rules = simple_rules(m);
+
+  std::vector<Footprint> footprints;
+  for (const Ptr<Rule> &r : rules)
+    footprints.push_back(get_footprint(dynamic_cast<const SimpleRule&>(*r)));
+
+  const std::vector<Access> observed = property_reads(m);
+
+  RelationTable relation(out);
+
+  std::ostringstream groups;
+  mpz_class base = 0;
+
+  for (size_t g = 0; g < rules.size(); g++) {
+    const Footprint &fg = footprints[g];
+
+    // which other rule instances must be fired alongside an enabled one?
+    std::vector<std::string> depends;
+    for (size_t h = 0; h < rules.size(); h++) {
+      const Footprint &fh = footprints[h];
+      Relation r;
+      conflicts(fg.writes, fh.reads, r);
+      conflicts(fg.writes, fh.writes, r);
+      conflicts(fg.reads, fh.writes, r);
+      depends.push_back(relation(r));
+    }
+
+    // which other rule instances could enable a disabled one?
+    std::vector<std::string> enables;
+    for (const std::vector<Access> &reads : fg.conjuncts) {
+      for (size_t h = 0; h < rules.size(); h++) {
+        Relation r;
+        conflicts(reads, footprints[h].writes, r);
+        enables.push_back(relation(r));
+      }
+    }
+
+    // could firing this rule be observed by a property?
+    Relation o;
+    conflicts(fg.writes, observed, o);
+    const bool visible = fg.observable || o.always;
+
+    out << "static const struct por_relation por_depends_" << g << "[] = {\n";
+    for (const std::string &d : depends)
+      out << "  " << d << ",\n";
+    out << "};\n";
+
+    if (!enables.empty()) {
+      out << "static const struct por_relation por_enables_" << g << "[] = {\n";
+      for (const std::string &e : enables)
+        out << "  " << e << ",\n";
+      out << "};\n";
+    }
+
+    const mpz_class count = instances(*rules[g]);
+    groups
+      << "  { .base = " << base << "ul, .count = " << count << "ul, "
+      << ".conjuncts = " << fg.conjuncts.size() << "ul, "
+      << ".visible = " << (visible ? "true" : "false") << ", "
+      << ".depends = por_depends_" << g << ", "
+      << ".enables = "
+        << (enables.empty() ? "NULL" : "por_enables_" + std::to_string(g))
+      << " },\n";
+    base += count;
+  }
+
+  out
+    << "static const struct por_group POR_GROUP[POR_GROUPS + 1] = {\n"
+    << groups.str()
+    << "  /* Dummy entry in case the above generated list is empty. */\n"
+    << "  { .base = 0, .count = 0, .conjuncts = 0, .visible = true, "
+      << ".depends = NULL, .enables = NULL },\n"
+    << "};\n\n";
+
+  // Generate a guard for each rule that tells us which conjunct was false
+  out << "static void por_guards(const struct state *NONNULL s) {\n"
+    << "  /* Used when writing to quantifier variables. */\n"
+    << "  static const char *rule_name __attribute__((unused)) = NULL;\n"
+    << "  uint64_t rule_taken = 1;\n";
+  for (size_t g = 0; g < rules.size(); g++) {
+    const Rule &r = *rules[g];
+
+    out << "  {\n";
+    for (const Quantifier &q : r.quantifiers)
+      generate_quantifier_header(out, q);
+
+    out
+      << "      do {\n"
+      << "        guard_enter(rule_taken);\n"
+      << "        int c = por_guard" << g << "(s";
+    for (const Quantifier &q : r.quantifiers)
+      out << ", ru_" << q.name;
+    out
+      << ");\n"
+      << "        guard_leave();\n"
+      << "        por_enabled[rule_taken - 1] = c == 0;\n"
+      << "        por_blocker[rule_taken - 1] = c == -1 ? SIZE_MAX : (size_t)c - 1;\n";
+    for (size_t i = 0; i < r.quantifiers.size(); i++) {
+      const Quantifier &q = r.quantifiers[i];
+      ExprID id(q.name, q.decl, q.loc);
+      out << "        por_values[rule_taken - 1][" << i << "] = ";
+      generate_rvalue(out, id);
+      out << ";\n";
+    }
+    out
+      << "      } while (0);\n"
+      << "      rule_taken++;\n";
+
+    for (auto it = r.quantifiers.rbegin(); it != r.quantifiers.rend(); it++)
+      generate_quantifier_footer(out, *it);
+
+    out << "  }\n";
+  }
+  out << "}\n\n";
+}
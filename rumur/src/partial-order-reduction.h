@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+#include <rumur/rumur.h>
+#include <vector>
+
+// Generate the definitions that dimension the partial order reduction
+// machinery in header.c by the model's rules
+void generate_por_constants(const rumur::Model &m, std::ostream &out);
+
+/* Generate the tables describing which rule instances are dependent on one
+ * another and the `por_guards` function that evaluates every rule's guard, for
+ * use in partial order reduction. Nothing is generated unless partial order
+ * reduction is enabled.
+ */
+void generate_por(const rumur::Model &m, std::ostream &out);
+
+// the top-level conjuncts of a rule's guard, which `por_guard<N>` evaluates
+// one at a time
+std::vector<const rumur::Expr*> guard_conjuncts(const rumur::SimpleRule &r);
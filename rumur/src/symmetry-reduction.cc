@@ -1,3 +1,4 @@
+#include "align-fields.h"
 #include <cassert>
 #include <cstddef>
 #include <gmpxx.h>
@@ -5,6 +6,8 @@
 #include <memory>
 #include "options.h"
 #include <rumur/rumur.h>
+#include <set>
+#include <string>
 #include "symmetry-reduction.h"
 #include <utility>
 #include "utils.h"
@@ -69,13 +72,13 @@ static void generate_apply_swap(std::ostream &out, const std::string &offset_a,
     out
       << indent << "if (" << offset_a << " != " << offset_b << ") {\n"
       << indent << "  raw_value_t a = handle_read_raw(s, state_handle(s, "
-        << offset_a << ", " << t->width() << "ull));\n"
+        << offset_a << ", " << layout_width(*t) << "ull));\n"
       << indent << "  raw_value_t b = handle_read_raw(s, state_handle(s, "
-        << offset_b << ", " << t->width() << "ull));\n"
+        << offset_b << ", " << layout_width(*t) << "ull));\n"
       << indent << "  handle_write_raw(s, state_handle(s, " << offset_b
-        << ", " << t->width() << "ull), a);\n"
+        << ", " << layout_width(*t) << "ull), a);\n"
       << indent << "  handle_write_raw(s, state_handle(s, " << offset_a
-        << ", " << t->width() << "ull), b);\n"
+        << ", " << layout_width(*t) << "ull), b);\n"
       << indent << "}\n";
     return;
   }
@@ -84,8 +87,8 @@ static void generate_apply_swap(std::ostream &out, const std::string &offset_a,
     const std::string var = "i" + std::to_string(depth);
     mpz_class ic = a->index_type->count() - 1;
     const std::string len = "((size_t)" + ic.get_str() + "ull)";
-    const std::string width = "((size_t)" + a->element_type->width().get_str()
-      + "ull)";
+    const std::string width = "((size_t)"
+      + layout_width(*a->element_type).get_str() + "ull)";
 
     out << indent << "for (size_t " << var << " = 0; " << var << " < " << len
       << "; " << var << "++) {\n";
@@ -106,8 +109,8 @@ static void generate_apply_swap(std::ostream &out, const std::string &offset_a,
     for (const Ptr<VarDecl> &f : r->fields) {
       generate_apply_swap(out, off_a, off_b, *f->type, depth);
 
-      off_a += " + ((size_t)" + f->width().get_str() + "ull)";
-      off_b += " + ((size_t)" + f->width().get_str() + "ull)";
+      off_a += " + ((size_t)" + layout_width(*f->type).get_str() + "ull)";
+      off_b += " + ((size_t)" + layout_width(*f->type).get_str() + "ull)";
     }
     return;
   }
@@ -128,7 +131,7 @@ static void generate_swap_chunk(std::ostream &out, const TypeExpr &t,
          * one of the pair we are swapping, we need to change it to the other.
          */
 
-        const std::string w = "((size_t)" + t.width().get_str() + "ull)";
+        const std::string w = "((size_t)" + layout_width(t).get_str() + "ull)";
         const std::string h = "state_handle(s, " + offset + ", " + w + ")";
 
         out
@@ -154,7 +157,7 @@ static void generate_swap_chunk(std::ostream &out, const TypeExpr &t,
 
   if (auto a = dynamic_cast<const Array*>(type.get())) {
 
-    const std::string w = "((size_t)" + a->element_type->width().get_str()
+    const std::string w = "((size_t)" + layout_width(*a->element_type).get_str()
       + "ull)";
 
     // If this array is indexed by our pivot type, swap the relevant elements
@@ -193,7 +196,7 @@ static void generate_swap_chunk(std::ostream &out, const TypeExpr &t,
     for (const Ptr<VarDecl> &f : r->fields) {
       generate_swap_chunk(out, *f->type, off, pivot, depth);
 
-      off += " + ((size_t)" + f->width().get_str() + "ull)";
+      off += " + ((size_t)" + layout_width(*f->type).get_str() + "ull)";
     }
     return;
   }
@@ -406,9 +409,9 @@ static void generate_apply_compare(std::ostream &out, const TypeExpr &type,
       out
         << indent << "if (" << offset_a << " != " << offset_b << ") {\n"
         << indent << "  raw_value_t a = handle_read_raw(s, state_handle(s, " << offset_a
-          << ", " << t->width() << "ull));\n"
+          << ", " << layout_width(*t) << "ull));\n"
         << indent << "  raw_value_t b = handle_read_raw(s, state_handle(s, " << offset_b
-          << ", " << t->width() << "ull));\n"
+          << ", " << layout_width(*t) << "ull));\n"
         << indent << "  if (a < b) {\n"
         << indent << "    return -1;\n"
         << indent << "  } else if (a > b) {\n"
@@ -429,8 +432,8 @@ static void generate_apply_compare(std::ostream &out, const TypeExpr &type,
       const std::string var = "i" + std::to_string(depth);
       mpz_class ic = a->index_type->count() - 1;
       const std::string len = "((size_t)" + ic.get_str() + "ull)";
-      const std::string width = "((size_t)" + a->element_type->width().get_str()
-        + "ull)";
+      const std::string width = "((size_t)"
+        + layout_width(*a->element_type).get_str() + "ull)";
 
       out << indent << "for (size_t " << var << " = 0; " << var << " < " << len
         << "; " << var << "++) {\n";
@@ -456,8 +459,8 @@ static void generate_apply_compare(std::ostream &out, const TypeExpr &type,
       generate_apply_compare(out, *f->type, off_a, off_b, pivot, depth,
         used_pivot);
 
-      off_a += " + ((size_t)" + f->width().get_str() + "ull)";
-      off_b += " + ((size_t)" + f->width().get_str() + "ull)";
+      off_a += " + ((size_t)" + layout_width(*f->type).get_str() + "ull)";
+      off_b += " + ((size_t)" + layout_width(*f->type).get_str() + "ull)";
     }
     return;
   }
@@ -479,7 +482,8 @@ static void generate_compare_chunk(std::ostream &out, const TypeExpr &t,
      */
     if (is_pivot(pivot, &t) && !used_pivot) {
 
-      const std::string width = "((size_t)" + t.width().get_str() + "ull)";
+      const std::string width = "((size_t)" + layout_width(t).get_str()
+        + "ull)";
       out
 
         /* Open a scope so we don't need to think about redeclaring/shadowing
@@ -512,8 +516,8 @@ static void generate_compare_chunk(std::ostream &out, const TypeExpr &t,
   if (auto a = dynamic_cast<const Array*>(type.get())) {
 
     // The bit size of each array element as a C code string
-    const std::string width = "((size_t)" + a->element_type->width().get_str()
-      + "ull)";
+    const std::string width = "((size_t)"
+      + layout_width(*a->element_type).get_str() + "ull)";
 
     /* If this array is indexed by the pivot type, first compare the relevant
      * elements. Note, we'll only end up descending if the two elements happen
@@ -562,7 +566,8 @@ static void generate_compare_chunk(std::ostream &out, const TypeExpr &t,
       generate_compare_chunk(out, *f->type, off, pivot, depth, used_pivot);
 
       // Jump over this field to get the offset of the next field
-      const std::string width = "((size_t)" + f->width().get_str() + "ull)";
+      const std::string width = "((size_t)"
+        + layout_width(*f->type).get_str() + "ull)";
       off += " + " + width;
     }
 
@@ -710,6 +715,527 @@ static void generate_canonicalise_heuristic(const Model &m,
     << "}\n\n";
 }
 
+static bool is_scalarset(const std::vector<const TypeDecl*> &scalarsets,
+    const TypeExpr *t) {
+  for (const TypeDecl *s : scalarsets) {
+    if (is_pivot(*s, t))
+      return true;
+  }
+  return false;
+}
+
+/* Generate part of the computation of each scalarset element's signature. The
+ * signature of an element must be unaffected by permuting any scalarset, so
+ * values of scalarset type only contribute whether they are defined (or, for
+ * the pivot, whether they refer to the element itself) and the elements of
+ * arrays indexed by a scalarset are combined with a commutative sum.
+ */
+static void generate_signature_chunk(std::ostream &out, const TypeExpr &t,
+    const std::string &offset, const std::string &id,
+    const std::vector<const TypeDecl*> &scalarsets, const TypeDecl &pivot,
+    const std::string &element = "", size_t depth = 0) {
+
+  const std::string indent((depth + 1) * 2, ' ');
+
+  if (t.is_simple()) {
+
+    // outside an element of a pivot-indexed array, only references to pivot
+    // elements are relevant
+    if (element == "" && !is_pivot(pivot, &t))
+      return;
+
+    const std::string width = "((size_t)" + layout_width(t).get_str() + "ull)";
+    out
+      << indent << "{\n"
+      << indent << "  raw_value_t v = handle_read_raw(s, state_handle(s, "
+        << offset << ", " << width << "));\n";
+
+    if (is_pivot(pivot, &t)) {
+      // count the places each element is referred to from
+      out
+        << indent << "  if (v != 0) {\n"
+        << indent << "    sig[v - 1] += signature_mix(" << id << ", 0);\n"
+        << indent << "  }\n";
+      if (element != "")
+        out << indent << "  sig[" << element << "] += signature_mix(" << id
+          << ", v == 0 ? 1 : v - 1 == (raw_value_t)" << element
+          << " ? 2 : 3);\n";
+    } else if (is_scalarset(scalarsets, &t)) {
+      out << indent << "  sig[" << element << "] += signature_mix(" << id
+        << ", v != 0);\n";
+    } else {
+      out << indent << "  sig[" << element << "] += signature_mix(" << id
+        << ", (uint64_t)v);\n";
+    }
+
+    out << indent << "}\n";
+
+    return;
+  }
+
+  const Ptr<TypeExpr> type = t.resolve();
+
+  if (auto a = dynamic_cast<const Array*>(type.get())) {
+
+    const std::string width = "((size_t)"
+      + layout_width(*a->element_type).get_str() + "ull)";
+    mpz_class ic = a->index_type->count() - 1;
+    const std::string ub = "((size_t)" + ic.get_str() + "ull)";
+
+    const std::string var = "i" + std::to_string(depth);
+    out << indent << "for (size_t " << var << " = 0; " << var << " < " << ub
+      << "; " << var << "++) {\n";
+
+    const std::string off = offset + " + " + var + " * " + width;
+
+    if (is_pivot(pivot, a->index_type.get())) {
+      if (element == "") {
+        // entering the data belonging to a single element
+        generate_signature_chunk(out, *a->element_type, off, id, scalarsets,
+          pivot, var, depth + 1);
+      } else {
+        // distinguish an element's relation to itself from its relation to
+        // others
+        const std::string sub = "signature_mix(" + id + ", " + var + " == "
+          + element + ")";
+        generate_signature_chunk(out, *a->element_type, off, sub, scalarsets,
+          pivot, element, depth + 1);
+      }
+    } else if (is_scalarset(scalarsets, a->index_type.get())) {
+      generate_signature_chunk(out, *a->element_type, off, id, scalarsets,
+        pivot, element, depth + 1);
+    } else {
+      const std::string sub = "signature_mix(" + id + ", " + var + ")";
+      generate_signature_chunk(out, *a->element_type, off, sub, scalarsets,
+        pivot, element, depth + 1);
+    }
+
+    out << indent << "}\n";
+
+    return;
+  }
+
+  if (auto r = dynamic_cast<const Record*>(type.get())) {
+
+    std::string off = offset;
+    size_t index = 0;
+
+    for (const Ptr<VarDecl> &f : r->fields) {
+
+      const std::string sub = "signature_mix(" + id + ", "
+        + std::to_string(index) + ")";
+      generate_signature_chunk(out, *f->type, off, sub, scalarsets, pivot,
+        element, depth);
+
+      const std::string width = "((size_t)"
+        + layout_width(*f->type).get_str() + "ull)";
+      off += " + " + width;
+      index++;
+    }
+
+    return;
+  }
+
+  assert(!"missed case in generate_signature_chunk");
+}
+
+/* Generate a function to compute a signature for each element of a given
+ * scalarset that does not change when the state is permuted.
+ */
+static void generate_signature(std::ostream &out, const TypeDecl &pivot,
+    const std::vector<const TypeDecl*> &scalarsets, const Model &m) {
+
+  out
+    << "static void signature_" << pivot.name << "(const struct state *s, "
+      << "uint64_t *NONNULL sig) {\n";
+
+  size_t index = 0;
+  for (const Ptr<Node> &c : m.children) {
+    if (auto v = dynamic_cast<const VarDecl*>(c.get())) {
+      const std::string offset = "((size_t)" + v->offset.get_str() + "ull)";
+      const std::string id = "UINT64_C(" + std::to_string(index) + ")";
+      generate_signature_chunk(out, *v->type, offset, id, scalarsets, pivot);
+      index++;
+    }
+  }
+
+  out
+    << "}\n\n";
+}
+
+static void generate_canonicalise_signature(const Model &m,
+    const std::vector<const TypeDecl*> &scalarsets, std::ostream &out) {
+
+  for (const TypeDecl *t : scalarsets)
+    generate_signature(out, *t, scalarsets, m);
+
+  // the total number of scalarset elements, and the largest scalarset
+  mpz_class total = 0;
+  mpz_class largest = 1;
+  for (const TypeDecl *t : scalarsets) {
+    mpz_class bound = t->value->resolve()->count() - 1;
+    total += bound;
+    if (bound > largest)
+      largest = bound;
+  }
+
+  out
+    << "static __attribute__((unused)) void swap_signature(struct state *s,\n"
+    << "    size_t scalarset, size_t x, size_t y) {\n"
+    << "  switch (scalarset) {\n";
+  {
+    size_t index = 0;
+    for (const TypeDecl *t : scalarsets) {
+      out
+        << "    case " << index << ":\n"
+        << "      swap_" << t->name << "(s, x, y);\n"
+        << "      break;\n";
+      index++;
+    }
+  }
+  out
+    << "  }\n"
+    << "  (void)s;\n"
+    << "  (void)x;\n"
+    << "  (void)y;\n"
+    << "}\n\n"
+
+    << "/* A run of scalarset elements with equal signatures, whose order cannot\n"
+    << " * be decided by the signatures alone.\n"
+    << " */\n"
+    << "struct signature_tie {\n"
+    << "  size_t scalarset;\n"
+    << "  size_t lower; /* offset of the run's first element in `schedule` */\n"
+    << "  size_t first; /* index of the run's first element */\n"
+    << "  size_t length;\n"
+    << "};\n\n"
+
+    << "/* Try every permutation of the elements within each tie, keeping the\n"
+    << " * smallest state found in `s`.\n"
+    << " */\n"
+    << "static __attribute__((unused)) void permute_signature(\n"
+    << "    struct state *NONNULL s,\n"
+    << "    struct state *NONNULL candidate, size_t *NONNULL schedule,\n"
+    << "    size_t *NONNULL best, const struct signature_tie *ties,\n"
+    << "    size_t tie_count) {\n"
+    << "\n"
+    << "  if (tie_count == 0) {\n"
+    << "    if (state_cmp(candidate, s) < 0) {\n"
+    << "      /* Found a more canonical representation. */\n"
+    << "      memcpy(s, candidate, sizeof(*s));\n"
+    << "      memcpy(best, schedule, sizeof(best[0]) * (size_t)"
+      << total.get_str() << "ull);\n"
+    << "    }\n"
+    << "    return;\n"
+    << "  }\n"
+    << "\n"
+    << "  /* use Heap's algorithm to step through the permutations of this tie */\n"
+    << "  const struct signature_tie *t = &ties[0];\n"
+    << "  size_t stack[(size_t)" << largest.get_str() << "ull] = { 0 };\n"
+    << "  permute_signature(s, candidate, schedule, best, ties + 1, tie_count - 1);\n"
+    << "  for (size_t i = 1; i < t->length; ) {\n"
+    << "    if (stack[i] < i) {\n"
+    << "      size_t x = i % 2 == 0 ? 0 : stack[i];\n"
+    << "      swap_signature(candidate, t->scalarset, t->first + x, t->first + i);\n"
+    << "      size_t tmp = schedule[t->lower + x];\n"
+    << "      schedule[t->lower + x] = schedule[t->lower + i];\n"
+    << "      schedule[t->lower + i] = tmp;\n"
+    << "      permute_signature(s, candidate, schedule, best, ties + 1,\n"
+    << "        tie_count - 1);\n"
+    << "      stack[i]++;\n"
+    << "      i = 1;\n"
+    << "    } else {\n"
+    << "      stack[i] = 0;\n"
+    << "      i++;\n"
+    << "    }\n"
+    << "  }\n"
+    << "}\n\n"
+
+    << "static void state_canonicalise_signature(struct state *s "
+      "__attribute__((unused))) {\n"
+    << "\n"
+    << "  assert(s != NULL && \"attempt to canonicalise NULL state\");\n"
+    << "\n";
+
+  if (!scalarsets.empty()) {
+    out
+      << "  /* the permutation applied so far, for each scalarset in turn */\n"
+      << "  size_t schedule[(size_t)" << total.get_str() << "ull];\n"
+      << "  size_t best[(size_t)" << total.get_str() << "ull];\n"
+      << "\n"
+      << "  /* runs of elements whose order is not decided by their signatures */\n"
+      << "  struct signature_tie ties[(size_t)" << total.get_str() << "ull];\n"
+      << "  size_t tie_count = 0;\n"
+      << "\n";
+
+    mpz_class lower = 0;
+    size_t index = 0;
+    for (const TypeDecl *t : scalarsets) {
+
+      const mpz_class bound = t->value->resolve()->count() - 1;
+      const std::string b = "(size_t)" + bound.get_str() + "ull";
+      const std::string sched = "&schedule[" + lower.get_str() + "]";
+
+      out
+        << "  {\n"
+        << "    size_t *sched = " << sched << ";\n"
+        << "    for (size_t i = 0; i < " << b << "; ++i) {\n"
+        << "      sched[i] = i;\n"
+        << "    }\n"
+        << "    if (USE_SCALARSET_SCHEDULES) {\n"
+        << "      size_t index = schedule_read_" << t->name << "(s);\n"
+        << "      size_t stack[" << b << "];\n"
+        << "      index_to_permutation(index, sched, stack, " << b << ");\n"
+        << "    }\n"
+        << "\n"
+        << "    uint64_t sig[" << b << "] = { 0 };\n"
+        << "    signature_" << t->name << "(s, sig);\n"
+        << "\n"
+        << "    /* order the elements by their signatures */\n"
+        << "    for (size_t i = 0; i < " << b << "; ++i) {\n"
+        << "      size_t min = i;\n"
+        << "      for (size_t j = i + 1; j < " << b << "; ++j) {\n"
+        << "        if (sig[j] < sig[min]) {\n"
+        << "          min = j;\n"
+        << "        }\n"
+        << "      }\n"
+        << "      if (min != i) {\n"
+        << "        swap_" << t->name << "(s, i, min);\n"
+        << "        uint64_t tmp = sig[i];\n"
+        << "        sig[i] = sig[min];\n"
+        << "        sig[min] = tmp;\n"
+        << "        size_t tmp2 = sched[i];\n"
+        << "        sched[i] = sched[min];\n"
+        << "        sched[min] = tmp2;\n"
+        << "      }\n"
+        << "    }\n"
+        << "\n"
+        << "    /* note the elements that remain tied */\n"
+        << "    for (size_t i = 0; i < " << b << "; ) {\n"
+        << "      size_t j = i + 1;\n"
+        << "      while (j < " << b << " && sig[j] == sig[i]) {\n"
+        << "        j++;\n"
+        << "      }\n"
+        << "      if (j - i > 1) {\n"
+        << "        ties[tie_count] = (struct signature_tie){ .scalarset = "
+          << index << ", .lower = " << lower.get_str() << "ull + i, .first = i, "
+          << ".length = j - i };\n"
+        << "        tie_count++;\n"
+        << "      }\n"
+        << "      i = j;\n"
+        << "    }\n"
+        << "  }\n"
+        << "\n";
+
+      lower += bound;
+      index++;
+    }
+
+    out
+      << "  if (tie_count > 0) {\n"
+      << "    /* A state to store the current permutation we are considering. */\n"
+      << "    static _Thread_local struct state candidate;\n"
+      << "    memcpy(&candidate, s, sizeof(candidate));\n"
+      << "    memcpy(best, schedule, sizeof(best));\n"
+      << "    permute_signature(s, &candidate, schedule, best, ties, tie_count);\n"
+      << "  } else {\n"
+      << "    memcpy(best, schedule, sizeof(best));\n"
+      << "  }\n"
+      << "\n"
+      << "  /* save selected schedule to map this back for later more\n"
+      << "   * comprehensible counterexample traces\n"
+      << "   */\n"
+      << "  if (USE_SCALARSET_SCHEDULES) {\n";
+
+    lower = 0;
+    for (const TypeDecl *t : scalarsets) {
+      const mpz_class bound = t->value->resolve()->count() - 1;
+      const std::string b = "(size_t)" + bound.get_str() + "ull";
+      out
+        << "    {\n"
+        << "      size_t stack[" << b << "];\n"
+        << "      size_t working[" << b << "];\n"
+        << "      size_t index = permutation_to_index(&best[" << lower.get_str()
+          << "], stack, working, " << b << ");\n"
+        << "      schedule_write_" << t->name << "(s, index);\n"
+        << "    }\n";
+      lower += bound;
+    }
+
+    out
+      << "  }\n";
+  }
+
+  out
+    << "}\n\n";
+}
+
+// could this type contain data that is changed by permuting a scalarset?
+static bool is_symmetric(const std::vector<const TypeDecl*> &scalarsets,
+    const TypeExpr &t) {
+
+  if (is_scalarset(scalarsets, &t))
+    return true;
+
+  const Ptr<TypeExpr> type = t.resolve();
+
+  if (auto a = dynamic_cast<const Array*>(type.get()))
+    return is_scalarset(scalarsets, a->index_type.get())
+      || is_symmetric(scalarsets, *a->element_type);
+
+  if (auto r = dynamic_cast<const Record*>(type.get())) {
+    for (const Ptr<VarDecl> &f : r->fields) {
+      if (is_symmetric(scalarsets, *f->type))
+        return true;
+    }
+  }
+
+  return false;
+}
+
+/* Could writing to this lvalue change data that is affected by permuting a
+ * scalarset? This is the case if the written data itself is symmetric or it
+ * lies within an array indexed by a scalarset.
+ */
+static bool writes_symmetric(const std::vector<const TypeDecl*> &scalarsets,
+    const Expr &lhs, bool within = false) {
+
+  if (auto id = dynamic_cast<const ExprID*>(&lhs)) {
+    if (auto a = dynamic_cast<const AliasDecl*>(id->value.get()))
+      return writes_symmetric(scalarsets, *a->value, within);
+    auto v = dynamic_cast<const VarDecl*>(id->value.get());
+    if (v == nullptr || !v->is_in_state())
+      return false;
+    return within || is_symmetric(scalarsets, *lhs.type());
+  }
+
+  if (auto f = dynamic_cast<const Field*>(&lhs))
+    return writes_symmetric(scalarsets, *f->record,
+      within || is_symmetric(scalarsets, *lhs.type()));
+
+  if (auto e = dynamic_cast<const Element*>(&lhs)) {
+    const Ptr<TypeExpr> t = e->array->type()->resolve();
+    auto a = dynamic_cast<const Array*>(t.get());
+    assert(a != nullptr && "non-array indexed in writes_symmetric");
+    return writes_symmetric(scalarsets, *e->array, within
+      || is_symmetric(scalarsets, *lhs.type())
+      || is_scalarset(scalarsets, a->index_type.get()));
+  }
+
+  // something we do not understand
+  return true;
+}
+
+namespace {
+
+class SymmetricWrites : public ConstTraversal {
+
+ private:
+  const std::vector<const TypeDecl*> &scalarsets;
+
+  // functions whose bodies we have already looked at
+  std::set<std::string> seen_functions;
+
+ public:
+  bool result = false;
+
+  explicit SymmetricWrites(const std::vector<const TypeDecl*> &scalarsets_):
+    scalarsets(scalarsets_) { }
+
+  void visit_assignment(const Assignment &n) final {
+    result |= writes_symmetric(scalarsets, *n.lhs);
+    dispatch(*n.rhs);
+  }
+
+  void visit_clear(const Clear &n) final {
+    result |= writes_symmetric(scalarsets, *n.rhs);
+  }
+
+  void visit_functioncall(const FunctionCall &n) final {
+
+    for (size_t i = 0; i < n.arguments.size(); i++) {
+      dispatch(*n.arguments[i]);
+      // a var parameter may be written by the callee
+      if (n.function == nullptr || i >= n.function->parameters.size() ||
+          !n.function->parameters[i]->readonly) {
+        if (n.arguments[i]->is_lvalue())
+          result |= writes_symmetric(scalarsets, *n.arguments[i]);
+      }
+    }
+
+    if (n.function == nullptr) {
+      result = true;
+      return;
+    }
+
+    // the callee may also write to state variables directly
+    if (seen_functions.insert(n.name).second) {
+      for (const Ptr<Decl> &d : n.function->decls)
+        dispatch(*d);
+      for (const Ptr<Stmt> &s : n.function->body)
+        dispatch(*s);
+    }
+  }
+
+  void visit_undefine(const Undefine &n) final {
+    result |= writes_symmetric(scalarsets, *n.rhs);
+  }
+};
+
+}
+
+bool may_write_symmetric(const Model &m, const SimpleRule &r) {
+
+  const std::vector<const TypeDecl*> scalarsets = get_scalarsets(m);
+  if (scalarsets.empty())
+    return false;
+
+  SymmetricWrites w(scalarsets);
+  for (const Ptr<Stmt> &s : r.body)
+    w.dispatch(*s);
+  return w.result;
+}
+
+static void generate_schedule_compose(
+    const std::vector<const TypeDecl*> &scalarsets, std::ostream &out) {
+
+  out
+    << "static __attribute__((unused)) void state_schedule_reset("
+      << "struct state *NONNULL s __attribute__((unused))) {\n";
+  for (const TypeDecl *t : scalarsets)
+    out << "  schedule_write_" << t->name << "(s, 0);\n";
+  out
+    << "}\n\n";
+
+  out
+    << "static __attribute__((unused)) void state_schedule_compose(\n"
+    << "    struct state *NONNULL s __attribute__((unused)),\n"
+    << "    const struct state *NONNULL relative __attribute__((unused))) {\n";
+  for (const TypeDecl *t : scalarsets) {
+    const mpz_class bound = t->value->resolve()->count() - 1;
+    const std::string b = "(size_t)" + bound.get_str() + "ull";
+    out
+      << "  {\n"
+      << "    size_t p[" << b << "];\n"
+      << "    size_t r[" << b << "];\n"
+      << "    size_t c[" << b << "];\n"
+      << "    size_t stack[" << b << "];\n"
+      << "    size_t working[" << b << "];\n"
+      << "    index_to_permutation(schedule_read_" << t->name << "(s), p, stack, "
+        << b << ");\n"
+      << "    index_to_permutation(schedule_read_" << t->name << "(relative), r, "
+        << "stack, " << b << ");\n"
+      << "    for (size_t i = 0; i < " << b << "; ++i) {\n"
+      << "      c[i] = p[r[i]];\n"
+      << "    }\n"
+      << "    schedule_write_" << t->name << "(s, permutation_to_index(c, stack, "
+        << "working, " << b << "));\n"
+      << "  }\n";
+  }
+  out
+    << "}\n\n";
+}
+
 void generate_canonicalise(const Model &m, std::ostream &out) {
 
   // Find types eligible for use in canonicalisation
@@ -734,4 +1260,8 @@ void generate_canonicalise(const Model &m, std::ostream &out) {
   generate_canonicalise_exhaustive(scalarsets, out);
 
   generate_canonicalise_heuristic(m, scalarsets, out);
+
+  generate_canonicalise_signature(m, scalarsets, out);
+
+  generate_schedule_compose(scalarsets, out);
 }
@@ -18,3 +18,9 @@ mpz_class get_schedule_width(const rumur::TypeDecl &t);
  * will only be used when symmetry reduction is enabled.
  */
 void generate_canonicalise(const rumur::Model &m, std::ostream &out);
+
+/* Could firing this rule change any state data that is affected by permuting a
+ * scalarset? If not, the rule's successors of a canonical state are already
+ * canonical.
+ */
+bool may_write_symmetric(const rumur::Model &m, const rumur::SimpleRule &r);
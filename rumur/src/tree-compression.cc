@@ -0,0 +1,95 @@
+#include "align-fields.h"
+#include <cstddef>
+#include <gmpxx.h>
+#include <iostream>
+#include "options.h"
+#include <rumur/rumur.h>
+#include <set>
+#include "tree-compression.h"
+#include <utility>
+#include <vector>
+
+using namespace rumur;
+
+// maximum width of a leaf, which must fit in a child of a tree node in header.c
+static const unsigned long MAX_LEAF_WIDTH = 31;
+
+// note the offsets at which each simple typed value within a type starts
+static void boundaries(const TypeExpr &t, const mpz_class &offset,
+    std::set<mpz_class> &out) {
+
+  const Ptr<TypeExpr> type = t.resolve();
+
+  if (auto a = dynamic_cast<const Array*>(type.get())) {
+    const mpz_class elements = a->index_type->count() - 1;
+    const mpz_class width = layout_width(*a->element_type);
+    for (mpz_class i = 0; i < elements; i++)
+      boundaries(*a->element_type, offset + i * width, out);
+    return;
+  }
+
+  if (auto r = dynamic_cast<const Record*>(type.get())) {
+    mpz_class o = offset;
+    for (const Ptr<VarDecl> &f : r->fields) {
+      boundaries(*f->type, o, out);
+      o += layout_width(*f->type);
+    }
+    return;
+  }
+
+  out.insert(offset);
+}
+
+void generate_tree_leaves(const Model &m, std::ostream &out) {
+
+  if (options.tree_compression == 0)
+    return;
+
+  const mpz_class end = layout_size_bits(m);
+
+  std::set<mpz_class> starts{0};
+  for (const Ptr<Node> &c : m.children) {
+    if (auto v = dynamic_cast<const VarDecl*>(c.get()))
+      boundaries(*v->type, v->offset, starts);
+  }
+
+  // pack consecutive values into leaves as long as they fit, splitting any
+  // value wider than a leaf
+  std::vector<std::pair<mpz_class, mpz_class>> leaves;
+  mpz_class leaf_start = 0;
+  mpz_class leaf_end = 0;
+  for (auto it = starts.begin(); it != starts.end() && *it < end; ++it) {
+    const mpz_class value_start = *it;
+    const mpz_class value_end = std::next(it) == starts.end() ? end
+      : *std::next(it);
+
+    if (value_end - leaf_start <= MAX_LEAF_WIDTH) {
+      leaf_end = value_end;
+      continue;
+    }
+
+    if (leaf_end > leaf_start)
+      leaves.emplace_back(leaf_start, leaf_end - leaf_start);
+
+    leaf_start = value_start;
+    while (value_end - leaf_start > MAX_LEAF_WIDTH) {
+      leaves.emplace_back(leaf_start, MAX_LEAF_WIDTH);
+      leaf_start += MAX_LEAF_WIDTH;
+    }
+    leaf_end = value_end;
+  }
+
+  // an empty state still has a (zero width) leaf, so the tree has a root
+  if (leaf_end > leaf_start || leaves.empty())
+    leaves.emplace_back(leaf_start, leaf_end - leaf_start);
+
+  out << "enum { TREE_LEAVES = " << leaves.size() << "ul };\n"
+      << "static const size_t TREE_LEAF_OFFSET[] = {";
+  for (const std::pair<mpz_class, mpz_class> &l : leaves)
+    out << " " << l.first << ",";
+  out << " };\n"
+      << "static const size_t TREE_LEAF_WIDTH[] = {";
+  for (const std::pair<mpz_class, mpz_class> &l : leaves)
+    out << " " << l.second << ",";
+  out << " };\n\n";
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <iostream>
+#include <rumur/rumur.h>
+
+/* Generate the leaves tree compression cuts a state into, TREE_LEAVES and the
+ * tables TREE_LEAF_OFFSET and TREE_LEAF_WIDTH giving each leaf's bit offset
+ * and width within the state data. Leaves follow the boundaries of the simple
+ * typed values in the state, so that changing one value usually only changes
+ * one leaf. Nothing is generated unless tree compression is enabled.
+ */
+void generate_tree_leaves(const rumur::Model &m, std::ostream &out);
@@ -0,0 +1,23 @@
+-- rumur_flags: ['--bitstate', '1']
+-- checker_output: re.compile(r'<summary states="22"[^>]* coverage_estimate="' if self.xml else r'\b22 states\b[\s\S]*\bEstimated coverage of the bitstate search is\b')
+
+-- basic test of --bitstate
+
+var
+  x: 0 .. 10;
+  y: boolean;
+
+startstate begin
+  x := 0;
+  y := false;
+end;
+
+rule x < 10 ==> begin
+  x := x + 1;
+end;
+
+rule begin
+  y := !y;
+end;
+
+invariant x <= 10;
@@ -0,0 +1,37 @@
+-- rumur_flags: ['--canonical-cache', 'on', '--symmetry-reduction', 'exhaustive']
+-- checker_output: re.compile(r'<summary states="56"' if self.xml else r'\b56 states\b')
+
+-- --canonical-cache should not change the states found by symmetry reduction,
+-- whether a successor is canonicalised, looked up in the cache or known to be
+-- canonical because its rule ("tick") does not touch symmetric data
+
+type
+  node: scalarset(3);
+
+var
+  st: array[node] of enum { idle, busy };
+  tick: 0 .. 7;
+  last: node;
+
+startstate begin
+  for i: node do
+    st[i] := idle;
+  end;
+  tick := 0;
+  undefine last;
+end;
+
+ruleset i: node do
+  rule "go" st[i] = idle ==> begin
+    st[i] := busy;
+    last := i;
+  end;
+
+  rule "stop" st[i] = busy ==> begin
+    st[i] := idle;
+  end;
+end;
+
+rule "tick" true ==> begin
+  tick := (tick + 1) % 8;
+end;
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+
+'''
+Test that a run resumed from a checkpoint finds the same state space as an
+uninterrupted run.
+'''
+
+import os
+import re
+import shutil
+import subprocess as sp
+import sys
+import tempfile
+
+MODEL = '''
+var
+  x: 0 .. 200;
+  y: 0 .. 30;
+  b: boolean;
+
+startstate begin
+  x := 0;
+  y := 0;
+  b := false;
+end;
+
+rule "inc x" x < 200 ==> begin
+  x := x + 1;
+end;
+
+rule "inc y" y < 30 ==> begin
+  y := y + 1;
+end;
+
+rule "flip" begin
+  b := !b;
+end;
+'''
+
+def check(tmp: str, model: str, args: [str]) -> sp.CompletedProcess:
+  '''generate, compile and run a checker'''
+
+  model_c = os.path.join(tmp, 'model.c')
+  sp.run(['rumur', '--output', model_c] + args, check=True,
+    input=model.encode('utf-8', 'replace'))
+
+  model_bin = os.path.join(tmp, 'model.exe')
+  argv = [os.environ.get('CC', 'cc'), '-std=c11', '-o', model_bin, model_c,
+    '-lpthread']
+  if os.environ.get('HAS_MCX16') == 'True':
+    argv.append('-mcx16')
+  if os.environ.get('NEEDS_LIBATOMIC') == 'True':
+    argv.append('-latomic')
+  sp.run(argv, check=True)
+
+  return sp.run([model_bin], stdout=sp.PIPE, stderr=sp.STDOUT,
+    universal_newlines=True)
+
+def summary(output: str) -> str:
+  '''extract the count of states and rules fired from a checker's output'''
+  m = re.search(r'\b\d+ states, \d+ rules fired\b', output)
+  assert m is not None, f'no summary in output:\n{output}'
+  return m.group(0)
+
+def main():
+
+  tmp = tempfile.mkdtemp()
+  try:
+    checkpoint = os.path.join(tmp, 'checkpoint')
+
+    # an uninterrupted run that checkpoints as often as it can
+    first = check(tmp, MODEL, ['--threads', '2', '--checkpoint', checkpoint,
+      '--checkpoint-every', '0'])
+    assert first.returncode == 0, f'checkpointing run failed:\n{first.stdout}'
+    assert 'checkpointed' in first.stdout, \
+      f'no checkpoints were taken:\n{first.stdout}'
+
+    # resuming from the last of these should reach the same totals
+    second = check(tmp, MODEL, ['--threads', '2', '--resume', checkpoint])
+    assert second.returncode == 0, f'resumed run failed:\n{second.stdout}'
+    assert summary(first.stdout) == summary(second.stdout), \
+      f'resumed run diverged:\n{first.stdout}\n{second.stdout}'
+
+    # a checkpoint should not be accepted by a checker for a different model
+    other = MODEL.replace('200', '100')
+    third = check(tmp, other, ['--resume', checkpoint])
+    assert third.returncode != 0, \
+      f'checkpoint of a different model was accepted:\n{third.stdout}'
+
+  finally:
+    shutil.rmtree(tmp)
+
+  return 0
+
+if __name__ == '__main__':
+  sys.exit(main())
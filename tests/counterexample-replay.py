@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+
+'''
+Test that a verifier generated with --counterexample-replay reconstructs the
+same counterexample traces as one that stores a path back to a start state in
+every state.
+'''
+
+import os
+import re
+import shutil
+import subprocess as sp
+import sys
+import tempfile
+
+# an error within a rule at depth 53, after which checking continues to an
+# invariant violation at depth 108
+MODEL = '''
+var
+  x: 0 .. 1000;
+  y: 0 .. 30;
+
+startstate begin
+  x := 0;
+  y := 0;
+end;
+
+rule "step" x < 1000 ==> begin
+  x := x + 1;
+end;
+
+rule "jump" x < 990 ==> begin
+  x := x + 10;
+end;
+
+rule "wiggle" y < 30 ==> begin
+  y := y + 1;
+end;
+
+rule "check" x = 500 ==> begin
+  assert y != 3 "y is 3 when x is 500";
+end;
+
+invariant "x is not 999" x != 999;
+'''
+
+def traces(tmp: str, args: [str]) -> [str]:
+  '''generate, compile and run a checker, returning its counterexample traces'''
+
+  model_c = os.path.join(tmp, 'model.c')
+  sp.run(['rumur', '--threads', '1', '--max-errors', '2', '--output', model_c]
+    + args, check=True, input=MODEL.encode('utf-8', 'replace'))
+
+  model_bin = os.path.join(tmp, 'model.exe')
+  argv = [os.environ.get('CC', 'cc'), '-std=c11', '-o', model_bin, model_c,
+    '-lpthread']
+  if os.environ.get('HAS_MCX16') == 'True':
+    argv.append('-mcx16')
+  if os.environ.get('NEEDS_LIBATOMIC') == 'True':
+    argv.append('-latomic')
+  sp.run(argv, check=True)
+
+  p = sp.run([model_bin], stdout=sp.PIPE, stderr=sp.STDOUT,
+    universal_newlines=True)
+  assert p.returncode != 0, f'errors not found:\n{p.stdout}'
+
+  found = re.findall(r'^The following is the error trace for the error:$.*?'
+    r'^End of the error trace\.$', p.stdout, re.MULTILINE | re.DOTALL)
+  assert len(found) == 2, f'expected two counterexample traces:\n{p.stdout}'
+  return found
+
+def main():
+
+  tmp = tempfile.mkdtemp()
+  try:
+    stored = traces(tmp, [])
+    replayed = traces(tmp, ['--counterexample-replay', 'on'])
+
+    for s, r in zip(stored, replayed):
+      assert s == r, f'replayed trace differs:\n{s}\nvs\n{r}'
+
+    steps = re.findall(r'^(?:Startstate|Rule) .* fired\.$', replayed[1],
+      re.MULTILINE)
+    assert len(steps) == 1 + 99 + 9, \
+      f'unexpected length of replayed trace:\n{replayed[1]}'
+
+  finally:
+    shutil.rmtree(tmp)
+
+  return 0
+
+if __name__ == '__main__':
+  sys.exit(main())
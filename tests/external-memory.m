@@ -0,0 +1,26 @@
+-- rumur_flags: ['--external-memory', tempfile.gettempdir(), '--set-capacity', '1024']
+-- checker_output: re.compile(r'<summary states="441"' if self.xml else r'\b441 states\b')
+
+-- test of --external-memory with a seen set cache too small to hold all states
+
+var
+  x: 0 .. 20;
+  y: 0 .. 20;
+
+startstate begin
+  x := 0;
+  y := 0;
+end;
+
+rule x < 20 ==> begin
+  x := x + 1;
+end;
+
+rule y < 20 ==> begin
+  y := y + 1;
+end;
+
+rule x > 0 & y > 0 ==> begin
+  x := x - 1;
+  y := y - 1;
+end;
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+
+'''
+Test that guards reading fixed-position variables are evaluated correctly when
+the checker is optimised and guards catch errors with sigsetjmp().
+'''
+
+import os
+import re
+import shutil
+import subprocess as sp
+import sys
+import tempfile
+
+# each rule should only be enabled until its variable reaches its bound
+MODEL = '''
+var
+  x: 0 .. 20;
+  y: 0 .. 10;
+
+startstate begin
+  x := 0;
+  y := 0;
+end;
+
+rule "x" x < 20 ==> begin
+  x := x + 1;
+end;
+
+rule "y" y < 10 ==> begin
+  y := y + 1;
+end;
+
+rule "both" x < 20 & y < 10 ==> begin
+  x := x + 1;
+  y := y + 1;
+end;
+
+rule "reset" x = 20 & y = 10 ==> begin
+  x := 0;
+  y := 0;
+end;
+'''
+
+def main():
+
+  tmp = tempfile.mkdtemp()
+  try:
+    # more than one error means guards need a jmp_buf to recover from errors
+    model_c = os.path.join(tmp, 'model.c')
+    sp.run(['rumur', '--max-errors', '2', '--counterexample-trace', 'off',
+      '--output', model_c], check=True, input=MODEL.encode('utf-8', 'replace'))
+
+    model_bin = os.path.join(tmp, 'model.exe')
+    argv = [os.environ.get('CC', 'cc'), '-std=c11', '-O2', '-o', model_bin,
+      model_c, '-lpthread']
+    if os.environ.get('HAS_MCX16') == 'True':
+      argv.append('-mcx16')
+    if os.environ.get('NEEDS_LIBATOMIC') == 'True':
+      argv.append('-latomic')
+    sp.run(argv, check=True)
+
+    # a guard wrongly evaluating to true would lead to an out-of-range write
+    p = sp.run([model_bin], stdout=sp.PIPE, universal_newlines=True)
+    output = p.stdout
+    assert p.returncode == 0, f'unexpected errors:\n{output}'
+    assert re.search(r'\b231 states, 631 rules fired\b', output), \
+      f'unexpected number of states explored or rules fired:\n{output}'
+
+  finally:
+    shutil.rmtree(tmp)
+
+  return 0
+
+if __name__ == '__main__':
+  sys.exit(main())
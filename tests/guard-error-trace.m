@@ -0,0 +1,25 @@
+-- checker_exit_code: 1
+-- checker_output: re.compile(r'<transition>Rule &quot;bad&quot;</transition>' if self.xml else r'^Rule "bad" fired\.$', re.MULTILINE)
+
+-- Guards are evaluated against the state being expanded, without first taking
+-- a copy of it. An error within a guard should still produce a counterexample
+-- trace ending in the rule whose guard failed.
+
+var
+  x: 0..3;
+  a: array[0..1] of 0..3;
+
+startstate begin
+  x := 0;
+  a[0] := 0;
+  a[1] := 0;
+end;
+
+rule "inc" x < 3 ==> begin
+  x := x + 1;
+end;
+
+-- overflows in the start state
+rule "bad" a[x - 1] = 0 ==> begin
+  a[0] := 1;
+end;
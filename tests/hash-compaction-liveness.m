@@ -0,0 +1,17 @@
+-- rumur_flags: ['--hash-compaction', '64']
+-- rumur_exit_code: 1
+
+-- --hash-compaction should be rejected for a model with liveness properties
+
+var
+  x: boolean;
+
+startstate begin
+  x := false;
+end;
+
+rule begin
+  x := !x;
+end;
+
+liveness "x is eventually true" x;
@@ -0,0 +1,23 @@
+-- rumur_flags: ['--hash-compaction', '64']
+-- checker_output: re.compile(r'<summary states="22"[^>]* omission_probability="' if self.xml else r'\b22 states\b[\s\S]*\bProbability of omitting a state due to hash compaction is at most\b')
+
+-- basic test of --hash-compaction
+
+var
+  x: 0 .. 10;
+  y: boolean;
+
+startstate begin
+  x := 0;
+  y := false;
+end;
+
+rule x < 10 ==> begin
+  x := x + 1;
+end;
+
+rule begin
+  y := !y;
+end;
+
+invariant x <= 10;
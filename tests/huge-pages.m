@@ -0,0 +1,23 @@
+-- rumur_flags: ['--huge-pages', 'explicit']
+-- checker_output: re.compile(r'<summary states="20"' if self.xml else r'\b20 states\b')
+
+-- a basic model checked with the seen set and state arenas backed by huge
+-- pages, falling back to transparent huge pages or normal pages when these are
+-- unavailable
+
+var
+  x: 0 .. 9;
+  y: boolean;
+
+startstate begin
+  x := 0;
+  y := false;
+end;
+
+rule begin
+  x := (x + 1) % 10;
+end;
+
+rule begin
+  y := !y;
+end;
@@ -0,0 +1,60 @@
+-- rumur_flags: ['--incremental-hash', 'on']
+-- checker_output: re.compile(r'<summary states="3584"' if self.xml else r'\b3584 states\b')
+
+-- test that --incremental-hash explores the same state space when states are
+-- written through assignments of simple values, whole records and arrays,
+-- undefines and function calls
+
+type
+  t: record
+    a: 0 .. 3;
+    b: boolean;
+  end;
+
+var
+  x: t;
+  y: array[0 .. 1] of t;
+  z: 0 .. 5;
+
+function bump(v: t): t;
+var r: t;
+begin
+  r := v;
+  r.a := (v.a + 1) % 4;
+  return r;
+end;
+
+startstate begin
+  undefine x;
+  x.a := 0;
+  x.b := false;
+  for i: 0 .. 1 do
+    y[i] := x;
+  end;
+  z := 0;
+end;
+
+rule "bump x" true ==> begin
+  x := bump(x);
+end;
+
+rule "flip x" true ==> begin
+  x.b := !x.b;
+end;
+
+rule "save x" true ==> begin
+  y[1] := y[0];
+  y[0] := x;
+end;
+
+rule "count" !isundefined(z) & z < 5 ==> begin
+  z := z + 1;
+end;
+
+rule "forget" !isundefined(z) & z = 5 ==> begin
+  undefine z;
+end;
+
+rule "restart" isundefined(z) ==> begin
+  z := 0;
+end;
@@ -0,0 +1,34 @@
+-- rumur_flags: ['--counterexample-trace', 'off', '--set-capacity', '8192']
+-- checker_output: re.compile(r'<summary states="20301"' if self.xml else r'\b20301 states\b')
+
+-- as for inline-states.m, but with a state that needs a 16-byte slot
+
+var
+  x: 0 .. 200;
+  y: 0 .. 100;
+  z: array [0 .. 7] of 0 .. 255;
+
+startstate begin
+  x := 0;
+  y := 0;
+  for i: 0 .. 7 do
+    z[i] := 0;
+  end;
+end;
+
+rule "inc x" x < 200 ==> begin
+  x := x + 1;
+  z[x % 8] := x;
+end;
+
+rule "inc y" y < 100 ==> begin
+  y := y + 1;
+end;
+
+rule "reset" x = 200 & y = 100 ==> begin
+  x := 0;
+  y := 0;
+  for i: 0 .. 7 do
+    z[i] := 0;
+  end;
+end;
@@ -0,0 +1,27 @@
+-- rumur_flags: ['--counterexample-trace', 'off', '--set-capacity', '8192']
+-- checker_output: re.compile(r'<summary states="20301"' if self.xml else r'States are stored inline in 8-byte seen set slots\.[\s\S]*\b20301 states\b')
+
+-- test that storing small states inline in the seen set explores the same
+-- state space, across several expansions of the set
+
+var
+  x: 0 .. 200;
+  y: 0 .. 100;
+
+startstate begin
+  x := 0;
+  y := 0;
+end;
+
+rule "inc x" x < 200 ==> begin
+  x := x + 1;
+end;
+
+rule "inc y" y < 100 ==> begin
+  y := y + 1;
+end;
+
+rule "reset" x = 200 & y = 100 ==> begin
+  x := 0;
+  y := 0;
+end;
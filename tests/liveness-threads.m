@@ -0,0 +1,40 @@
+-- rumur_flags: ['--threads', '4']
+-- checker_exit_code: 1
+-- checker_output: None if self.xml else re.compile(r'liveness property "y is 100" violated')
+
+/* A liveness property that only fails once the model falls into a trap, from
+ * which y stops increasing. The final liveness check has to pass what it knows
+ * back through many states, from multiple threads, to tell these apart.
+ */
+
+var
+  x: 0 .. 200;
+  y: 0 .. 100;
+  trap: boolean;
+
+startstate begin
+  x := 0;
+  y := 0;
+  trap := false;
+end
+
+rule x < 200 ==> begin
+  x := x + 1;
+end
+
+rule !trap & y < 100 ==> begin
+  y := y + 1;
+end
+
+rule x = 200 & (y = 100 | trap) ==> begin
+  x := 0;
+  y := 0;
+end
+
+rule !trap & x = 150 & y = 20 ==> begin
+  trap := true;
+end
+
+liveness "x is 200" x = 200;
+
+liveness "y is 100" y = 100;
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+
+'''
+Test that a multithreaded verifier generated with --minimal-traces reports a
+shortest counterexample trace, even when threads race to reach states via
+longer paths.
+'''
+
+import os
+import re
+import shutil
+import subprocess as sp
+import sys
+import tempfile
+
+# x can be advanced by 1 or 10, so the shortest way to 999 is 99 jumps and 9
+# steps, while wiggling y gives threads plenty of other states to race through
+MODEL = '''
+var
+  x: 0 .. 1000;
+  y: 0 .. 30;
+
+startstate begin
+  x := 0;
+  y := 0;
+end;
+
+rule "step" x < 1000 ==> begin
+  x := x + 1;
+end;
+
+rule "jump" x < 990 ==> begin
+  x := x + 10;
+end;
+
+rule "wiggle" y < 30 ==> begin
+  y := y + 1;
+end;
+
+rule "unwiggle" y > 0 ==> begin
+  y := y - 1;
+end;
+
+invariant "x is not 999" x != 999;
+'''
+
+def main():
+
+  tmp = tempfile.mkdtemp()
+  try:
+    model_c = os.path.join(tmp, 'model.c')
+    sp.run(['rumur', '--threads', '4', '--minimal-traces', 'on', '--output',
+      model_c], check=True, input=MODEL.encode('utf-8', 'replace'))
+
+    model_bin = os.path.join(tmp, 'model.exe')
+    argv = [os.environ.get('CC', 'cc'), '-std=c11', '-o', model_bin, model_c,
+      '-lpthread']
+    if os.environ.get('HAS_MCX16') == 'True':
+      argv.append('-mcx16')
+    if os.environ.get('NEEDS_LIBATOMIC') == 'True':
+      argv.append('-latomic')
+    sp.run(argv, check=True)
+
+    # the threads' interleaving differs from run to run, so try a few
+    for _ in range(5):
+      p = sp.run([model_bin], stdout=sp.PIPE, stderr=sp.STDOUT,
+        universal_newlines=True)
+      assert p.returncode != 0, f'invariant violation not found:\n{p.stdout}'
+
+      steps = re.findall(r'^(?:Startstate|Rule) .* fired\.$', p.stdout,
+        re.MULTILINE)
+      assert len(steps) == 1 + 99 + 9, \
+        f'counterexample trace of {len(steps)} steps is not minimal:\n{p.stdout}'
+
+  finally:
+    shutil.rmtree(tmp)
+
+  return 0
+
+if __name__ == '__main__':
+  sys.exit(main())
@@ -0,0 +1,22 @@
+-- rumur_flags: ['--numa', 'on']
+-- checker_output: re.compile(r'<summary states="20"' if self.xml else r'\b20 states\b')
+
+-- a basic model checked with NUMA-aware placement, which should find the same
+-- states as without it
+
+var
+  x: 0 .. 9;
+  y: boolean;
+
+startstate begin
+  x := 0;
+  y := false;
+end;
+
+rule begin
+  x := (x + 1) % 10;
+end;
+
+rule begin
+  y := !y;
+end;
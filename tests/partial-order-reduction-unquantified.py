@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+
+'''
+Test that partial order reduction of a model with no quantified rules generates
+a checker that compiles cleanly and reduces the state space.
+'''
+
+import os
+import re
+import shutil
+import subprocess as sp
+import sys
+import tempfile
+
+# two independent rules, neither of them in a ruleset, so only one order of
+# them needs to be explored
+MODEL = '''
+var
+  a: boolean;
+  b: boolean;
+
+startstate begin
+  a := false;
+  b := false;
+end;
+
+rule "set a" !a ==> begin
+  a := true;
+end;
+
+rule "set b" !b ==> begin
+  b := true;
+end;
+
+rule "reset" a & b ==> begin
+  a := false;
+  b := false;
+end;
+'''
+
+def main():
+
+  tmp = tempfile.mkdtemp()
+  try:
+    model_c = os.path.join(tmp, 'model.c')
+    sp.run(['rumur', '--partial-order-reduction', 'on', '--output', model_c],
+      check=True, input=MODEL.encode('utf-8', 'replace'))
+
+    # the checker should compile without warnings
+    model_bin = os.path.join(tmp, 'model.exe')
+    argv = [os.environ.get('CC', 'cc'), '-std=c11', '-O2', '-Wall', '-Wextra',
+      '-Werror', '-o', model_bin, model_c, '-lpthread']
+    if os.environ.get('HAS_MCX16') == 'True':
+      argv.append('-mcx16')
+    if os.environ.get('NEEDS_LIBATOMIC') == 'True':
+      argv.append('-latomic')
+    sp.run(argv, check=True)
+
+    output = sp.check_output([model_bin], universal_newlines=True)
+    assert re.search(r'\b3 states\b', output), \
+      f'unexpected number of states explored:\n{output}'
+
+  finally:
+    shutil.rmtree(tmp)
+
+  return 0
+
+if __name__ == '__main__':
+  sys.exit(main())
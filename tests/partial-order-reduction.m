@@ -0,0 +1,29 @@
+-- rumur_flags: ['--partial-order-reduction', 'on']
+-- checker_output: re.compile(r'<summary states="7"' if self.xml else r'\b7 states\b')
+
+-- three independent counters that are reset together. Without partial order
+-- reduction every interleaving of the increments is explored (27 states). Each
+-- increment is independent of the others, so only one needs to be expanded in
+-- any state, leaving a single path to the state in which the reset is enabled
+
+var c: array[0..2] of 0..2;
+
+startstate begin
+  for i: 0..2 do
+    c[i] := 0;
+  end;
+end;
+
+ruleset p: 0..2 do
+  rule c[p] < 2 ==>
+  begin
+    c[p] := c[p] + 1;
+  end;
+end;
+
+rule "reset" c[0] = 2 & c[1] = 2 & c[2] = 2 ==>
+begin
+  c[0] := 0;
+  c[1] := 0;
+  c[2] := 0;
+end;
@@ -0,0 +1,25 @@
+-- rumur_flags: ['--processes', '3']
+-- checker_exit_code: 1
+-- checker_output: None if self.xml else re.compile(r'\binvariant "corner" failed\b')
+
+-- test that an invariant violation found by any of the processes under
+-- --processes is reported
+
+var
+  x: 0 .. 20;
+  y: 0 .. 20;
+
+startstate begin
+  x := 0;
+  y := 0;
+end;
+
+rule x < 20 ==> begin
+  x := x + 1;
+end;
+
+rule y < 20 ==> begin
+  y := y + 1;
+end;
+
+invariant "corner" !(x = 20 & y = 20);
@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+
+'''
+Test that a verifier generated with --size-hint records the size of its run, and
+that a verifier generated from the result starts with a large enough seen set.
+'''
+
+import os
+import re
+import shutil
+import subprocess as sp
+import sys
+import tempfile
+
+MODEL = '''
+var
+  x: 0 .. 200;
+  y: 0 .. 100;
+
+startstate begin
+  x := 0;
+  y := 0;
+end;
+
+rule "inc x" x < 200 ==> begin
+  x := x + 1;
+end;
+
+rule "inc y" y < 100 ==> begin
+  y := y + 1;
+end;
+
+rule "reset" x = 200 & y = 100 ==> begin
+  x := 0;
+  y := 0;
+end;
+'''
+
+def check(tmp: str, args: [str]) -> sp.CompletedProcess:
+  '''generate, compile and run a checker'''
+
+  model_c = os.path.join(tmp, 'model.c')
+  sp.run(['rumur', '--output', model_c] + args, check=True,
+    input=MODEL.encode('utf-8', 'replace'))
+
+  model_bin = os.path.join(tmp, 'model.exe')
+  argv = [os.environ.get('CC', 'cc'), '-std=c11', '-o', model_bin, model_c,
+    '-lpthread']
+  if os.environ.get('HAS_MCX16') == 'True':
+    argv.append('-mcx16')
+  if os.environ.get('NEEDS_LIBATOMIC') == 'True':
+    argv.append('-latomic')
+  sp.run(argv, check=True)
+
+  return sp.run([model_bin], stdout=sp.PIPE, stderr=sp.STDOUT,
+    universal_newlines=True)
+
+def slots(output: str) -> int:
+  '''extract the initial size of the seen set from a checker's output'''
+  m = re.search(r'\bsize of the hash table is (\d+) slots\b', output)
+  assert m is not None, f'no hash table size in output:\n{output}'
+  return int(m.group(1))
+
+def main():
+
+  tmp = tempfile.mkdtemp()
+  try:
+    hint = os.path.join(tmp, 'hint')
+    args = ['--threads', '2', '--set-capacity', '4096', '--size-hint', hint]
+
+    # a first run, with no hint to go on, should record how many states it found
+    first = check(tmp, args)
+    assert first.returncode == 0, f'first run failed:\n{first.stdout}'
+    with open(hint, 'rt', encoding='utf-8') as f:
+      stats = f.read()
+    assert re.search(r'^states 20301$', stats, re.MULTILINE), \
+      f'state count not recorded:\n{stats}'
+
+    # a second run should start with room for all of these
+    second = check(tmp, args)
+    assert second.returncode == 0, f'second run failed:\n{second.stdout}'
+    assert '20301 states' in second.stdout, \
+      f'second run diverged:\n{second.stdout}'
+    assert slots(second.stdout) > slots(first.stdout), \
+      f'seen set was not resized:\n{first.stdout}\n{second.stdout}'
+    assert slots(second.stdout) * 75 // 100 > 20301, \
+      f'seen set is too small to avoid expanding:\n{second.stdout}'
+
+  finally:
+    shutil.rmtree(tmp)
+
+  return 0
+
+if __name__ == '__main__':
+  sys.exit(main())
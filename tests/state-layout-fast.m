@@ -0,0 +1,41 @@
+-- rumur_flags: ['--state-layout', 'fast']
+-- checker_output: re.compile(r'<summary states="18082"' if self.xml else r'\b18082 states\b')
+
+-- --state-layout fast should not change the states found. This model mixes
+-- fields that get widened to a whole number of bytes with a boolean that stays
+-- bit-packed, within records that get padded as array elements.
+
+type
+  r: record
+    flag: boolean;
+    count: 0 .. 20;
+    big: 0 .. 1000;
+  end;
+
+var
+  a: array[0 .. 2] of r;
+  b: boolean;
+  n: 0 .. 50;
+
+startstate begin
+  for i: 0 .. 2 do
+    a[i].flag := false;
+    a[i].count := 0;
+    a[i].big := 0;
+  end;
+  b := false;
+  n := 0;
+end;
+
+ruleset i: 0 .. 2 do
+  rule "bump" a[i].count < 20 & n < 50 ==> begin
+    a[i].count := a[i].count + 1;
+    a[i].big := (a[i].big + 7 * a[i].count) % 1001;
+    a[i].flag := !a[i].flag;
+    n := n + 1;
+  end;
+end;
+
+rule "toggle" true ==> begin
+  b := !b;
+end;
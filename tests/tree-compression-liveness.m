@@ -0,0 +1,17 @@
+-- rumur_flags: ['--tree-compression', '16']
+-- rumur_exit_code: 1
+
+-- --tree-compression should be rejected for a model with liveness properties
+
+var
+  x: boolean;
+
+startstate begin
+  x := false;
+end;
+
+rule begin
+  x := !x;
+end;
+
+liveness "x is eventually true" x;
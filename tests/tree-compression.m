@@ -0,0 +1,34 @@
+-- rumur_flags: ['--tree-compression', '16', '--set-capacity', '8192']
+-- checker_output: re.compile(r'<summary states="53136"[^>]* tree_nodes="' if self.xml else r'\b53136 states\b[\s\S]*\bTree compression stored \d+ distinct nodes\b')
+
+-- basic test of --tree-compression, with a variable wider than a leaf and an
+-- array of records that spans several leaves
+
+var
+  big: 0 .. 1099511627775;
+  a: array [0 .. 3] of record
+    x: 0 .. 2;
+    y: boolean;
+  end;
+
+startstate begin
+  big := 0;
+  for i: 0 .. 3 do
+    a[i].x := 0;
+    a[i].y := false;
+  end;
+end;
+
+rule "grow" big < 1099511627775 ==> begin
+  big := big * 2 + 1;
+end;
+
+ruleset i: 0 .. 3 do
+  rule "cycle" true ==> begin
+    a[i].x := (a[i].x + 1) % 3;
+  end;
+
+  rule "flip" true ==> begin
+    a[i].y := !a[i].y;
+  end;
+end;